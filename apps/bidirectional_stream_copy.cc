@@ -13,13 +13,15 @@ void bidirectional_stream_copy( Socket& socket, string_view peer_name )
 {
   constexpr size_t buffer_size = 1048576;
 
-  EventLoop _eventloop {};
+  EventLoop _eventloop { EventLoop::Backend::Epoll };
   FileDescriptor _input { STDIN_FILENO };
   FileDescriptor _output { STDOUT_FILENO };
-  ByteStream _outbound { buffer_size };
-  ByteStream _inbound { buffer_size };
+  // stdin -> socket can stay inside the kernel: bytes are spliced into a pipe and from there to the socket
+  ByteStream _outbound { buffer_size, ByteStream::Storage::Pipe };
+  ByteStream _inbound { buffer_size, ByteStream::Storage::Mirrored };
   bool _outbound_shutdown { false };
   bool _inbound_shutdown { false };
+  vector<string_view> _inbound_views {};
 
   socket.set_blocking( false );
   _input.set_blocking( false );
@@ -31,10 +33,7 @@ void bidirectional_stream_copy( Socket& socket, string_view peer_name )
     _input,
     Direction::In,
     [&] {
-      string data;
-      data.resize( _outbound.writer().available_capacity() );
-      _input.read( data );
-      _outbound.writer().push( move( data ) );
+      _outbound.writer().fill_from( _input );
       if ( _input.eof() ) {
         _outbound.writer().close();
       }
@@ -57,7 +56,7 @@ void bidirectional_stream_copy( Socket& socket, string_view peer_name )
     Direction::Out,
     [&] {
       if ( _outbound.reader().bytes_buffered() ) {
-        _outbound.reader().pop( socket.write( _outbound.reader().peek() ) );
+        _outbound.reader().drain_to( socket );
       }
       if ( _outbound.reader().is_finished() ) {
         socket.shutdown( SHUT_WR );
@@ -81,10 +80,7 @@ void bidirectional_stream_copy( Socket& socket, string_view peer_name )
     socket,
     Direction::In,
     [&] {
-      string data;
-      data.resize( _inbound.writer().available_capacity() );
-      socket.read( data );
-      _inbound.writer().push( move( data ) );
+      _inbound.writer().commit( socket.read( _inbound.writer().reserve() ) );
       if ( socket.eof() ) {
         _inbound.writer().close();
       }
@@ -107,7 +103,8 @@ void bidirectional_stream_copy( Socket& socket, string_view peer_name )
     Direction::Out,
     [&] {
       if ( _inbound.reader().bytes_buffered() ) {
-        _inbound.reader().pop( _output.write( _inbound.reader().peek() ) );
+        _inbound.reader().peek( _inbound_views );
+        _inbound.reader().pop( _output.write( _inbound_views ) );
       }
       if ( _inbound.reader().is_finished() ) {
         _output.close();
@@ -129,6 +126,10 @@ void bidirectional_stream_copy( Socket& socket, string_view peer_name )
   // loop until completion
   while ( true ) {
     if ( EventLoop::Result::Exit == _eventloop.wait_next_event( -1 ) ) {
+      if ( _outbound.stats().enabled ) {
+        cerr << "DEBUG: Outbound stream to " << peer_name << " stats:\n" << _outbound.stats().to_string();
+        cerr << "DEBUG: Inbound stream from " << peer_name << " stats:\n" << _inbound.stats().to_string();
+      }
       return;
     }
   }
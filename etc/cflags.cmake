@@ -1,6 +1,12 @@
 set (CMAKE_CXX_STANDARD 20)
 set (CMAKE_EXPORT_COMPILE_COMMANDS ON)
 
+# per-ByteStream occupancy and stall counters (ByteStream::stats); when off they are compiled out entirely
+option(BYTE_STREAM_STATS "Keep occupancy, stall and push/pop size counters in every ByteStream" OFF)
+if (BYTE_STREAM_STATS)
+  add_compile_definitions(BYTE_STREAM_STATS)
+endif ()
+
 set(SANITIZING_FLAGS -fno-sanitize-recover=all -fsanitize=undefined -fsanitize=address)
 
 # ask for more warnings from the compiler
@@ -23,6 +23,21 @@ ttest(byte_stream_one_write)
 ttest(byte_stream_two_writes)
 ttest(byte_stream_many_writes)
 ttest(byte_stream_stress_test)
+ttest(byte_stream_spsc)
+ttest(byte_stream_mpsc)
+ttest(byte_stream_pool)
+ttest(byte_stream_idle)
+ttest(byte_stream_readiness)
+ttest(byte_stream_splice)
+ttest(byte_stream_relay)
+ttest(eventloop_dispatch)
+ttest(eventloop_timers)
+ttest(eventloop_pool)
+ttest(eventloop_profile)
+ttest(eventloop_notify)
+ttest(eventloop_post)
+ttest(byte_stream_stats)
+ttest(eventloop_epoll)
 
 ttest(reassembler_single)
 ttest(reassembler_cap)
@@ -89,4 +104,15 @@ set_property(TEST ${compile_name_opt} PROPERTY TIMEOUT 0)
 set_tests_properties(${compile_name_opt} PROPERTIES FIXTURES_SETUP compile_opt)
 
 stest(byte_stream_speed_test)
+stest(byte_stream_spsc_speed_test)
+stest(byte_stream_mpsc_speed_test)
+stest(byte_stream_memory_speed_test)
+stest(byte_stream_spill_speed_test)
+stest(eventloop_speed_test)
+stest(eventloop_tcp_speed_test)
+stest(eventloop_timer_speed_test)
+stest(eventloop_churn_speed_test)
+stest(eventloop_copy_speed_test)
+stest(eventloop_pool_speed_test)
+stest(eventloop_post_speed_test)
 stest(reassembler_speed_test)
@@ -1,8 +1,247 @@
 #include "byte_stream.hh"
+#include "chunk_buffer.hh"
+#include "mirrored_buffer.hh"
+#include "pipe_buffer.hh"
+#include "pooled_buffer.hh"
+#include "ring_buffer.hh"
+#include "spill_buffer.hh"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
 
 using namespace std;
 
-ByteStream::ByteStream( uint64_t capacity ) : capacity_( capacity ) {}
+namespace {
+unique_ptr<StreamBuffer> make_buffer( uint64_t capacity, ByteStream::Storage storage )
+{
+  switch ( storage ) {
+    case ByteStream::Storage::Ring:
+      return make_unique<RingBuffer>( capacity );
+    case ByteStream::Storage::Chunked:
+      return make_unique<ChunkBuffer>();
+    case ByteStream::Storage::Mirrored:
+      return MirroredBuffer::make( capacity );
+    case ByteStream::Storage::Pooled:
+      return make_unique<PooledBuffer>();
+    case ByteStream::Storage::Pipe:
+      return PipeBuffer::make( capacity );
+    case ByteStream::Storage::Spilled:
+      return SpillBuffer::make( capacity );
+  }
+  throw runtime_error( "unknown ByteStream storage" );
+}
+} // namespace
+
+ByteStream::ByteStream( uint64_t capacity, Storage storage )
+  : buffer_( make_buffer( capacity, storage ) ), capacity_( capacity )
+{}
+
+ByteStream::ByteStream( const ByteStream& other )
+  : buffer_( other.buffer_->clone() )
+  , used_( other.used_ )
+  , endflag_( other.endflag_ )
+  , total_push_( other.total_push_ )
+  , total_pop_( other.total_pop_ )
+  , capacity_( other.capacity_ )
+  , error_( other.error_ )
+  , idle_timeout_( other.idle_timeout_ )
+  , drained_at_( other.drained_at_ )
+#ifdef BYTE_STREAM_STATS
+  , recorder_( other.recorder_ )
+#endif
+{}
+
+ByteStream& ByteStream::operator=( const ByteStream& other )
+{
+  if ( this != &other ) {
+    *this = ByteStream { other };
+  }
+  return *this;
+}
+
+ByteStream::ByteStream( ByteStream&& other ) noexcept = default;
+ByteStream& ByteStream::operator=( ByteStream&& other ) noexcept = default;
+ByteStream::~ByteStream() = default;
+
+void ByteStream::release_if_idle()
+{
+  // an open reservation points into the storage, so it stays until the reservation is committed
+  if ( used_ == 0 and reserved_ == 0 and chrono::steady_clock::now() - drained_at_ >= idle_timeout_ ) {
+    buffer_->shrink();
+  }
+}
+
+ByteStream::Readiness& ByteStream::readiness()
+{
+  if ( not readiness_ ) {
+    readiness_ = make_unique<Readiness>();
+    update_readiness();
+  }
+  return *readiness_;
+}
+
+void ByteStream::update_readiness()
+{
+  if ( not readiness_ ) {
+    return;
+  }
+
+  const auto sync = []( EventFD& fd, bool& is_set, bool should_be_set ) {
+    if ( should_be_set and not is_set ) {
+      fd.signal();
+    } else if ( is_set and not should_be_set ) {
+      fd.clear();
+    }
+    is_set = should_be_set;
+  };
+
+  sync( readiness_->readable, readiness_->readable_set, used_ > 0 or endflag_ or error_ );
+  sync( readiness_->writable,
+        readiness_->writable_set,
+        writer().available_capacity() > 0 and not endflag_ and not error_ );
+}
+
+void ByteStream::set_error()
+{
+  error_ = true;
+  update_readiness();
+}
+
+#ifdef BYTE_STREAM_STATS
+namespace {
+size_t size_bucket( uint64_t len )
+{
+  return min( static_cast<size_t>( bit_width( len ) ) - 1, ByteStream::Stats::size_buckets - 1 );
+}
+} // namespace
+
+ByteStream::Occupancy ByteStream::occupancy() const
+{
+  if ( used_ == 0 ) {
+    return Occupancy::Empty;
+  }
+  return writer().available_capacity() == 0 ? Occupancy::Full : Occupancy::Partial;
+}
+
+void ByteStream::record_occupancy()
+{
+  const Occupancy now_in = occupancy();
+  if ( now_in == recorder_.occupancy ) {
+    return;
+  }
+  const auto now = chrono::steady_clock::now();
+  if ( recorder_.occupancy == Occupancy::Full ) {
+    recorder_.stats.time_full += now - recorder_.since;
+  } else if ( recorder_.occupancy == Occupancy::Empty ) {
+    recorder_.stats.time_empty += now - recorder_.since;
+  }
+  recorder_.occupancy = now_in;
+  recorder_.since = now;
+}
+#endif
+
+string ByteStream::Stats::to_string() const
+{
+  if ( not enabled ) {
+    return "  (not compiled in; configure with -DBYTE_STREAM_STATS=ON)\n";
+  }
+
+  const auto ms = []( chrono::nanoseconds t ) { return std::to_string( t.count() / 1000000 ) + " ms"; };
+  const auto histogram = []( const array<uint64_t, size_buckets>& counts ) {
+    string out;
+    for ( size_t i = 0; i < counts.size(); ++i ) {
+      if ( counts[i] ) {
+        out += " " + std::to_string( uint64_t { 1 } << i ) + ( i + 1 == counts.size() ? "+" : "" ) + ":"
+               + std::to_string( counts[i] );
+      }
+    }
+    return out.empty() ? string { " (none)" } : out;
+  };
+
+  return "  high-water mark: " + std::to_string( high_water_mark ) + " bytes\n"
+         + "  truncated pushes: " + std::to_string( truncated_pushes ) + "\n"
+         + "  time full: " + ms( time_full ) + ", time empty: " + ms( time_empty ) + "\n"
+         + "  push sizes (bytes:count):" + histogram( push_sizes ) + "\n"
+         + "  pop sizes (bytes:count):" + histogram( pop_sizes ) + "\n";
+}
+
+ByteStream::Stats ByteStream::stats() const
+{
+#ifdef BYTE_STREAM_STATS
+  Stats snapshot = recorder_.stats;
+  const auto in_state = chrono::steady_clock::now() - recorder_.since;
+  if ( recorder_.occupancy == Occupancy::Full ) {
+    snapshot.time_full += in_state;
+  } else if ( recorder_.occupancy == Occupancy::Empty ) {
+    snapshot.time_empty += in_state;
+  }
+  return snapshot;
+#else
+  return {};
+#endif
+}
+
+void ByteStream::pushed( uint64_t len )
+{
+  if ( len == 0 ) {
+    return;
+  }
+  total_push_ += len;
+  used_ += len;
+
+#ifdef BYTE_STREAM_STATS
+  ++recorder_.stats.push_sizes[size_bucket( len )];
+  recorder_.stats.high_water_mark = max( recorder_.stats.high_water_mark, used_ );
+  record_occupancy();
+#endif
+
+  if ( readiness_ ) {
+    update_readiness();
+    // a writer rule that leaves room did its work without a clear(): count it for EventLoop's busy-wait check
+    if ( readiness_->writable_set ) {
+      readiness_->writable.register_read();
+    }
+  }
+}
+
+void ByteStream::popped( uint64_t len )
+{
+  if ( len == 0 ) {
+    return;
+  }
+  total_pop_ += len;
+  used_ -= len;
+
+#ifdef BYTE_STREAM_STATS
+  ++recorder_.stats.pop_sizes[size_bucket( len )];
+  record_occupancy();
+#endif
+
+  if ( used_ == 0 ) {
+    drained_at_ = chrono::steady_clock::now();
+  }
+
+  if ( readiness_ ) {
+    update_readiness();
+    if ( readiness_->readable_set ) {
+      readiness_->readable.register_read();
+    }
+  }
+}
+
+FileDescriptor& Writer::writable_fd()
+{
+  return readiness().writable;
+}
+
+FileDescriptor& Reader::readable_fd()
+{
+  return readiness().readable;
+}
 
 bool Writer::is_closed() const
 {
@@ -12,26 +251,97 @@ bool Writer::is_closed() const
 
 void Writer::push( string data )
 {
+  reserved_ = 0;
   // 是否close了
-  if (is_closed()) return;
+  if ( is_closed() ) {
+    return;
+  }
   // 可用的容量
-  uint64_t available_len = available_capacity();
-  uint64_t len = available_len >= data.length() ? data.length() : available_len;
-  // 将data压入buffer
-  buffer_ += data.substr(0, len);
-  total_push_ += len;
-  used_ += len;
-  return;
+  const uint64_t len = min( available_capacity(), static_cast<uint64_t>( data.length() ) );
+#ifdef BYTE_STREAM_STATS
+  if ( len < data.length() ) {
+    ++recorder_.stats.truncated_pushes;
+  }
+#endif
+  if ( len == 0 ) {
+    return;
+  }
+
+  // 只有容量不够时才截断 data, 否则整个字符串直接交给 buffer_
+  // A short prefix is copied out: resize() would keep the whole allocation alive for as long as it is buffered.
+  if ( len < data.length() ) {
+    if ( len < data.capacity() / 2 ) {
+      data = string( data, 0, len );
+    } else {
+      data.resize( len );
+    }
+  }
+  buffer_->push( move( data ) );
+  pushed( len );
+}
+
+span<char> Writer::reserve( uint64_t len )
+{
+  if ( is_closed() ) {
+    reserved_ = 0;
+    return {};
+  }
+#ifdef BYTE_STREAM_STATS
+  // asking for "as much as fits" (the default) is only cut short when nothing fits
+  if ( len > available_capacity() and ( len != UINT64_MAX or available_capacity() == 0 ) ) {
+    ++recorder_.stats.truncated_pushes;
+  }
+#endif
+  const span<char> space = buffer_->reserve( min( len, available_capacity() ) );
+  reserved_ = space.size();
+  return space;
+}
+
+void Writer::commit( uint64_t len )
+{
+  if ( reserved_ == 0 ) {
+    return;
+  }
+  len = min( len, reserved_ );
+  reserved_ = 0;
+  buffer_->commit( len ); // even an empty commit, so the storage can take back what it set aside
+  pushed( len );
+}
+
+uint64_t Writer::fill_from( FileDescriptor& fd )
+{
+  reserved_ = 0;
+  if ( is_closed() ) {
+    return 0;
+  }
+  const uint64_t len = available_capacity();
+#ifdef BYTE_STREAM_STATS
+  if ( len == 0 ) {
+    ++recorder_.stats.truncated_pushes;
+  }
+#endif
+  if ( len == 0 ) {
+    return 0;
+  }
+  const uint64_t bytes_read = buffer_->fill_from( fd, len );
+#ifdef BYTE_STREAM_STATS
+  if ( bytes_read == len ) {
+    ++recorder_.stats.truncated_pushes; // stopped by the stream's capacity, not by fd running dry
+  }
+#endif
+  pushed( bytes_read );
+  return bytes_read;
 }
 
 void Writer::close()
 {
   endflag_ = true;
+  update_readiness();
 }
 
 uint64_t Writer::available_capacity() const
 {
-  return capacity_ - used_;
+  return min( capacity_ - used_, buffer_->headroom() );
 }
 
 uint64_t Writer::bytes_pushed() const
@@ -51,16 +361,67 @@ uint64_t Reader::bytes_popped() const
 
 string_view Reader::peek() const
 {
-  return buffer_;
+  return buffer_->peek();
+}
+
+void Reader::peek( vector<string_view>& views, uint64_t len ) const
+{
+  views.clear();
+  buffer_->peek( views, len );
 }
 
 void Reader::pop( uint64_t len )
 {
-  if (len > buffer_.length()) len = buffer_.length();
-  buffer_ = buffer_.erase(0, len);
-  total_pop_ += len;
-  used_ -= len;
-  return;
+  len = min( len, used_ );
+  if ( len == 0 ) {
+    return;
+  }
+  reserved_ = 0; // popping may move the free space, so any outstanding reservation is void
+  buffer_->pop( len );
+  popped( len );
+}
+
+string Reader::take_chunk( uint64_t max_len )
+{
+  string chunk = buffer_->take_front( min( max_len, used_ ) );
+  if ( not chunk.empty() ) {
+    reserved_ = 0;
+    popped( chunk.size() );
+  }
+  return chunk;
+}
+
+uint64_t Reader::read( span<char> buffer )
+{
+  const uint64_t len = min( static_cast<uint64_t>( buffer.size() ), used_ );
+  if ( len == 0 ) {
+    return 0;
+  }
+  reserved_ = 0;
+
+  uint64_t copied = 0;
+  while ( copied < len ) {
+    const string_view view = buffer_->peek().substr( 0, len - copied );
+    if ( view.empty() ) {
+      throw runtime_error( "Reader::read(): buffer returned empty view" );
+    }
+    copy( view.begin(), view.end(), buffer.begin() + static_cast<ptrdiff_t>( copied ) );
+    buffer_->pop( view.size() );
+    copied += view.size();
+  }
+  popped( copied );
+  return copied;
+}
+
+uint64_t Reader::drain_to( FileDescriptor& fd )
+{
+  if ( used_ == 0 ) {
+    return 0;
+  }
+  reserved_ = 0;
+  const uint64_t bytes_written = buffer_->drain_to( fd, used_ );
+  popped( bytes_written );
+  return bytes_written;
 }
 
 uint64_t Reader::bytes_buffered() const
@@ -1,16 +1,41 @@
 #pragma once
 
+#include "eventfd.hh"
+
+#include <array>
+#include <chrono>
 #include <cstdint>
+#include <memory>
+#include <span>
 #include <string>
 #include <string_view>
+#include <vector>
 
 class Reader;
 class Writer;
+class StreamBuffer;
 
 class ByteStream
 {
 public:
-  explicit ByteStream( uint64_t capacity );
+  // How the buffered bytes are stored
+  enum class Storage
+  {
+    Ring,     // Ring buffer that grows on demand up to capacity; every push copies into it
+    Chunked,  // Queue of the pushed strings themselves; push and peek never copy
+    Mirrored, // Ring buffer mapped twice in a row, so peek() always sees every buffered byte
+    Pooled,   // Pages borrowed from the process-wide PagePool on push and returned on pop
+    Pipe,     // Kernel pipe; Writer::fill_from and Reader::drain_to splice(2) bytes without copying them
+    Spilled,  // Both ends in memory, the middle in a memory-mapped temp file (see SpillBuffer::set_window)
+  };
+
+  explicit ByteStream( uint64_t capacity, Storage storage = Storage::Ring );
+
+  ByteStream( const ByteStream& other );
+  ByteStream& operator=( const ByteStream& other );
+  ByteStream( ByteStream&& other ) noexcept;
+  ByteStream& operator=( ByteStream&& other ) noexcept;
+  ~ByteStream();
 
   // Helper functions (provided) to access the ByteStream's Reader and Writer interfaces
   Reader& reader();
@@ -18,18 +43,87 @@ public:
   Writer& writer();
   const Writer& writer() const;
 
-  void set_error() { error_ = true; };       // Signal that the stream suffered an error.
+  void set_error();                          // Signal that the stream suffered an error.
   bool has_error() const { return error_; }; // Has the stream had an error?
 
+  // Memory held by an empty stream is given back once it has stayed empty for `timeout` (default 1 s).
+  // The stream has no timer of its own: call release_if_idle() periodically, e.g. from an EventLoop rule.
+  void set_idle_timeout( std::chrono::milliseconds timeout ) { idle_timeout_ = timeout; }
+  void release_if_idle();
+
+  // Occupancy and stall counters, to tell whether the producer or the consumer holds a relay back.
+  // They are only kept when built with -DBYTE_STREAM_STATS=ON; otherwise they compile out entirely
+  // and stats() returns an all-zero snapshot with `enabled` false.
+  struct Stats
+  {
+    // Bucket 0 counts sizes of 1 byte, bucket i sizes in [2^i, 2^(i+1)), and the last bucket everything larger
+    static constexpr size_t size_buckets = 21;
+
+    bool enabled = false;
+    uint64_t high_water_mark = 0;  // largest bytes_buffered() seen
+    uint64_t truncated_pushes = 0; // pushes, reserves and fills cut short (or dropped) as the stream was full
+    std::chrono::nanoseconds time_full {};  // time spent with no available capacity (producer stalled)
+    std::chrono::nanoseconds time_empty {}; // time spent with nothing buffered (consumer starved)
+    std::array<uint64_t, size_buckets> push_sizes {};
+    std::array<uint64_t, size_buckets> pop_sizes {};
+
+    std::string to_string() const; // Multi-line summary, e.g. for printing at shutdown
+  };
+  Stats stats() const; // Snapshot of the counters, including time spent in the current state
+
 protected:
   // Please add any additional state to the ByteStream here, and not to the Writer and Reader interfaces.
-  std::string buffer_ = "";
+  std::unique_ptr<StreamBuffer> buffer_;
   uint64_t used_ = 0;
+  uint64_t reserved_ = 0; // size of the span handed out by the last Writer::reserve()
   bool endflag_ = false;
   uint64_t total_push_ = 0;
   uint64_t total_pop_ = 0;
   uint64_t capacity_;
   bool error_ = false;
+  std::chrono::milliseconds idle_timeout_ { 1000 };
+  std::chrono::steady_clock::time_point drained_at_ {}; // when the stream last became empty
+
+  // Readiness signals (created on first use by Reader::readable_fd or Writer::writable_fd) let an EventLoop
+  // sleep in poll() until the stream needs attention, instead of re-evaluating interest() predicates.
+  // Each is an eventfd, registered with Direction::In like any other fd rule. Copies do not share them.
+  struct Readiness
+  {
+    EventFD readable {}; // signalled while bytes are buffered, or the stream is closed or has an error
+    EventFD writable {}; // signalled while the stream is open, has no error and available_capacity() > 0
+    bool readable_set = false;
+    bool writable_set = false;
+  };
+  std::unique_ptr<Readiness> readiness_ {};
+
+  Readiness& readiness();  // Create the readiness signals if needed
+  void update_readiness(); // Signal or clear each eventfd to match the stream's state
+
+  // The signals are only brought up to date by this stream's own calls. A Pooled stream held back by the
+  // shared PagePool is not re-signalled when other streams return pages, only when its own reader pops:
+  // a writer that also waits on other streams' pages should re-check available_capacity() periodically.
+
+  void pushed( uint64_t len ); // Account for `len` bytes added to buffer_
+  void popped( uint64_t len ); // Account for `len` bytes removed from buffer_
+
+#ifdef BYTE_STREAM_STATS
+  enum class Occupancy
+  {
+    Empty,
+    Partial,
+    Full
+  };
+  struct Recorder
+  {
+    Stats stats { .enabled = true };
+    Occupancy occupancy = Occupancy::Empty;
+    std::chrono::steady_clock::time_point since = std::chrono::steady_clock::now(); // entered `occupancy`
+  };
+  Recorder recorder_ {};
+
+  Occupancy occupancy() const;
+  void record_occupancy(); // Charge the time spent in the previous occupancy state, if it changed
+#endif
 };
 
 class Writer : public ByteStream
@@ -38,17 +132,51 @@ public:
   void push( std::string data ); // Push data to stream, but only as much as available capacity allows.
   void close();                  // Signal that the stream has reached its ending. Nothing more will be written.
 
+  // Writable space inside the stream for up to `len` more bytes (never more than available_capacity()),
+  // e.g. for FileDescriptor::read to fill directly. The span may be shorter than requested, and is only
+  // empty if the stream is closed or full. It stays valid until the next call on the stream.
+  std::span<char> reserve( uint64_t len = UINT64_MAX );
+  void commit( uint64_t len ); // Push the first `len` bytes written into the reserved span
+
+  // Read from `fd` straight into the stream, up to available_capacity() bytes; returns number of bytes read.
+  // With Storage::Pipe the bytes are spliced into the pipe and never enter user space.
+  // As with FileDescriptor::read, check fd.eof() afterwards; the stream is not closed automatically.
+  uint64_t fill_from( FileDescriptor& fd );
+
+  // Pollable (Direction::In) while there is room to push; pushing counts as servicing it
+  FileDescriptor& writable_fd();
+
   // 函数后面的 const, 表示该成员函数不会修改对象的任何成员变量, 被称为“常量成员函数”
   bool is_closed() const;              // Has the stream been closed?
   uint64_t available_capacity() const; // How many bytes can be pushed to the stream right now?
   uint64_t bytes_pushed() const;       // Total number of bytes cumulatively pushed to the stream
+
+  // available_capacity() is capacity minus bytes buffered, capped by what the storage can take right
+  // now. Two storages can report less: a Pooled stream past its fair share of the PagePool, and a Pipe
+  // stream whose pipe came out smaller than its capacity (see PipeBuffer::make).
 };
 
 class Reader : public ByteStream
 {
 public:
   std::string_view peek() const; // Peek at the next bytes in the buffer
-  void pop( uint64_t len );      // Remove `len` bytes from the buffer
+
+  // Replace the contents of `views` with views of the next `len` bytes (or all buffered bytes, if fewer),
+  // e.g. to hand the whole buffer to FileDescriptor::write in a single system call
+  void peek( std::vector<std::string_view>& views, uint64_t len = UINT64_MAX ) const;
+  void pop( uint64_t len ); // Remove `len` bytes from the buffer
+
+  // Bulk read-out. take_chunk() pops the next chunk and hands over its string as-is, if the stream holds
+  // one (Storage::Chunked) that is no longer than `max_len`; otherwise it returns an empty string.
+  // read() copies up to buffer.size() bytes into `buffer` and pops them, returning how many it copied.
+  std::string take_chunk( uint64_t max_len );
+  uint64_t read( std::span<char> buffer );
+
+  // Write buffered bytes to `fd` and pop them; returns number of bytes written (spliced with Storage::Pipe)
+  uint64_t drain_to( FileDescriptor& fd );
+
+  // Pollable (Direction::In) while bytes are buffered or the stream is closed; popping counts as servicing it
+  FileDescriptor& readable_fd();
 
   bool is_finished() const;        // Is the stream finished (closed and fully popped)?
   uint64_t bytes_buffered() const; // Number of bytes currently buffered (pushed and not popped)
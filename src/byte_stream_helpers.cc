@@ -1,27 +1,26 @@
 #include "byte_stream.hh"
 
+#include <algorithm>
 #include <cstdint>
-#include <stdexcept>
+#include <span>
+#include <string>
 
 /*
- * read: A helper function thats peeks and pops up to `len` bytes
- * from a ByteStream Reader into a string;
+ * read: A helper function thats pops up to `len` bytes from a ByteStream Reader
+ * into a string. A chunk held as a string is handed over without copying;
+ * everything else is copied into `out`, which is sized once up front.
  */
 void read( Reader& reader, uint64_t len, std::string& out )
 {
-  out.clear();
-
-  while ( reader.bytes_buffered() and out.size() < len ) {
-    auto view = reader.peek();
-
-    if ( view.empty() ) {
-      throw std::runtime_error( "Reader::peek() returned empty string_view" );
-    }
-
-    view = view.substr( 0, len - out.size() ); // Don't return more bytes than desired.
-    out += view;
-    reader.pop( view.size() );
+  len = std::min( len, reader.bytes_buffered() );
+  out = reader.take_chunk( len );
+  if ( out.size() == len ) {
+    return;
   }
+
+  const uint64_t taken = out.size();
+  out.resize( len );
+  reader.read( std::span { out }.subspan( taken ) );
 }
 
 Reader& ByteStream::reader()
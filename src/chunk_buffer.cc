@@ -0,0 +1,78 @@
+#include "chunk_buffer.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+unique_ptr<StreamBuffer> ChunkBuffer::clone() const
+{
+  return make_unique<ChunkBuffer>( *this );
+}
+
+void ChunkBuffer::push( string data )
+{
+  if ( not data.empty() ) {
+    chunks_.push_back( move( data ) );
+  }
+}
+
+span<char> ChunkBuffer::reserve( uint64_t len )
+{
+  reserved_.resize( min( len, max_reservation ) );
+  return reserved_;
+}
+
+void ChunkBuffer::commit( uint64_t len )
+{
+  if ( len * 2 < reserved_.size() ) {
+    // a short read: queue a copy that fits it, and keep the reserved string for the next reservation
+    push( reserved_.substr( 0, len ) );
+    return;
+  }
+  reserved_.resize( len );
+  push( move( reserved_ ) );
+  reserved_.clear();
+}
+
+string_view ChunkBuffer::peek() const
+{
+  if ( chunks_.empty() ) {
+    return {};
+  }
+  return string_view { chunks_.front() }.substr( front_offset_ );
+}
+
+void ChunkBuffer::peek( vector<string_view>& views, uint64_t len ) const
+{
+  uint64_t offset = front_offset_;
+  for ( auto it = chunks_.begin(); it != chunks_.end() and len > 0; ++it ) {
+    const string_view view = string_view { *it }.substr( offset, len );
+    views.push_back( view );
+    len -= view.size();
+    offset = 0;
+  }
+}
+
+string ChunkBuffer::take_front( uint64_t len )
+{
+  if ( chunks_.empty() or front_offset_ != 0 or chunks_.front().size() > len ) {
+    return {};
+  }
+  string chunk = move( chunks_.front() );
+  chunks_.pop_front();
+  return chunk;
+}
+
+void ChunkBuffer::pop( uint64_t len )
+{
+  while ( len > 0 ) {
+    const uint64_t remaining = chunks_.front().size() - front_offset_;
+    if ( len < remaining ) {
+      front_offset_ += len;
+      return;
+    }
+    len -= remaining;
+    chunks_.pop_front();
+    front_offset_ = 0;
+  }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "stream_buffer.hh"
+
+#include <deque>
+
+// Queue of the strings handed to Writer::push, kept as-is.
+// Pushing moves the string in and peek() views the front chunk, so bytes are never copied.
+class ChunkBuffer : public StreamBuffer
+{
+  std::deque<std::string> chunks_ {};
+  uint64_t front_offset_ = 0; // bytes already popped from chunks_.front()
+  std::string reserved_ {};   // chunk handed out by reserve(), queued by commit()
+
+public:
+  std::unique_ptr<StreamBuffer> clone() const override;
+
+  void push( std::string data ) override;
+  std::string_view peek() const override;
+  void pop( uint64_t len ) override;
+  void peek( std::vector<std::string_view>& views, uint64_t len ) const override;
+  std::string take_front( uint64_t len ) override;
+  std::span<char> reserve( uint64_t len ) override;
+  void commit( uint64_t len ) override;
+};
@@ -0,0 +1,106 @@
+#include "mirrored_buffer.hh"
+#include "file_descriptor.hh"
+#include "ring_buffer.hh"
+
+#include <algorithm>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+// Map one `size`-byte memfd twice in a row; returns nullptr on any failure.
+char* map_mirrored( uint64_t size )
+{
+  const int memfd = memfd_create( "bytestream", MFD_CLOEXEC );
+  if ( memfd < 0 ) {
+    return nullptr;
+  }
+  const FileDescriptor pages { memfd }; // the mappings keep the pages alive after this is closed
+
+  if ( ftruncate( pages.fd_num(), static_cast<off_t>( size ) ) < 0 ) {
+    return nullptr;
+  }
+
+  // reserve 2 * size of address space, then map the memfd over each half
+  void* const reservation = mmap( nullptr, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if ( reservation == MAP_FAILED ) {
+    return nullptr;
+  }
+  char* const base = static_cast<char*>( reservation );
+
+  for ( char* const half : { base, base + size } ) {
+    if ( mmap( half, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, pages.fd_num(), 0 ) == MAP_FAILED ) {
+      munmap( base, 2 * size );
+      return nullptr;
+    }
+  }
+
+  return base;
+}
+} // namespace
+
+unique_ptr<StreamBuffer> MirroredBuffer::make( uint64_t capacity )
+{
+  const auto page_size = static_cast<uint64_t>( sysconf( _SC_PAGESIZE ) );
+  if ( capacity >= page_size ) {
+    const uint64_t size = ( capacity + page_size - 1 ) / page_size * page_size;
+    char* const base = map_mirrored( size );
+    if ( base ) {
+      return unique_ptr<StreamBuffer> { new MirroredBuffer { base, size } };
+    }
+  }
+
+  return make_unique<RingBuffer>( capacity );
+}
+
+MirroredBuffer::~MirroredBuffer()
+{
+  munmap( base_, 2 * size_ );
+}
+
+unique_ptr<StreamBuffer> MirroredBuffer::clone() const
+{
+  auto copy = make( size_ );
+  copy->push( string { peek() } );
+  return copy;
+}
+
+void MirroredBuffer::push( string data )
+{
+  // writes past the end of the first mapping land at the start of the buffer
+  copy( data.begin(), data.end(), base_ + head_ + used_ );
+  used_ += data.size();
+}
+
+span<char> MirroredBuffer::reserve( uint64_t len )
+{
+  // the free space is contiguous too, thanks to the second mapping
+  return { base_ + head_ + used_, min( len, size_ - used_ ) };
+}
+
+void MirroredBuffer::commit( uint64_t len )
+{
+  used_ += len;
+}
+
+string_view MirroredBuffer::peek() const
+{
+  return { base_ + head_, used_ };
+}
+
+void MirroredBuffer::peek( vector<string_view>& views, uint64_t len ) const
+{
+  if ( used_ and len ) {
+    views.emplace_back( base_ + head_, min( len, used_ ) );
+  }
+}
+
+void MirroredBuffer::pop( uint64_t len )
+{
+  head_ += len;
+  if ( head_ >= size_ ) {
+    head_ -= size_;
+  }
+  used_ -= len;
+}
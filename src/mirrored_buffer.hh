@@ -0,0 +1,37 @@
+#pragma once
+
+#include "stream_buffer.hh"
+
+// Circular buffer whose pages are mapped twice, back to back, in virtual memory.
+// A read or write that runs off the end of the first mapping lands at the start of the
+// same physical pages, so every buffered byte is always visible in one contiguous peek().
+class MirroredBuffer : public StreamBuffer
+{
+  char* base_;        // start of the first of the two mappings
+  uint64_t size_;     // size of one mapping (a multiple of the page size)
+  uint64_t head_ = 0; // offset of the next byte to be popped, always < size_
+  uint64_t used_ = 0; // number of bytes buffered
+
+  MirroredBuffer( char* base, uint64_t size ) : base_( base ), size_( size ) {}
+
+public:
+  // Returns a MirroredBuffer able to hold `capacity` bytes, or a RingBuffer if
+  // `capacity` is smaller than a page or the double mapping could not be set up.
+  static std::unique_ptr<StreamBuffer> make( uint64_t capacity );
+
+  ~MirroredBuffer() override;
+
+  std::unique_ptr<StreamBuffer> clone() const override;
+
+  void push( std::string data ) override;
+  std::string_view peek() const override;
+  void pop( uint64_t len ) override;
+  void peek( std::vector<std::string_view>& views, uint64_t len ) const override;
+  std::span<char> reserve( uint64_t len ) override;
+  void commit( uint64_t len ) override;
+
+  MirroredBuffer( const MirroredBuffer& other ) = delete;
+  MirroredBuffer& operator=( const MirroredBuffer& other ) = delete;
+  MirroredBuffer( MirroredBuffer&& other ) = delete;
+  MirroredBuffer& operator=( MirroredBuffer&& other ) = delete;
+};
@@ -0,0 +1,82 @@
+#include "mpsc_byte_stream.hh"
+
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+
+bool MPSCWriter::push( string_view record )
+{
+  if ( record.empty() or record.size() > capacity_ or is_closed() or has_error() ) {
+    return false;
+  }
+
+  // a waiting producer gives up once the stream is closed or has an error (e.g. the reader went away). Its
+  // claim is then never published, which stalls every later record, so they give up the same way.
+  const auto abandoned = [this] { return is_closed() or has_error(); };
+
+  // claim [start, start + size) of the stream
+  const uint64_t start = total_reserved_.fetch_add( record.size(), memory_order_relaxed );
+  const uint64_t end = start + record.size();
+
+  // wait for the reader to free the space we claimed
+  while ( end - total_pop_.load( memory_order_acquire ) > capacity_ ) {
+    if ( abandoned() ) {
+      return false;
+    }
+    this_thread::yield();
+  }
+
+  const uint64_t tail = start & mask_;
+  const uint64_t first = min( record.size(), storage_.size() - tail );
+  copy_n( record.begin(), first, storage_.begin() + static_cast<ptrdiff_t>( tail ) );
+  copy_n( record.begin() + first, record.size() - first, storage_.begin() );
+
+  // publish in stream order: wait for every earlier record, then extend the visible prefix past ours
+  while ( total_push_.load( memory_order_acquire ) != start ) {
+    if ( abandoned() ) {
+      return false;
+    }
+    this_thread::yield();
+  }
+  total_push_.store( end, memory_order_release );
+
+  return true;
+}
+
+void MPSCWriter::close()
+{
+  closed_.store( true, memory_order_release );
+}
+
+bool MPSCWriter::is_closed() const
+{
+  return closed_.load( memory_order_relaxed );
+}
+
+uint64_t MPSCWriter::available_capacity() const
+{
+  const uint64_t claimed = total_reserved_.load( memory_order_relaxed ) - total_pop_.load( memory_order_acquire );
+  return capacity_ - min( claimed, capacity_ );
+}
+
+uint64_t MPSCWriter::bytes_pushed() const
+{
+  return total_push_.load( memory_order_acquire );
+}
+
+MPSCWriter& MPSCByteStream::writer()
+{
+  static_assert( sizeof( MPSCWriter ) == sizeof( MPSCByteStream ),
+                 "Please add member variables to the MPSCByteStream base, not the MPSCByteStream Writer." );
+
+  return static_cast<MPSCWriter&>( *this ); // NOLINT(*-downcast)
+}
+
+const MPSCWriter& MPSCByteStream::writer() const
+{
+  static_assert( sizeof( MPSCWriter ) == sizeof( MPSCByteStream ),
+                 "Please add member variables to the MPSCByteStream base, not the MPSCByteStream Writer." );
+
+  return static_cast<const MPSCWriter&>( *this ); // NOLINT(*-downcast)
+}
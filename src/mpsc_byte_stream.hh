@@ -0,0 +1,39 @@
+#pragma once
+
+#include "spsc_byte_stream.hh"
+
+class MPSCWriter;
+
+// A ByteStream that any number of writer threads may push whole records into, for one reader thread.
+// Each push claims its place in the stream with a single fetch-add on total_reserved_, copies the record
+// in, then publishes it by advancing total_push_ once every earlier record has been published. The reader
+// (the SPSCReader interface) therefore only ever sees complete records, never interleaved.
+class MPSCByteStream : public SPSCByteStream
+{
+public:
+  explicit MPSCByteStream( uint64_t capacity ) : SPSCByteStream( capacity ) {}
+
+  // Access the stream's Writer interface (any thread); reader() is inherited (one thread)
+  MPSCWriter& writer();
+  const MPSCWriter& writer() const;
+
+protected:
+  // bytes claimed by producers, including records still being copied in (>= total_push_)
+  alignas( cache_line_size ) std::atomic<uint64_t> total_reserved_ { 0 };
+};
+
+class MPSCWriter : public MPSCByteStream
+{
+public:
+  // Push `record` as one unit, waiting for the reader to free space if necessary.
+  // Returns false (and pushes nothing) if the record is larger than the capacity, or if the stream is closed or
+  // has an error, including one set while the push waits. A reader that stops reading should set_error().
+  bool push( std::string_view record );
+
+  // Signal that the stream has reached its ending. Call only after every producer's last push has returned.
+  void close();
+
+  bool is_closed() const;              // Has the stream been closed?
+  uint64_t available_capacity() const; // Unclaimed space right now (may shrink before a push)
+  uint64_t bytes_pushed() const;       // Total number of bytes published to the reader
+};
@@ -0,0 +1,100 @@
+#include "page_pool.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+PagePool& PagePool::global()
+{
+  static PagePool pool;
+  return pool;
+}
+
+PagePool::~PagePool()
+{
+  for ( char* const page : free_pages_ ) {
+    delete[] page; // NOLINT(*-owning-memory)
+  }
+}
+
+void PagePool::set_limit( uint64_t bytes )
+{
+  limit_pages_.store( max( bytes / page_size, uint64_t { 1 } ), memory_order_relaxed );
+}
+
+PagePool::Stats PagePool::stats() const
+{
+  uint64_t free_pages = 0;
+  {
+    const lock_guard lock { mutex_ };
+    free_pages = free_pages_.size();
+  }
+  return { limit_pages_.load( memory_order_relaxed ),
+           pages_in_use_.load( memory_order_relaxed ),
+           peak_pages_.load( memory_order_relaxed ),
+           free_pages,
+           streams_.load( memory_order_relaxed ) };
+}
+
+void PagePool::add_stream()
+{
+  streams_.fetch_add( 1, memory_order_relaxed );
+}
+
+void PagePool::remove_stream()
+{
+  streams_.fetch_sub( 1, memory_order_relaxed );
+}
+
+uint64_t PagePool::grantable( uint64_t pages_held ) const
+{
+  return grantable( pages_held, pages_in_use_.load( memory_order_relaxed ) );
+}
+
+uint64_t PagePool::grantable( uint64_t pages_held, uint64_t pages_in_use ) const
+{
+  const uint64_t limit_pages = limit_pages_.load( memory_order_relaxed );
+  const uint64_t streams = streams_.load( memory_order_relaxed );
+  const uint64_t room = limit_pages > pages_in_use ? limit_pages - pages_in_use : 0;
+  const uint64_t fair_share = max( limit_pages / max( streams, uint64_t { 1 } ), uint64_t { 1 } );
+  const uint64_t within_share = fair_share > pages_held ? fair_share - pages_held : 0;
+  const uint64_t spare = limit_pages / 2 > pages_in_use ? limit_pages / 2 - pages_in_use : 0;
+  return min( room, max( within_share, spare ) );
+}
+
+char* PagePool::acquire( uint64_t pages_held, bool ignore_limit )
+{
+  // claim the page against the ceiling first; the claim only succeeds if nobody else's got in between
+  uint64_t in_use = pages_in_use_.load( memory_order_relaxed );
+  do {
+    if ( not ignore_limit and grantable( pages_held, in_use ) == 0 ) {
+      return nullptr;
+    }
+  } while ( not pages_in_use_.compare_exchange_weak( in_use, in_use + 1, memory_order_relaxed ) );
+
+  uint64_t peak = peak_pages_.load( memory_order_relaxed );
+  while ( peak < in_use + 1 and not peak_pages_.compare_exchange_weak( peak, in_use + 1, memory_order_relaxed ) ) {}
+
+  {
+    const lock_guard lock { mutex_ };
+    if ( not free_pages_.empty() ) {
+      char* const page = free_pages_.back();
+      free_pages_.pop_back();
+      return page;
+    }
+  }
+  return new char[page_size]; // NOLINT(*-owning-memory)
+}
+
+void PagePool::release( char* page )
+{
+  pages_in_use_.fetch_sub( 1, memory_order_relaxed );
+  {
+    const lock_guard lock { mutex_ };
+    if ( free_pages_.size() < max_free_pages ) {
+      free_pages_.push_back( page );
+      return;
+    }
+  }
+  delete[] page; // NOLINT(*-owning-memory)
+}
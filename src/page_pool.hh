@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Process-wide pool of fixed-size pages that pooled ByteStreams borrow on push and return on pop.
+// The pool enforces a global ceiling on pages in use. Within it, each stream is guaranteed its fair
+// share (the ceiling divided among the registered streams), and may borrow beyond that share only while
+// less than half of the ceiling is in use, so one busy stream cannot starve the rest.
+// The counters are atomic, so asking what may be borrowed (every available_capacity() of a pooled stream)
+// takes no lock; only handing pages out of and back into the free list does.
+class PagePool
+{
+public:
+  static constexpr uint64_t page_size = 16384;
+
+  struct Stats
+  {
+    uint64_t limit_pages;  // ceiling on pages in use
+    uint64_t pages_in_use; // pages currently lent to streams
+    uint64_t peak_pages;   // high-water mark of pages_in_use
+    uint64_t free_pages;   // returned pages kept for reuse
+    uint64_t streams;      // registered streams
+  };
+
+  static PagePool& global();
+
+  void set_limit( uint64_t bytes ); // Ceiling on memory lent out (rounded down to whole pages, at least one)
+  Stats stats() const;
+
+  void add_stream();
+  void remove_stream();
+
+  // How many more pages a stream already holding `pages_held` may borrow right now (a snapshot: other streams
+  // may borrow or return pages at any moment)
+  uint64_t grantable( uint64_t pages_held ) const;
+
+  // Borrow a page, or nullptr if grantable( pages_held ) is zero (unless `ignore_limit`)
+  char* acquire( uint64_t pages_held, bool ignore_limit = false );
+  void release( char* page );
+
+  PagePool() = default;
+  ~PagePool();
+  PagePool( const PagePool& other ) = delete;
+  PagePool& operator=( const PagePool& other ) = delete;
+  PagePool( PagePool&& other ) = delete;
+  PagePool& operator=( PagePool&& other ) = delete;
+
+private:
+  static constexpr uint64_t max_free_pages = 256; // returned pages kept for reuse; the rest go back to the OS
+
+  uint64_t grantable( uint64_t pages_held, uint64_t pages_in_use ) const;
+
+  mutable std::mutex mutex_ {}; // guards free_pages_ only
+  std::vector<char*> free_pages_ {};
+  std::atomic<uint64_t> limit_pages_ { UINT64_MAX };
+  std::atomic<uint64_t> pages_in_use_ {};
+  std::atomic<uint64_t> peak_pages_ {};
+  std::atomic<uint64_t> streams_ {};
+};
@@ -0,0 +1,231 @@
+#include "pipe_buffer.hh"
+#include "exception.hh"
+#include "ring_buffer.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+// write(2) to a non-blocking pipe; returns 0 instead of failing if the pipe is full
+uint64_t write_some( const FileDescriptor& pipe, string_view data )
+{
+  if ( data.empty() ) {
+    return 0;
+  }
+  const ssize_t bytes_written = ::write( pipe.fd_num(), data.data(), data.size() );
+  if ( bytes_written < 0 ) {
+    if ( errno == EAGAIN ) {
+      return 0;
+    }
+    throw unix_error { "write" };
+  }
+  return bytes_written;
+}
+} // namespace
+
+PipeBuffer::PipeBuffer( FileDescriptor read_end, FileDescriptor write_end, uint64_t pipe_size )
+  : read_end_( move( read_end ) ), write_end_( move( write_end ) ), pipe_size_( pipe_size )
+{}
+
+unique_ptr<StreamBuffer> PipeBuffer::make( uint64_t capacity )
+{
+  int fds[2] {};
+  if ( ::pipe2( fds, O_NONBLOCK | O_CLOEXEC ) != 0 ) { // NOLINT(*-array-to-pointer-decay)
+    return make_unique<RingBuffer>( capacity );
+  }
+  FileDescriptor read_end { fds[0] };
+  FileDescriptor write_end { fds[1] };
+
+  // Unprivileged processes can't grow a pipe past pipe-max-size (1 MiB by default), so settle for the
+  // largest size the kernel accepts. It rounds sizes up to a power-of-two number of pages.
+  const auto default_size = static_cast<uint64_t>( CheckSystemCall( "fcntl", fcntl( fds[1], F_GETPIPE_SZ ) ) );
+  for ( uint64_t size = min( capacity, static_cast<uint64_t>( INT_MAX ) ); size > default_size; size /= 2 ) {
+    if ( fcntl( fds[1], F_SETPIPE_SZ, static_cast<int>( size ) ) >= 0 ) { // NOLINT(*-vararg)
+      break;
+    }
+  }
+  const auto pipe_size = static_cast<uint64_t>( CheckSystemCall( "fcntl", fcntl( fds[1], F_GETPIPE_SZ ) ) );
+
+  return unique_ptr<StreamBuffer> { new PipeBuffer { move( read_end ), move( write_end ), pipe_size } };
+}
+
+unique_ptr<StreamBuffer> PipeBuffer::clone() const
+{
+  pull( in_pipe_ );
+  auto copy = make( pipe_size_ );
+  copy->push( front_.substr( front_offset_ ) );
+  copy->push( back_ );
+  return copy;
+}
+
+void PipeBuffer::append( string_view data )
+{
+  // nothing may overtake bytes already waiting in back_
+  const uint64_t bytes_written = back_.empty() ? write_some( write_end_, data ) : 0;
+  in_pipe_ += bytes_written;
+  back_.append( data.substr( bytes_written ) );
+}
+
+void PipeBuffer::flush_back()
+{
+  const uint64_t bytes_written = write_some( write_end_, back_ );
+  in_pipe_ += bytes_written;
+  back_.erase( 0, bytes_written );
+}
+
+void PipeBuffer::pull( uint64_t len ) const
+{
+  len = min( len, in_pipe_ );
+  if ( len == 0 ) {
+    return;
+  }
+
+  front_.erase( 0, front_offset_ );
+  front_offset_ = 0;
+
+  uint64_t filled = front_.size();
+  front_.resize( filled + len );
+  while ( filled < front_.size() ) {
+    const uint64_t bytes_read = read_end_.read( span { front_ }.subspan( filled ) );
+    if ( bytes_read == 0 ) {
+      throw runtime_error( "PipeBuffer: pipe holds fewer bytes than were put in it" );
+    }
+    filled += bytes_read;
+  }
+  in_pipe_ -= len;
+}
+
+bool PipeBuffer::out_of_pages() const
+{
+  if ( in_pipe_ == 0 ) {
+    return false;
+  }
+  pollfd pfd { write_end_.fd_num(), POLLOUT, 0 };
+  return CheckSystemCall( "poll", ::poll( &pfd, 1, 0 ) ) == 0;
+}
+
+void PipeBuffer::push( string data )
+{
+  append( data );
+}
+
+span<char> PipeBuffer::reserve( uint64_t len )
+{
+  reserved_.resize( min( len, max_reservation ) );
+  return reserved_;
+}
+
+void PipeBuffer::commit( uint64_t len )
+{
+  append( string_view { reserved_ }.substr( 0, len ) );
+}
+
+string_view PipeBuffer::peek() const
+{
+  if ( front_size() == 0 ) {
+    pull( peek_size );
+  }
+  if ( front_size() > 0 ) {
+    return string_view { front_ }.substr( front_offset_ );
+  }
+  return back_;
+}
+
+void PipeBuffer::peek( vector<string_view>& views, uint64_t len ) const
+{
+  if ( len > front_size() ) {
+    pull( len - front_size() );
+  }
+  for ( const string_view part : { string_view { front_ }.substr( front_offset_ ), string_view { back_ } } ) {
+    if ( len > 0 and not part.empty() ) {
+      views.push_back( part.substr( 0, len ) );
+      len -= views.back().size();
+    }
+  }
+}
+
+void PipeBuffer::pop( uint64_t len )
+{
+  if ( len > front_size() ) {
+    pull( len - front_size() );
+  }
+
+  const uint64_t from_front = min( len, front_size() );
+  front_offset_ += from_front;
+  if ( front_size() == 0 ) {
+    front_.clear();
+    front_offset_ = 0;
+  }
+
+  back_.erase( 0, len - from_front );
+  flush_back();
+}
+
+uint64_t PipeBuffer::fill_from( FileDescriptor& fd, uint64_t len )
+{
+  flush_back();
+  if ( splice_in_ and back_.empty() ) {
+    try {
+      const uint64_t bytes_spliced = fd.splice_to( write_end_, len );
+      in_pipe_ += bytes_spliced;
+      // Nothing moved: either fd has nothing to read, or the pipe ran out of pages before reaching
+      // pipe_size_ bytes. Only the second needs reading into back_ below to keep the stream moving.
+      if ( bytes_spliced > 0 or fd.eof() or not out_of_pages() ) {
+        return bytes_spliced;
+      }
+    } catch ( const unix_error& e ) {
+      if ( e.error_code() != EINVAL ) {
+        throw;
+      }
+      splice_in_ = false; // e.g. a terminal or an O_APPEND file
+    }
+  }
+  return StreamBuffer::fill_from( fd, len );
+}
+
+uint64_t PipeBuffer::drain_to( FileDescriptor& fd, uint64_t len )
+{
+  if ( front_size() > 0 ) {
+    // bytes already pulled out of the pipe by peek() have to be written from user space
+    return StreamBuffer::drain_to( fd, min( len, front_size() ) );
+  }
+
+  flush_back();
+  if ( splice_out_ and in_pipe_ > 0 ) {
+    try {
+      const uint64_t bytes_spliced = read_end_.splice_to( fd, min( len, in_pipe_ ) );
+      in_pipe_ -= bytes_spliced;
+      flush_back();
+      return bytes_spliced;
+    } catch ( const unix_error& e ) {
+      if ( e.error_code() != EINVAL ) {
+        throw;
+      }
+      splice_out_ = false;
+    }
+  }
+  return StreamBuffer::drain_to( fd, len );
+}
+
+uint64_t PipeBuffer::headroom() const
+{
+  const uint64_t queued = in_pipe_ + back_.size();
+  return queued < pipe_size_ ? pipe_size_ - queued : 0;
+}
+
+void PipeBuffer::shrink()
+{
+  if ( front_size() == 0 ) {
+    front_.clear();
+    front_.shrink_to_fit();
+  }
+  reserved_.clear();
+  reserved_.shrink_to_fit();
+  back_.shrink_to_fit();
+}
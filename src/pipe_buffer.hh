@@ -0,0 +1,58 @@
+#pragma once
+
+#include "file_descriptor.hh"
+#include "stream_buffer.hh"
+
+// Buffer that keeps its bytes in a kernel pipe, so fill_from() and drain_to() can splice(2) them from one
+// file descriptor to another without the bytes ever being copied into user space.
+// Bytes pushed from user space are written into the pipe, and peek() has to read them back out, into a
+// string in front of those still in the pipe. Bytes that don't fit in the pipe (whose pages may be only
+// partly used after a splice) wait in a string behind it.
+// A reader that peeks copies what it sees out of the pipe (up to peek_size bytes at a time), and those bytes
+// are then written from user space by drain_to(); only the bytes never peeked at are spliced.
+class PipeBuffer : public StreamBuffer
+{
+  static constexpr uint64_t peek_size = 64 * 1024; // how much peek() reads out of the pipe at once
+
+  mutable FileDescriptor read_end_;
+  FileDescriptor write_end_;
+  uint64_t pipe_size_;                // how many bytes the kernel agreed the pipe may hold
+  mutable uint64_t in_pipe_ = 0;      // bytes currently in the pipe
+  mutable std::string front_ {};      // bytes read out of the pipe by peek(), ahead of those still in it
+  mutable uint64_t front_offset_ = 0; // bytes already popped from front_
+  std::string back_ {};               // bytes that did not fit in the pipe, behind those in it
+  std::string reserved_ {};           // space handed out by reserve(), written to the pipe by commit()
+  bool splice_in_ = true;             // cleared once a source fd refuses splice (EINVAL); read() from then on
+  bool splice_out_ = true;            // same for destination fds; write() from then on
+
+  PipeBuffer( FileDescriptor read_end, FileDescriptor write_end, uint64_t pipe_size );
+
+  void append( std::string_view data ); // Write to the pipe, or to back_ if it is in use or the pipe is full
+  void flush_back();                    // Move as much of back_ into the pipe as will fit
+  void pull( uint64_t len ) const;      // Read up to `len` bytes still in the pipe onto the end of front_
+  bool out_of_pages() const;            // Is the pipe out of free pages (holding less than pipe_size_)?
+  uint64_t front_size() const { return front_.size() - front_offset_; }
+
+public:
+  // Returns a PipeBuffer meant to hold `capacity` bytes, or a RingBuffer if no pipe could be created.
+  // The pipe may end up smaller than `capacity` (see /proc/sys/fs/pipe-max-size); headroom() accounts for it.
+  static std::unique_ptr<StreamBuffer> make( uint64_t capacity );
+
+  std::unique_ptr<StreamBuffer> clone() const override;
+
+  void push( std::string data ) override;
+  std::string_view peek() const override;
+  void pop( uint64_t len ) override;
+  void peek( std::vector<std::string_view>& views, uint64_t len ) const override;
+  std::span<char> reserve( uint64_t len ) override;
+  void commit( uint64_t len ) override;
+  uint64_t fill_from( FileDescriptor& fd, uint64_t len ) override;
+  uint64_t drain_to( FileDescriptor& fd, uint64_t len ) override;
+  uint64_t headroom() const override;
+  void shrink() override;
+
+  PipeBuffer( const PipeBuffer& other ) = delete;
+  PipeBuffer& operator=( const PipeBuffer& other ) = delete;
+  PipeBuffer( PipeBuffer&& other ) = delete;
+  PipeBuffer& operator=( PipeBuffer&& other ) = delete;
+};
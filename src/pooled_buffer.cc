@@ -0,0 +1,133 @@
+#include "pooled_buffer.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+PooledBuffer::PooledBuffer( PagePool& pool ) : pool_( pool )
+{
+  pool_.add_stream();
+}
+
+PooledBuffer::~PooledBuffer()
+{
+  for ( char* const page : pages_ ) {
+    pool_.release( page );
+  }
+  pool_.remove_stream();
+}
+
+unique_ptr<StreamBuffer> PooledBuffer::clone() const
+{
+  auto copy = make_unique<PooledBuffer>( pool_ );
+  vector<string_view> views;
+  peek( views, UINT64_MAX );
+  for ( const auto view : views ) {
+    // a copy must hold everything the original does, even past its fair share
+    string_view remaining = view;
+    while ( not remaining.empty() ) {
+      copy->make_room( true );
+      const uint64_t len = min( remaining.size(), PagePool::page_size - copy->tail_ );
+      copy_n( remaining.begin(), len, copy->pages_.back() + copy->tail_ );
+      copy->tail_ += len;
+      remaining.remove_prefix( len );
+    }
+  }
+  return copy;
+}
+
+bool PooledBuffer::make_room( bool ignore_limit )
+{
+  if ( not pages_.empty() and tail_ < PagePool::page_size ) {
+    return true;
+  }
+  char* const page = pool_.acquire( pages_.size(), ignore_limit );
+  if ( not page ) {
+    return false;
+  }
+  pages_.push_back( page );
+  tail_ = 0;
+  return true;
+}
+
+void PooledBuffer::drop_front()
+{
+  pool_.release( pages_.front() );
+  pages_.pop_front();
+  head_ = 0;
+}
+
+void PooledBuffer::push( string data )
+{
+  string_view remaining = data;
+  while ( not remaining.empty() ) {
+    // the ByteStream checked headroom() first, so only a race with another stream can make this fail
+    if ( not make_room() ) {
+      make_room( true );
+    }
+    const auto space = reserve( remaining.size() );
+    copy_n( remaining.begin(), space.size(), space.begin() );
+    commit( space.size() );
+    remaining.remove_prefix( space.size() );
+  }
+}
+
+string_view PooledBuffer::peek() const
+{
+  if ( pages_.empty() ) {
+    return {};
+  }
+  const uint64_t end = pages_.size() == 1 ? tail_ : PagePool::page_size;
+  return { pages_.front() + head_, end - head_ };
+}
+
+void PooledBuffer::peek( vector<string_view>& views, uint64_t len ) const
+{
+  for ( size_t i = 0; i < pages_.size() and len > 0; ++i ) {
+    const uint64_t begin = i == 0 ? head_ : 0;
+    const uint64_t end = i + 1 == pages_.size() ? tail_ : PagePool::page_size;
+    const uint64_t size = min( len, end - begin );
+    if ( size ) {
+      views.emplace_back( pages_[i] + begin, size );
+    }
+    len -= size;
+  }
+}
+
+void PooledBuffer::pop( uint64_t len )
+{
+  while ( len > 0 ) {
+    const uint64_t end = pages_.size() == 1 ? tail_ : PagePool::page_size;
+    const uint64_t n = min( len, end - head_ );
+    head_ += n;
+    len -= n;
+    if ( head_ == end ) {
+      drop_front(); // return the page to the pool as soon as it is drained
+    }
+  }
+}
+
+span<char> PooledBuffer::reserve( uint64_t len )
+{
+  if ( len == 0 or not make_room() ) {
+    return {};
+  }
+  return { pages_.back() + tail_, min( len, PagePool::page_size - tail_ ) };
+}
+
+void PooledBuffer::commit( uint64_t len )
+{
+  tail_ += len;
+  if ( tail_ == 0 ) {
+    // nothing landed in the page reserve() borrowed: give it back rather than hold it while idle
+    pool_.release( pages_.back() );
+    pages_.pop_back();
+    tail_ = pages_.empty() ? 0 : PagePool::page_size;
+  }
+}
+
+uint64_t PooledBuffer::headroom() const
+{
+  const uint64_t in_last_page = pages_.empty() ? 0 : PagePool::page_size - tail_;
+  return in_last_page + pool_.grantable( pages_.size() ) * PagePool::page_size;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "page_pool.hh"
+#include "stream_buffer.hh"
+
+#include <deque>
+
+// Buffer made of pages borrowed from a PagePool: a page is borrowed when the last one fills up and
+// returned as soon as it has been popped, so an idle stream holds no memory at all.
+class PooledBuffer : public StreamBuffer
+{
+  PagePool& pool_;
+  std::deque<char*> pages_ {};
+  uint64_t head_ = 0; // bytes already popped from pages_.front()
+  uint64_t tail_ = 0; // bytes written into pages_.back()
+
+  // Make sure the last page has room, borrowing a new one if allowed; returns false if none is available
+  bool make_room( bool ignore_limit = false );
+  void drop_front();
+
+public:
+  explicit PooledBuffer( PagePool& pool = PagePool::global() );
+  ~PooledBuffer() override;
+
+  std::unique_ptr<StreamBuffer> clone() const override;
+
+  void push( std::string data ) override;
+  std::string_view peek() const override;
+  void pop( uint64_t len ) override;
+  void peek( std::vector<std::string_view>& views, uint64_t len ) const override;
+  std::span<char> reserve( uint64_t len ) override;
+  void commit( uint64_t len ) override;
+  uint64_t headroom() const override;
+
+  PooledBuffer( const PooledBuffer& other ) = delete;
+  PooledBuffer& operator=( const PooledBuffer& other ) = delete;
+  PooledBuffer( PooledBuffer&& other ) = delete;
+  PooledBuffer& operator=( PooledBuffer&& other ) = delete;
+};
@@ -0,0 +1,116 @@
+#include "ring_buffer.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+unique_ptr<StreamBuffer> RingBuffer::clone() const
+{
+  auto copy = make_unique<RingBuffer>( capacity_ );
+  copy->grow( size_ );
+  vector<string_view> views;
+  peek( views, size_ );
+  for ( const auto view : views ) {
+    copy->push( string { view } );
+  }
+  return copy;
+}
+
+uint64_t RingBuffer::tail() const
+{
+  const uint64_t tail = head_ + size_;
+  return tail >= storage_size_ ? tail - storage_size_ : tail;
+}
+
+void RingBuffer::grow( uint64_t needed )
+{
+  if ( size_ + needed <= storage_size_ ) {
+    return;
+  }
+
+  // at least quadruple, so a stream that fills up steadily is only copied O(log capacity) times, and the
+  // storage it allocates and faults in on the way adds up to a third of the final size rather than all of it
+  const uint64_t new_size = min( capacity_, max( { initial_size, 4 * storage_size_, size_ + needed } ) );
+  auto grown = make_unique_for_overwrite<char[]>( new_size );
+
+  // move the buffered bytes to the start of the new storage
+  vector<string_view> views;
+  peek( views, size_ );
+  char* out = grown.get();
+  for ( const auto view : views ) {
+    out = copy( view.begin(), view.end(), out );
+  }
+
+  storage_ = move( grown );
+  storage_size_ = new_size;
+  head_ = 0;
+}
+
+void RingBuffer::push( string data )
+{
+  grow( data.size() );
+
+  // write at the tail, wrapping around to the start of storage_ if needed
+  const uint64_t tail = this->tail();
+  const uint64_t first = min( static_cast<uint64_t>( data.size() ), storage_size_ - tail );
+  copy_n( data.data(), first, storage_.get() + tail );
+  copy_n( data.data() + first, data.size() - first, storage_.get() );
+  size_ += data.size();
+}
+
+span<char> RingBuffer::reserve( uint64_t len )
+{
+  // only grow once full, and then by one growth step, so large reservations don't allocate everything
+  if ( size_ == storage_size_ ) {
+    grow( min( len, max( storage_size_, initial_size ) ) );
+  }
+
+  const uint64_t tail = this->tail();
+  const uint64_t contiguous = ( tail < head_ or size_ == storage_size_ ) ? head_ - tail : storage_size_ - tail;
+  return { storage_.get() + tail, min( len, contiguous ) };
+}
+
+void RingBuffer::commit( uint64_t len )
+{
+  size_ += len;
+}
+
+string_view RingBuffer::peek() const
+{
+  return { storage_.get() + head_, min( size_, storage_size_ - head_ ) };
+}
+
+void RingBuffer::peek( vector<string_view>& views, uint64_t len ) const
+{
+  len = min( len, size_ );
+  const uint64_t first = min( len, storage_size_ - head_ );
+  if ( first ) {
+    views.emplace_back( storage_.get() + head_, first );
+  }
+  if ( len > first ) {
+    views.emplace_back( storage_.get(), len - first );
+  }
+}
+
+void RingBuffer::pop( uint64_t len )
+{
+  head_ += len;
+  if ( head_ >= storage_size_ ) {
+    head_ -= storage_size_;
+  }
+  size_ -= len;
+
+  // start over at the beginning once empty, so the next peek is as contiguous as possible
+  if ( size_ == 0 ) {
+    head_ = 0;
+  }
+}
+
+void RingBuffer::shrink()
+{
+  if ( size_ == 0 ) {
+    storage_.reset();
+    storage_size_ = 0;
+    head_ = 0;
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "stream_buffer.hh"
+
+
+// Circular buffer that starts empty and grows geometrically (up to the stream's capacity) as data
+// arrives, and can be released again once drained. peek() returns the bytes up to the wrap point;
+// the rest become visible after a pop.
+class RingBuffer : public StreamBuffer
+{
+  static constexpr uint64_t initial_size = 4096;
+
+  std::unique_ptr<char[]> storage_ {}; // left uninitialized: bytes are always written before being read
+  uint64_t storage_size_ = 0;
+  uint64_t capacity_; // storage_size_ never grows beyond this
+  uint64_t head_ = 0; // index in storage_ of the next byte to be popped
+  uint64_t size_ = 0; // number of bytes buffered
+
+  uint64_t tail() const;
+  void grow( uint64_t needed ); // Make room for `needed` more bytes (size_ + needed <= capacity_)
+
+public:
+  explicit RingBuffer( uint64_t capacity ) : capacity_( capacity ) {}
+  ~RingBuffer() override = default;
+
+  std::unique_ptr<StreamBuffer> clone() const override;
+
+  void push( std::string data ) override;
+  std::string_view peek() const override;
+  void pop( uint64_t len ) override;
+  void peek( std::vector<std::string_view>& views, uint64_t len ) const override;
+  std::span<char> reserve( uint64_t len ) override;
+  void commit( uint64_t len ) override;
+  void shrink() override;
+
+  RingBuffer( const RingBuffer& other ) = delete;
+  RingBuffer& operator=( const RingBuffer& other ) = delete;
+  RingBuffer( RingBuffer&& other ) = delete;
+  RingBuffer& operator=( RingBuffer&& other ) = delete;
+};
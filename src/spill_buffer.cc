@@ -0,0 +1,231 @@
+#include "spill_buffer.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+atomic<uint64_t> SpillBuffer::window_ { SpillBuffer::default_window };
+
+void SpillBuffer::set_window( uint64_t bytes )
+{
+  window_ = max( bytes, uint64_t { 2 } );
+}
+
+unique_ptr<StreamBuffer> SpillBuffer::make( uint64_t capacity )
+{
+  if ( capacity <= window() ) {
+    return make_unique<RingBuffer>( capacity );
+  }
+
+  const char* dir = getenv( "TMPDIR" ); // NOLINT(concurrency-mt-unsafe)
+  if ( dir == nullptr or *dir == '\0' ) {
+    dir = "/var/tmp"; // unlike /tmp, rarely a tmpfs that would spill right back into memory
+  }
+  const int fd = open( dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600 ); // NOLINT(*-vararg)
+  if ( fd < 0 ) {
+    return make_unique<RingBuffer>( capacity );
+  }
+  FileDescriptor file { fd };
+
+  // a sparse file of the full size, so no access through the mapping can fall beyond the end of the file.
+  // Read bytes stay in the file until a whole punch step of them has built up, so it has room for those
+  // as well as the capacity: the writer never wraps onto a range that is still waiting to be punched.
+  const auto page_size = static_cast<uint64_t>( sysconf( _SC_PAGESIZE ) );
+  const uint64_t map_size = ( capacity + punch_step + 2 * page_size - 1 ) / page_size * page_size;
+  if ( ftruncate( fd, static_cast<off_t>( map_size ) ) != 0 ) {
+    return make_unique<RingBuffer>( capacity );
+  }
+  void* const map = mmap( nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0 );
+  if ( map == MAP_FAILED ) {
+    return make_unique<RingBuffer>( capacity );
+  }
+
+  return unique_ptr<StreamBuffer> {
+    new SpillBuffer { capacity, move( file ), static_cast<char*>( map ), map_size } };
+}
+
+SpillBuffer::SpillBuffer( uint64_t capacity, FileDescriptor file, char* map, uint64_t map_size )
+  : capacity_( capacity )
+  , half_window_( window() / 2 )
+  , front_( half_window_ )
+  , file_( move( file ) )
+  , map_( map )
+  , map_size_( map_size )
+{}
+
+SpillBuffer::~SpillBuffer()
+{
+  munmap( map_, map_size_ );
+}
+
+unique_ptr<StreamBuffer> SpillBuffer::clone() const
+{
+  auto copy = make( capacity_ );
+  vector<string_view> views;
+  peek( views, UINT64_MAX );
+  for ( const auto view : views ) {
+    copy->push( string { view } );
+  }
+  return copy;
+}
+
+void SpillBuffer::append( string_view data )
+{
+  // new bytes may only go into front_ while nothing is queued behind it
+  if ( appends_to_front() ) {
+    while ( not data.empty() and front_size_ < half_window_ ) {
+      const span<char> space = front_.reserve( min( data.size(), half_window_ - front_size_ ) );
+      copy( data.begin(), data.begin() + static_cast<ptrdiff_t>( space.size() ), space.begin() );
+      front_.commit( space.size() );
+      front_size_ += space.size();
+      data.remove_prefix( space.size() );
+    }
+  }
+
+  if ( not data.empty() ) {
+    back_.append( data );
+    spill();
+  }
+}
+
+void SpillBuffer::spill()
+{
+  if ( back_size() < half_window_ ) {
+    if ( back_offset_ >= half_window_ ) {
+      back_.erase( 0, back_offset_ ); // the reader is keeping up with back_; don't let it grow forever
+      back_offset_ = 0;
+    }
+    return;
+  }
+
+  string_view data = string_view { back_ }.substr( back_offset_ );
+  while ( not data.empty() ) {
+    const uint64_t offset = write_pos_ % map_size_;
+    // stop at the end of the file and wrap; keep each write's size well within an int
+    const uint64_t len = min( { data.size(), map_size_ - offset, uint64_t { 1 } << 30 } );
+    const ssize_t bytes_written = CheckSystemCall(
+      "pwrite", static_cast<int>( pwrite( file_.fd_num(), data.data(), len, static_cast<off_t>( offset ) ) ) );
+    write_pos_ += bytes_written;
+    data.remove_prefix( bytes_written );
+  }
+  back_.clear();
+  back_offset_ = 0;
+}
+
+void SpillBuffer::release_file_pages()
+{
+  // punch whole pages only, and in steps of at least punch_step (or the whole file, once it has been drained)
+  const auto page_size = static_cast<uint64_t>( sysconf( _SC_PAGESIZE ) );
+  const uint64_t step = spilled() == 0 ? page_size : max( page_size, punch_step );
+  const uint64_t end = read_pos_ / page_size * page_size;
+  if ( end < punched_pos_ + step ) {
+    return;
+  }
+
+  while ( punched_pos_ < end ) {
+    const uint64_t offset = punched_pos_ % map_size_;
+    const uint64_t len = min( end - punched_pos_, map_size_ - offset );
+    // NOLINTNEXTLINE(*-signed-bitwise)
+    if ( fallocate( file_.fd_num(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, len ) != 0 ) {
+      if ( errno != EOPNOTSUPP ) {
+        throw unix_error { "fallocate" };
+      }
+    }
+    punched_pos_ += len;
+  }
+}
+
+void SpillBuffer::push( string data )
+{
+  append( data );
+}
+
+span<char> SpillBuffer::reserve( uint64_t len )
+{
+  reserved_in_front_ = appends_to_front() and front_size_ < half_window_;
+  if ( reserved_in_front_ ) {
+    return front_.reserve( min( len, half_window_ - front_size_ ) );
+  }
+  reserved_.resize( min( { len, half_window_, max_reservation } ) );
+  return reserved_;
+}
+
+void SpillBuffer::commit( uint64_t len )
+{
+  if ( reserved_in_front_ ) {
+    front_.commit( len );
+    front_size_ += len;
+  } else {
+    append( string_view { reserved_ }.substr( 0, len ) );
+  }
+}
+
+string_view SpillBuffer::peek() const
+{
+  if ( front_size_ > 0 ) {
+    return front_.peek();
+  }
+  if ( spilled() > 0 ) {
+    const uint64_t offset = read_pos_ % map_size_;
+    return { map_ + offset, min( spilled(), map_size_ - offset ) };
+  }
+  return string_view { back_ }.substr( back_offset_ );
+}
+
+void SpillBuffer::peek( vector<string_view>& views, uint64_t len ) const
+{
+  front_.peek( views, len );
+  len -= min( len, front_size_ );
+
+  for ( uint64_t pos = read_pos_; len > 0 and pos < write_pos_; ) {
+    const uint64_t offset = pos % map_size_;
+    const uint64_t size = min( { len, write_pos_ - pos, map_size_ - offset } );
+    views.emplace_back( map_ + offset, size );
+    pos += size;
+    len -= size;
+  }
+
+  if ( len > 0 and back_size() > 0 ) {
+    views.push_back( string_view { back_ }.substr( back_offset_, len ) );
+  }
+}
+
+void SpillBuffer::pop( uint64_t len )
+{
+  const uint64_t from_front = min( len, front_size_ );
+  if ( from_front > 0 ) {
+    front_.pop( from_front );
+    front_size_ -= from_front;
+    len -= from_front;
+  }
+
+  const uint64_t from_file = min( len, spilled() );
+  if ( from_file > 0 ) {
+    read_pos_ += from_file;
+    len -= from_file;
+    release_file_pages();
+  }
+
+  back_offset_ += len;
+  if ( back_size() == 0 ) {
+    back_.clear();
+    back_offset_ = 0;
+  }
+}
+
+void SpillBuffer::shrink()
+{
+  front_.shrink();
+  if ( back_size() == 0 ) {
+    back_.shrink_to_fit();
+  }
+  reserved_.clear();
+  reserved_.shrink_to_fit();
+}
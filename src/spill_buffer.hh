@@ -0,0 +1,76 @@
+#pragma once
+
+#include "file_descriptor.hh"
+#include "ring_buffer.hh"
+
+#include <atomic>
+
+// Buffer for streams far larger than the memory they are allowed to use. The oldest bytes (about to be
+// read) and the newest ones (just written) stay in memory, in a window of window() bytes split between
+// the two ends; the middle of the stream spills to an unlinked temp file. The whole file is mapped
+// read-only once, so peek() returns views straight into the mapped pages instead of reading them back.
+// Consumed parts of the file are punched out, so neither disk nor page cache outlives the data.
+class SpillBuffer : public StreamBuffer
+{
+  static constexpr uint64_t punch_step = 1 << 20; // read bytes punched out of the file at a time
+
+  uint64_t capacity_;
+  uint64_t half_window_; // bytes kept in memory at each end
+
+  RingBuffer front_;        // oldest bytes, ahead of everything in the file
+  uint64_t front_size_ = 0; // bytes in front_
+
+  // The file is used as a circular buffer of map_size_ bytes: stream positions are kept as running
+  // totals, and position p lives at file offset p % map_size_.
+  FileDescriptor file_;
+  char* map_;               // read-only mapping of the whole file
+  uint64_t map_size_;       // file and mapping size: capacity_ plus a punch step, in whole pages
+  uint64_t read_pos_ = 0;   // position of the next spilled byte to be read
+  uint64_t write_pos_ = 0;  // position just past the last spilled byte
+  uint64_t punched_pos_ = 0; // position up to which consumed file pages have been released
+
+  std::string back_ {};      // newest bytes, behind everything in the file
+  uint64_t back_offset_ = 0; // bytes already popped from back_
+  std::string reserved_ {};  // space handed out by reserve() when it can't be in front_
+  bool reserved_in_front_ = false;
+
+  SpillBuffer( uint64_t capacity, FileDescriptor file, char* map, uint64_t map_size );
+
+  uint64_t spilled() const { return write_pos_ - read_pos_; }
+  uint64_t back_size() const { return back_.size() - back_offset_; }
+  bool appends_to_front() const { return spilled() == 0 and back_size() == 0; }
+
+  void append( std::string_view data ); // Append to front_ while it is the end of the stream, else to back_
+  void spill();                         // Write back_ to the file once it outgrows its half of the window
+  void release_file_pages();            // Punch out file pages that have been read
+
+  static std::atomic<uint64_t> window_;
+
+public:
+  static constexpr uint64_t default_window = 64 * 1024 * 1024;
+
+  // Memory window for SpillBuffers created from now on (at least 2 bytes)
+  static void set_window( uint64_t bytes );
+  static uint64_t window() { return window_; }
+
+  // Returns a SpillBuffer able to hold `capacity` bytes, or a RingBuffer if `capacity` fits in the window
+  // anyway or the temp file could not be created and mapped. Temp files go in $TMPDIR, else /var/tmp.
+  static std::unique_ptr<StreamBuffer> make( uint64_t capacity );
+
+  ~SpillBuffer() override;
+
+  std::unique_ptr<StreamBuffer> clone() const override;
+
+  void push( std::string data ) override;
+  std::string_view peek() const override;
+  void pop( uint64_t len ) override;
+  void peek( std::vector<std::string_view>& views, uint64_t len ) const override;
+  std::span<char> reserve( uint64_t len ) override;
+  void commit( uint64_t len ) override;
+  void shrink() override;
+
+  SpillBuffer( const SpillBuffer& other ) = delete;
+  SpillBuffer& operator=( const SpillBuffer& other ) = delete;
+  SpillBuffer( SpillBuffer&& other ) = delete;
+  SpillBuffer& operator=( SpillBuffer&& other ) = delete;
+};
@@ -0,0 +1,150 @@
+#include "spsc_byte_stream.hh"
+
+#include <algorithm>
+#include <bit>
+
+using namespace std;
+
+SPSCByteStream::SPSCByteStream( uint64_t capacity )
+  : capacity_( capacity ), mask_( bit_ceil( max( capacity, uint64_t { 1 } ) ) - 1 ), storage_( mask_ + 1 )
+{}
+
+void SPSCWriter::push( string_view data )
+{
+  while ( not data.empty() ) {
+    const auto space = reserve( data.size() );
+    if ( space.empty() ) {
+      return;
+    }
+    copy_n( data.begin(), space.size(), space.begin() );
+    commit( space.size() );
+    data.remove_prefix( space.size() );
+  }
+}
+
+span<char> SPSCWriter::reserve( uint64_t len )
+{
+  const uint64_t pushed = total_push_.load( memory_order_relaxed );
+  if ( is_closed() ) {
+    reserved_ = 0;
+    return {};
+  }
+
+  // only look at the reader's counter (and pull in its cache line) when the cached value is not enough
+  if ( capacity_ - ( pushed - cached_pop_ ) < min( len, capacity_ ) ) {
+    cached_pop_ = total_pop_.load( memory_order_acquire );
+  }
+
+  const uint64_t tail = pushed & mask_;
+  len = min( { len, capacity_ - ( pushed - cached_pop_ ), storage_.size() - tail } );
+  reserved_ = len;
+  return span { storage_ }.subspan( tail, len );
+}
+
+void SPSCWriter::commit( uint64_t len )
+{
+  len = min( len, reserved_ );
+  reserved_ = 0;
+  total_push_.store( total_push_.load( memory_order_relaxed ) + len, memory_order_release );
+}
+
+void SPSCWriter::close()
+{
+  closed_.store( true, memory_order_release );
+}
+
+bool SPSCWriter::is_closed() const
+{
+  return closed_.load( memory_order_relaxed );
+}
+
+uint64_t SPSCWriter::available_capacity() const
+{
+  return capacity_ - ( total_push_.load( memory_order_relaxed ) - total_pop_.load( memory_order_acquire ) );
+}
+
+uint64_t SPSCWriter::bytes_pushed() const
+{
+  return total_push_.load( memory_order_relaxed );
+}
+
+string_view SPSCReader::peek() const
+{
+  const uint64_t popped = total_pop_.load( memory_order_relaxed );
+  const uint64_t head = popped & mask_;
+  return { storage_.data() + head, min( total_push_.load( memory_order_acquire ) - popped, storage_.size() - head ) };
+}
+
+void SPSCReader::peek( vector<string_view>& views, uint64_t len ) const
+{
+  views.clear();
+  const uint64_t popped = total_pop_.load( memory_order_relaxed );
+  const uint64_t head = popped & mask_;
+  len = min( len, total_push_.load( memory_order_acquire ) - popped );
+
+  const uint64_t first = min( len, storage_.size() - head );
+  if ( first ) {
+    views.emplace_back( storage_.data() + head, first );
+  }
+  if ( len > first ) {
+    views.emplace_back( storage_.data(), len - first );
+  }
+}
+
+void SPSCReader::pop( uint64_t len )
+{
+  const uint64_t popped = total_pop_.load( memory_order_relaxed );
+  if ( popped + len > cached_push_ ) {
+    cached_push_ = total_push_.load( memory_order_acquire );
+  }
+  len = min( len, cached_push_ - popped );
+  total_pop_.store( popped + len, memory_order_release );
+}
+
+bool SPSCReader::is_finished() const
+{
+  // closed_ is stored after the last push, so once it reads true total_push_ is final
+  return closed_.load( memory_order_acquire ) and total_push_.load( memory_order_acquire ) == bytes_popped();
+}
+
+uint64_t SPSCReader::bytes_buffered() const
+{
+  return total_push_.load( memory_order_acquire ) - total_pop_.load( memory_order_relaxed );
+}
+
+uint64_t SPSCReader::bytes_popped() const
+{
+  return total_pop_.load( memory_order_relaxed );
+}
+
+SPSCReader& SPSCByteStream::reader()
+{
+  static_assert( sizeof( SPSCReader ) == sizeof( SPSCByteStream ),
+                 "Please add member variables to the SPSCByteStream base, not the SPSCByteStream Reader." );
+
+  return static_cast<SPSCReader&>( *this ); // NOLINT(*-downcast)
+}
+
+const SPSCReader& SPSCByteStream::reader() const
+{
+  static_assert( sizeof( SPSCReader ) == sizeof( SPSCByteStream ),
+                 "Please add member variables to the SPSCByteStream base, not the SPSCByteStream Reader." );
+
+  return static_cast<const SPSCReader&>( *this ); // NOLINT(*-downcast)
+}
+
+SPSCWriter& SPSCByteStream::writer()
+{
+  static_assert( sizeof( SPSCWriter ) == sizeof( SPSCByteStream ),
+                 "Please add member variables to the SPSCByteStream base, not the SPSCByteStream Writer." );
+
+  return static_cast<SPSCWriter&>( *this ); // NOLINT(*-downcast)
+}
+
+const SPSCWriter& SPSCByteStream::writer() const
+{
+  static_assert( sizeof( SPSCWriter ) == sizeof( SPSCByteStream ),
+                 "Please add member variables to the SPSCByteStream base, not the SPSCByteStream Writer." );
+
+  return static_cast<const SPSCWriter&>( *this ); // NOLINT(*-downcast)
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class SPSCReader;
+class SPSCWriter;
+
+// A ByteStream that one writer thread and one reader thread may use concurrently without a lock.
+// The writer publishes bytes by advancing total_push_ (release) and the reader frees space by advancing
+// total_pop_ (release); each side only ever writes its own counter, which lives on its own cache line.
+class SPSCByteStream
+{
+public:
+  explicit SPSCByteStream( uint64_t capacity );
+
+  // Helper functions to access the stream's Reader and Writer interfaces (one thread each)
+  SPSCReader& reader();
+  const SPSCReader& reader() const;
+  SPSCWriter& writer();
+  const SPSCWriter& writer() const;
+
+  void set_error() { error_.store( true, std::memory_order_relaxed ); }          // Signal an error.
+  bool has_error() const { return error_.load( std::memory_order_relaxed ); } // Has the stream had an error?
+
+protected:
+  static constexpr size_t cache_line_size = 64;
+
+  // writer's cache line
+  alignas( cache_line_size ) std::atomic<uint64_t> total_push_ { 0 };
+  uint64_t cached_pop_ = 0;     // writer's last view of total_pop_
+  uint64_t reserved_ = 0;       // size of the span handed out by the last SPSCWriter::reserve()
+  std::atomic<bool> closed_ {}; // set (release) by the writer after its last push
+
+  // reader's cache line
+  alignas( cache_line_size ) std::atomic<uint64_t> total_pop_ { 0 };
+  uint64_t cached_push_ = 0; // reader's last view of total_push_
+
+  // read-only after construction
+  alignas( cache_line_size ) uint64_t capacity_;
+  uint64_t mask_;            // storage_.size() - 1 (storage_ is a power of two in size)
+  std::vector<char> storage_;
+  std::atomic<bool> error_ {};
+};
+
+class SPSCWriter : public SPSCByteStream
+{
+public:
+  void push( std::string_view data ); // Push data to stream, but only as much as available capacity allows.
+  void close();                       // Signal that the stream has reached its ending.
+
+  std::span<char> reserve( uint64_t len = UINT64_MAX ); // Writable space in the stream (see Writer::reserve)
+  void commit( uint64_t len );                          // Publish the first `len` bytes of the reservation
+
+  bool is_closed() const;              // Has the stream been closed?
+  uint64_t available_capacity() const; // How many bytes can be pushed to the stream right now?
+  uint64_t bytes_pushed() const;       // Total number of bytes cumulatively pushed to the stream
+};
+
+class SPSCReader : public SPSCByteStream
+{
+public:
+  std::string_view peek() const; // Peek at the next bytes in the buffer (up to the wrap point)
+  void peek( std::vector<std::string_view>& views, uint64_t len = UINT64_MAX ) const; // See Reader::peek
+  void pop( uint64_t len );                                                          // Remove `len` bytes
+
+  bool is_finished() const;        // Is the stream finished (closed and fully popped)?
+  uint64_t bytes_buffered() const; // Number of bytes currently buffered (pushed and not popped)
+  uint64_t bytes_popped() const;   // Total number of bytes cumulatively popped from stream
+};
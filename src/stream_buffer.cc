@@ -0,0 +1,20 @@
+#include "stream_buffer.hh"
+#include "file_descriptor.hh"
+
+using namespace std;
+
+uint64_t StreamBuffer::fill_from( FileDescriptor& fd, uint64_t len )
+{
+  const uint64_t bytes_read = fd.read( reserve( len ) );
+  commit( bytes_read );
+  return bytes_read;
+}
+
+uint64_t StreamBuffer::drain_to( FileDescriptor& fd, uint64_t len )
+{
+  vector<string_view> views;
+  peek( views, len );
+  const uint64_t bytes_written = fd.write( views );
+  pop( bytes_written );
+  return bytes_written;
+}
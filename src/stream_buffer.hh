@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class FileDescriptor;
+
+// Storage for the bytes held by a ByteStream.
+// The ByteStream does all of the accounting (capacity, bytes pushed and popped, closing);
+// a StreamBuffer only keeps the bytes themselves, in whatever layout suits it.
+class StreamBuffer
+{
+public:
+  virtual ~StreamBuffer() = default;
+
+  // Deep copy, used when a ByteStream is copied
+  virtual std::unique_ptr<StreamBuffer> clone() const = 0;
+
+  virtual void push( std::string data ) = 0; // Append data (already truncated to fit by the ByteStream)
+  virtual std::string_view peek() const = 0; // Contiguous bytes at the front of the buffer
+  virtual void pop( uint64_t len ) = 0;      // Discard `len` bytes from the front (len <= bytes buffered)
+
+  // Append views of the first `len` buffered bytes (or all of them, if fewer) to `views`
+  virtual void peek( std::vector<std::string_view>& views, uint64_t len ) const = 0;
+
+  // If the first bytes are a whole string of at most `len` bytes held as-is, remove it from the buffer and
+  // return it (without copying); otherwise return an empty string and leave the buffer unchanged
+  virtual std::string take_front( uint64_t /* len */ ) { return {}; }
+
+  // Writable space for up to `len` bytes (len <= free space) after the buffered bytes. It may be shorter
+  // than `len`, but is only empty if `len` is zero. The next commit() appends the first bytes written there.
+  virtual std::span<char> reserve( uint64_t len ) = 0;
+  virtual void commit( uint64_t len ) = 0; // len <= size of the last reservation (and may be zero)
+
+  // How many more bytes the buffer can take right now, before the ByteStream's own capacity limit
+  virtual uint64_t headroom() const { return UINT64_MAX; }
+
+  // Move bytes between the buffer and a file descriptor: read up to `len` bytes (len <= free space) from `fd`
+  // onto the end of the buffer, or write up to `len` of the buffered bytes to `fd` and discard them.
+  // Both return the number of bytes moved. By default they go through reserve()/commit() and peek()/pop();
+  // a buffer that lives in the kernel can move them without copying through user space.
+  virtual uint64_t fill_from( FileDescriptor& fd, uint64_t len );
+  virtual uint64_t drain_to( FileDescriptor& fd, uint64_t len );
+
+  // Give back any memory that is not needed to hold the bytes currently buffered
+  virtual void shrink() {}
+
+protected:
+  // Buffers that hand out a string of their own from reserve() (rather than space in their storage) keep it
+  // no longer than this, so one reservation never allocates the stream's whole free space
+  static constexpr uint64_t max_reservation = 64 * 1024;
+
+  StreamBuffer() = default;
+  StreamBuffer( const StreamBuffer& other ) = default;
+  StreamBuffer& operator=( const StreamBuffer& other ) = default;
+  StreamBuffer( StreamBuffer&& other ) = default;
+  StreamBuffer& operator=( StreamBuffer&& other ) = default;
+};
@@ -0,0 +1,59 @@
+#include "byte_stream_test_harness.hh"
+#include "common.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// release_if_idle() gives back an empty stream's memory, but not out from under an open reservation
+void reservation_test( const ByteStream::Storage storage )
+{
+  const string name = storage_name( storage );
+  ByteStream bs { 65536, storage };
+  bs.set_idle_timeout( chrono::milliseconds { 0 } );
+
+  const auto space = bs.writer().reserve( 4096 );
+  expect( space.size() > 0, name + ": reserve() gave no room" );
+  const string data( space.size(), 'r' );
+  ranges::copy( data, space.begin() );
+  bs.release_if_idle();
+  bs.writer().commit( space.size() );
+
+  expect( bs.reader().bytes_buffered() == data.size(), name + ": bytes_buffered after commit" );
+  string got;
+  while ( bs.reader().bytes_buffered() > 0 ) {
+    const auto peeked = bs.reader().peek();
+    expect( not peeked.empty(), name + ": peek() is empty while bytes are buffered" );
+    got += peeked;
+    bs.reader().pop( peeked.size() );
+  }
+  expect( got == data, name + ": the committed bytes did not survive release_if_idle()" );
+
+  // once drained and released, the stream still works
+  bs.release_if_idle();
+  bs.writer().push( "after" );
+  expect( bs.reader().peek() == "after", name + ": push after release_if_idle()" );
+}
+
+int main()
+{
+  try {
+    for ( const auto storage : { ByteStream::Storage::Ring,
+                                 ByteStream::Storage::Chunked,
+                                 ByteStream::Storage::Mirrored,
+                                 ByteStream::Storage::Pooled,
+                                 ByteStream::Storage::Pipe,
+                                 ByteStream::Storage::Spilled } ) {
+      reservation_test( storage );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
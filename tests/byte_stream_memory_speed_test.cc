@@ -0,0 +1,82 @@
+#include "byte_stream.hh"
+
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <malloc.h>
+#include <stdexcept>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+// Resident set size of this process, in MiB
+double resident_mib()
+{
+  ifstream statm { "/proc/self/statm" };
+  size_t total_pages = 0;
+  size_t resident_pages = 0;
+  statm >> total_pages >> resident_pages;
+  return static_cast<double>( resident_pages * static_cast<size_t>( sysconf( _SC_PAGESIZE ) ) ) / 1048576.0;
+}
+
+void memory_test( const size_t streams, const size_t capacity, const size_t active_every )
+{
+  cout << fixed << setprecision( 1 );
+  cout << streams << " ByteStreams with capacity=" << capacity << ", one in " << active_every
+       << " holding capacity/2 bytes:\n";
+
+  // on-demand growth: most streams see one short message, then sit idle
+  {
+    malloc_trim( 0 );
+    const double before = resident_mib();
+    vector<ByteStream> pool;
+    pool.reserve( streams );
+    for ( size_t i = 0; i < streams; ++i ) {
+      auto& bs = pool.emplace_back( capacity );
+      if ( i % active_every == 0 ) {
+        bs.writer().push( string( capacity / 2, 'x' ) );
+      } else {
+        bs.writer().push( string( 200, 'x' ) );
+        bs.reader().pop( 200 );
+      }
+    }
+    const double grown = resident_mib() - before;
+
+    for ( auto& bs : pool ) {
+      bs.set_idle_timeout( chrono::milliseconds { 0 } );
+      bs.release_if_idle();
+    }
+    malloc_trim( 0 );
+    const double released = resident_mib() - before;
+
+    cout << "  on-demand, after traffic:      " << setw( 8 ) << grown << " MiB resident\n";
+    cout << "  on-demand, after idle release: " << setw( 8 ) << released << " MiB resident\n";
+  }
+
+  // what eager allocation at construction costs: one zero-filled capacity-sized buffer per stream
+  {
+    malloc_trim( 0 );
+    const double before = resident_mib();
+    vector<vector<char>> eager;
+    eager.reserve( streams );
+    for ( size_t i = 0; i < streams; ++i ) {
+      eager.emplace_back( capacity );
+    }
+    const double eager_mib = resident_mib() - before;
+    cout << "  eager allocation:              " << setw( 8 ) << eager_mib << " MiB resident\n";
+  }
+}
+
+int main()
+{
+  try {
+    memory_test( 10000, 65536, 100 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+#include "common.hh"
+#include "mpsc_byte_stream.hh"
+
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+// Record layout: [length][producer][sequence number][payload of `length` copies of the sequence number]
+string make_record( uint8_t producer, uint8_t sequence, uint8_t length )
+{
+  string record { static_cast<char>( length ), static_cast<char>( producer ), static_cast<char>( sequence ) };
+  record.append( length, static_cast<char>( sequence ) );
+  return record;
+}
+
+void fan_in_test( const size_t producers, const size_t records_per_producer, const size_t capacity )
+{
+  MPSCByteStream bs { capacity };
+
+  expect( not bs.writer().push( string( capacity + 1, 'x' ) ), "record larger than capacity was accepted" );
+
+  // nothing in here may throw while the producers run: a thread still joinable would call std::terminate
+  // instead of reporting. Failures are noted, and the reader keeps draining so the producers (which wait for
+  // room) all finish and are joined before the test reports them.
+  atomic<size_t> producers_done {};
+  atomic<bool> push_failed {};
+  vector<thread> threads;
+  for ( size_t p = 0; p < producers; ++p ) {
+    threads.emplace_back( [&, p] {
+      default_random_engine rd { p };
+      uniform_int_distribution<int> length_dist { 0, 200 };
+      for ( size_t i = 0; i < records_per_producer; ++i ) {
+        if ( not bs.writer().push( make_record( p, i, static_cast<uint8_t>( length_dist( rd ) ) ) ) ) {
+          push_failed = true;
+          break;
+        }
+      }
+      ++producers_done;
+    } );
+  }
+
+  // consume whole records, checking that none were torn or interleaved and each producer's are in order
+  vector<size_t> next_sequence( producers );
+  size_t records_seen = 0;
+  string pending;
+  string failure;
+  const auto check = [&]( bool condition, const string& what ) {
+    if ( not condition and failure.empty() ) {
+      failure = what;
+    }
+    return condition;
+  };
+  while ( producers_done < producers or bs.reader().bytes_buffered() > 0 ) {
+    const auto peeked = bs.reader().peek();
+    if ( peeked.empty() ) {
+      this_thread::yield();
+      continue;
+    }
+    pending += peeked;
+    bs.reader().pop( peeked.size() );
+
+    while ( failure.empty() and pending.size() >= 3
+            and pending.size() >= 3 + size_t { static_cast<uint8_t>( pending[0] ) } ) {
+      const size_t length = static_cast<uint8_t>( pending[0] );
+      const size_t producer = static_cast<uint8_t>( pending[1] );
+      const auto sequence = static_cast<uint8_t>( pending[2] );
+      if ( check( producer < producers, "bad producer id (torn record?)" ) ) {
+        check( sequence == static_cast<uint8_t>( next_sequence[producer]++ ), "records out of order" );
+        check( pending.substr( 3, length ) == string( length, static_cast<char>( sequence ) ),
+               "record payload interleaved with another record" );
+      }
+      pending.erase( 0, 3 + length );
+      ++records_seen;
+    }
+  }
+
+  for ( auto& t : threads ) {
+    t.join();
+  }
+  expect( not push_failed, "push failed" );
+  expect( failure.empty(), failure );
+  expect( records_seen == producers * records_per_producer, "records went missing" );
+  bs.writer().close();
+  expect( pending.empty() and bs.reader().is_finished(), "stream should be finished" );
+  expect( bs.writer().bytes_pushed() == bs.reader().bytes_popped(), "bytes_pushed != bytes_popped" );
+}
+
+// producers waiting for room give up once the reader sets an error, instead of waiting forever
+void abandoned_test()
+{
+  MPSCByteStream bs { 100 };
+  expect( bs.writer().push( string( 100, 'x' ) ), "push into an empty stream failed" );
+
+  atomic<size_t> failed_pushes {};
+  vector<thread> threads;
+  for ( size_t p = 0; p < 4; ++p ) {
+    threads.emplace_back( [&] {
+      if ( not bs.writer().push( string( 50, 'y' ) ) ) {
+        ++failed_pushes;
+      }
+    } );
+  }
+
+  bs.set_error();
+  for ( auto& t : threads ) {
+    t.join();
+  }
+  expect( failed_pushes == 4, "a push into a full stream with an error succeeded" );
+  expect( bs.writer().bytes_pushed() == 100, "an abandoned record was published" );
+  expect( not bs.writer().push( "z" ), "push after an error succeeded" );
+}
+
+int main()
+{
+  try {
+    fan_in_test( 1, 2000, 1000 );
+    fan_in_test( 4, 2000, 1000 );
+    fan_in_test( 8, 1000, 4096 );
+    abandoned_test();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
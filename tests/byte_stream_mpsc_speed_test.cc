@@ -0,0 +1,85 @@
+#include "mpsc_byte_stream.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+// `producers` threads each push `records_per_producer` records of `record_size` bytes into one stream;
+// this thread consumes them. Every record is filled with its producer's id, so a torn or interleaved
+// record shows up as a mixed-up record on the reading side.
+void contention_test( const size_t producers,            // NOLINT(bugprone-easily-swappable-parameters)
+                      const size_t records_per_producer, // NOLINT(bugprone-easily-swappable-parameters)
+                      const size_t record_size,          // NOLINT(bugprone-easily-swappable-parameters)
+                      const size_t capacity )            // NOLINT(bugprone-easily-swappable-parameters)
+{
+  MPSCByteStream bs { capacity };
+  const size_t total_bytes = producers * records_per_producer * record_size;
+
+  const auto start_time = steady_clock::now();
+
+  vector<thread> threads;
+  for ( size_t p = 0; p < producers; ++p ) {
+    threads.emplace_back( [&bs, p, records_per_producer, record_size] {
+      const string record( record_size, static_cast<char>( 'A' + p ) );
+      for ( size_t i = 0; i < records_per_producer; ++i ) {
+        bs.writer().push( record );
+      }
+    } );
+  }
+
+  size_t consumed = 0;
+  char record_owner = 0;
+  while ( consumed < total_bytes ) {
+    const auto peeked = bs.reader().peek();
+    if ( peeked.empty() ) {
+      this_thread::yield();
+      continue;
+    }
+    // records start at multiples of record_size, and every byte of a record must match its first
+    for ( const char ch : peeked ) {
+      if ( consumed++ % record_size == 0 ) {
+        record_owner = ch;
+      } else if ( ch != record_owner ) {
+        throw runtime_error( "interleaved record detected" );
+      }
+    }
+    bs.reader().pop( peeked.size() );
+  }
+
+  for ( auto& t : threads ) {
+    t.join();
+  }
+  const auto stop_time = steady_clock::now();
+
+  const auto seconds = duration_cast<duration<double>>( stop_time - start_time ).count();
+  const auto records = static_cast<double>( producers * records_per_producer );
+
+  cout << "MPSCByteStream with " << setw( 2 ) << producers << " producer(s), record_size=" << record_size
+       << ", capacity=" << capacity << ": " << fixed << setprecision( 2 ) << records / seconds / 1e6
+       << " Mrecords/s, " << 8 * static_cast<double>( total_bytes ) / seconds / 1e9 << " Gbit/s.\n";
+}
+
+void program_body()
+{
+  for ( const size_t producers : { 1, 2, 4, 8 } ) {
+    contention_test( producers, 400000 / producers, 128, 65536 );
+  }
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
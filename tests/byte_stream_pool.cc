@@ -0,0 +1,57 @@
+#include "byte_stream.hh"
+#include "common.hh"
+#include "page_pool.hh"
+
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+int main()
+{
+  try {
+    constexpr uint64_t page = PagePool::page_size;
+    PagePool& pool = PagePool::global();
+    pool.set_limit( 8 * page );
+
+    ByteStream a { 1 << 20, ByteStream::Storage::Pooled };
+    ByteStream b { 1 << 20, ByteStream::Storage::Pooled };
+    expect( pool.stats().streams == 2, "both streams should be registered" );
+    expect( pool.stats().pages_in_use == 0, "an empty stream should hold no pages" );
+
+    // each stream's fair share is half of the ceiling
+    expect( a.writer().available_capacity() == 4 * page, "available_capacity should be the fair share" );
+    a.writer().push( string( 10 * page, 'a' ) );
+    expect( a.writer().bytes_pushed() == 4 * page, "push should stop at the fair share" );
+    expect( a.writer().available_capacity() == 0, "no more room past the fair share once half the pool is used" );
+
+    // the other stream still gets its share
+    expect( b.writer().available_capacity() == 4 * page, "second stream should still get its fair share" );
+    b.writer().push( string( 4 * page, 'b' ) );
+    expect( pool.stats().pages_in_use == 8, "pool should be at its ceiling" );
+
+    // popping returns pages to the pool
+    a.reader().pop( 3 * page );
+    expect( pool.stats().pages_in_use == 5, "popped pages should return to the pool" );
+    expect( pool.stats().peak_pages == 8, "peak should be remembered" );
+    expect( a.reader().peek() == string( page, 'a' ), "remaining bytes should be intact" );
+
+    // a reservation that receives nothing gives its page back
+    ByteStream c { 1 << 20, ByteStream::Storage::Pooled };
+    expect( c.writer().reserve().size() == page, "reserve should offer a whole page" );
+    expect( pool.stats().pages_in_use == 6, "reserve borrows a page" );
+    c.writer().commit( 0 );
+    expect( pool.stats().pages_in_use == 5, "an empty commit should return the page" );
+
+    // a copy holds its bytes even beyond the ceiling
+    const ByteStream copy = b;
+    expect( copy.reader().bytes_buffered() == 4 * page, "copy should hold every byte" );
+    expect( pool.stats().pages_in_use == 9, "copy borrows its own pages" );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+#include "byte_stream.hh"
+#include "common.hh"
+#include "eventloop.hh"
+#include "page_pool.hh"
+
+#include <exception>
+#include <iostream>
+#include <poll.h>
+#include <random>
+#include <stdexcept>
+
+using namespace std;
+
+bool is_signalled( FileDescriptor& fd )
+{
+  pollfd pfd { fd.fd_num(), POLLIN, 0 };
+  return ::poll( &pfd, 1, 0 ) == 1;
+}
+
+void signal_test()
+{
+  ByteStream bs { 4 };
+  auto& readable = bs.reader().readable_fd();
+  auto& writable = bs.writer().writable_fd();
+  expect( not is_signalled( readable ), "empty stream should not be readable" );
+  expect( is_signalled( writable ), "empty stream should be writable" );
+
+  bs.writer().push( "abcd" );
+  expect( is_signalled( readable ), "stream with bytes should be readable" );
+  expect( not is_signalled( writable ), "full stream should not be writable" );
+
+  bs.reader().pop( 1 );
+  expect( is_signalled( readable ) and is_signalled( writable ), "partly full stream is readable and writable" );
+
+  bs.reader().pop( 3 );
+  expect( not is_signalled( readable ), "drained stream should not be readable" );
+
+  bs.writer().close();
+  expect( is_signalled( readable ), "closed stream should be readable (to see the end)" );
+  expect( not is_signalled( writable ), "closed stream should not be writable" );
+}
+
+// The writable signal follows available_capacity(), which a pooled stream can run out of below its capacity
+void headroom_test()
+{
+  constexpr uint64_t page = PagePool::page_size;
+  PagePool::global().set_limit( 4 * page );
+  ByteStream bs { 1 << 20, ByteStream::Storage::Pooled };
+  auto& writable = bs.writer().writable_fd();
+
+  bs.writer().push( string( 8 * page, 'x' ) );
+  expect( bs.writer().available_capacity() == 0, "the pool should have run out" );
+  expect( bs.reader().bytes_buffered() < ( 1 << 20 ), "the stream itself should not be full" );
+  expect( not is_signalled( writable ), "stream with no room in the pool should not be writable" );
+
+  bs.reader().pop( page );
+  expect( is_signalled( writable ), "stream should be writable once a page is back in the pool" );
+  PagePool::global().set_limit( UINT64_MAX );
+}
+
+// An error ends the stream for both sides: the reader wakes up to see it, and the writer stops being offered room
+void error_test()
+{
+  ByteStream bs { 4 };
+  auto& readable = bs.reader().readable_fd();
+  auto& writable = bs.writer().writable_fd();
+  expect( not is_signalled( readable ) and is_signalled( writable ), "empty stream is only writable" );
+
+  bs.set_error();
+  expect( is_signalled( readable ), "stream with an error should be readable (to see the error)" );
+  expect( not is_signalled( writable ), "stream with an error should not be writable" );
+}
+
+// source -> a -> b -> sink, every hop an fd rule on a readiness eventfd, so the loop only wakes for real work
+void pipeline_test( const size_t input_len, const size_t capacity, const EventLoop::Backend backend )
+{
+  default_random_engine rd { input_len };
+  uniform_int_distribution<char> ud;
+  string data;
+  for ( size_t i = 0; i < input_len; ++i ) {
+    data += ud( rd );
+  }
+
+  ByteStream a { capacity };
+  ByteStream b { capacity / 3 };
+  string_view remaining = data;
+  string output;
+
+  EventLoop loop { backend };
+  loop.add_rule(
+    "source -> a",
+    a.writer().writable_fd(),
+    Direction::In,
+    [&] {
+      const uint64_t before = a.writer().bytes_pushed();
+      a.writer().push( string { remaining.substr( 0, 1000 ) } );
+      remaining.remove_prefix( a.writer().bytes_pushed() - before );
+      if ( remaining.empty() ) {
+        a.writer().close();
+      }
+    },
+    [&] { return not a.writer().is_closed(); } );
+
+  loop.add_rule(
+    "a -> b",
+    a.reader().readable_fd(),
+    Direction::In,
+    [&] {
+      const auto view = a.reader().peek().substr( 0, b.writer().available_capacity() );
+      b.writer().push( string { view } );
+      a.reader().pop( view.size() );
+      if ( a.reader().is_finished() ) {
+        b.writer().close();
+      }
+    },
+    [&] { return not b.writer().is_closed() and b.writer().available_capacity() > 0; } );
+
+  loop.add_rule(
+    "b -> sink",
+    b.reader().readable_fd(),
+    Direction::In,
+    [&] {
+      output += b.reader().peek();
+      b.reader().pop( b.reader().peek().size() );
+    },
+    [&] { return not b.reader().is_finished(); } );
+
+  while ( true ) {
+    const auto result = loop.wait_next_event( 1000 );
+    expect( result != EventLoop::Result::Timeout, "pipeline stalled" );
+    if ( result == EventLoop::Result::Exit ) {
+      break;
+    }
+  }
+
+  expect( output == data, "data out of the pipeline does not match data in" );
+}
+
+int main()
+{
+  try {
+    signal_test();
+    headroom_test();
+    error_test();
+    for ( const auto backend :
+          { EventLoop::Backend::Poll, EventLoop::Backend::Epoll, EventLoop::Backend::IoUring } ) {
+      pipeline_test( 100000, 4096, backend );
+      pipeline_test( 5000, 3, backend );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
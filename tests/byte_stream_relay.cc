@@ -0,0 +1,120 @@
+#include "byte_stream.hh"
+#include "common.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+
+#include <array>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <utility>
+
+using namespace std;
+
+pair<FileDescriptor, FileDescriptor> make_socket_pair()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds.data() ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+string make_data( size_t len )
+{
+  default_random_engine rd { len };
+  uniform_int_distribution<char> ud;
+  string data;
+  for ( size_t i = 0; i < len; ++i ) {
+    data += ud( rd );
+  }
+  return data;
+}
+
+// feed -> [in ... ByteStream ... out] -> drain, every hop a read or write rule, so the loop does all the I/O
+void relay_test( const EventLoop::Backend backend, const size_t input_len, const size_t capacity )
+{
+  const string data = make_data( input_len );
+  string_view remaining = data;
+  string output;
+
+  auto [feed, in] = make_socket_pair();
+  auto [out, drain] = make_socket_pair();
+  ByteStream bs { capacity };
+  bool out_shutdown = false;
+  const auto finish_out = [&] {
+    if ( bs.reader().is_finished() and not out_shutdown ) {
+      CheckSystemCall( "shutdown", ::shutdown( out.fd_num(), SHUT_WR ) );
+      out_shutdown = true;
+    }
+  };
+
+  EventLoop loop { backend };
+
+  loop.add_write_rule(
+    loop.add_category( "feed" ),
+    feed,
+    [&] { return remaining.substr( 0, 10000 ); },
+    [&]( size_t len ) {
+      remaining.remove_prefix( len );
+      if ( remaining.empty() ) {
+        CheckSystemCall( "shutdown", ::shutdown( feed.fd_num(), SHUT_WR ) );
+      }
+    } );
+
+  loop.add_read_rule(
+    loop.add_category( "in -> ByteStream" ),
+    in,
+    [&] { return bs.writer().is_closed() ? 0 : bs.writer().available_capacity(); },
+    [&]( string_view bytes ) { bs.writer().push( string { bytes } ); },
+    [&] {
+      bs.writer().close();
+      finish_out();
+    } );
+
+  loop.add_write_rule(
+    loop.add_category( "ByteStream -> out" ),
+    out,
+    [&] { return bs.reader().peek(); },
+    [&]( size_t len ) {
+      bs.reader().pop( len );
+      finish_out();
+    } );
+
+  loop.add_read_rule(
+    loop.add_category( "drain" ), drain, [] { return 65536; }, [&]( string_view bytes ) { output += bytes; } );
+
+  if ( remaining.empty() ) {
+    CheckSystemCall( "shutdown", ::shutdown( feed.fd_num(), SHUT_WR ) );
+  }
+
+  while ( true ) {
+    const auto result = loop.wait_next_event( 1000 );
+    expect( result != EventLoop::Result::Timeout, "relay stalled" );
+    if ( result == EventLoop::Result::Exit ) {
+      break;
+    }
+  }
+
+  expect( remaining.empty(), "not all of the input was fed in" );
+  expect( in.eof() and drain.eof(), "EOF did not reach the end of the relay" );
+  expect( output == data, "data out of the relay does not match data in" );
+}
+
+int main()
+{
+  try {
+    for ( const auto backend :
+          { EventLoop::Backend::Poll, EventLoop::Backend::Epoll, EventLoop::Backend::IoUring } ) {
+      relay_test( backend, 0, 4096 );
+      relay_test( backend, 20000, 3 );
+      relay_test( backend, 1000000, 4096 );
+      relay_test( backend, 2000000, 1048576 );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,100 +1,293 @@
 #include "byte_stream.hh"
+#include "byte_stream_test_harness.hh"
+#include "spill_buffer.hh"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstddef>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <new>
 #include <queue>
 #include <random>
+#include <span>
+#include <sstream>
+#include <vector>
 
 using namespace std;
 using namespace std::chrono;
 
-void speed_test( const size_t input_len,   // NOLINT(bugprone-easily-swappable-parameters)
-                 const size_t capacity,    // NOLINT(bugprone-easily-swappable-parameters)
-                 const size_t random_seed, // NOLINT(bugprone-easily-swappable-parameters)
-                 const size_t write_size,  // NOLINT(bugprone-easily-swappable-parameters)
-                 const size_t read_size )  // NOLINT(bugprone-easily-swappable-parameters)
+// Every heap allocation in the process goes through these, so a trial can count the ones the stream makes
+namespace {
+atomic<uint64_t> allocation_count { 0 };
+} // namespace
+
+void* operator new( size_t size )
 {
-  // Generate the data to be written
-  const string data = [&random_seed, &input_len] {
-    default_random_engine rd { random_seed };
-    uniform_int_distribution<char> ud;
-    string ret;
-    for ( size_t i = 0; i < input_len; ++i ) {
-      ret += ud( rd );
-    }
-    return ret;
-  }();
+  ++allocation_count;
+  if ( void* ptr = malloc( size ? size : 1 ) ) { // NOLINT(*-no-malloc)
+    return ptr;
+  }
+  throw bad_alloc();
+}
+
+void operator delete( void* ptr ) noexcept
+{
+  free( ptr ); // NOLINT(*-no-malloc)
+}
+
+void operator delete( void* ptr, size_t /* size */ ) noexcept
+{
+  free( ptr ); // NOLINT(*-no-malloc)
+}
+
+struct Config
+{
+  ByteStream::Storage storage;
+  size_t capacity;
+  size_t write_size;
+  size_t read_size;
+};
+
+struct Result
+{
+  Config config;
+  double median_gbps;
+  double min_gbps;
+  double max_gbps;
+  double allocations_per_mb;
+};
 
+struct Options
+{
+  size_t input_len = 1e7;
+  unsigned warmup = 1;
+  unsigned trials = 3;
+  string json_path {}; // reports are only written when asked for
+  string csv_path {};
+};
+
+void check_zero_copy( const size_t capacity, const size_t write_size )
+{
+  // A chunked ByteStream should hand back the very bytes that were pushed, without moving them.
+  ByteStream bs { capacity, ByteStream::Storage::Chunked };
+  string segment( write_size, 'x' );
+  const char* const original = segment.data();
+  bs.writer().push( move( segment ) );
+  if ( bs.reader().peek().data() != original ) {
+    throw runtime_error( "Chunked ByteStream copied data between push and peek" );
+  }
+  string out;
+  read( bs.reader(), write_size, out );
+  if ( out.data() != original ) {
+    throw runtime_error( "Chunked ByteStream copied data between push and read" );
+  }
+}
+
+// One trial: push `data` through a fresh stream and read it back. Returns Gbit/s; adds the allocations
+// made while the stream was moving bytes (not while preparing the input) to `allocations`.
+double run_trial( const Config& config, const string& data, uint64_t& allocations )
+{
   // Split the data into segments before writing
   queue<string> split_data;
-  for ( size_t i = 0; i < data.size(); i += write_size ) {
-    split_data.emplace( data.substr( i, write_size ) );
+  for ( size_t i = 0; i < data.size(); i += config.write_size ) {
+    split_data.emplace( data.substr( i, config.write_size ) );
   }
 
-  ByteStream bs { capacity };
   string output_data;
   output_data.reserve( data.size() );
 
+  const uint64_t allocations_before = allocation_count;
   const auto start_time = steady_clock::now();
-  while ( not bs.reader().is_finished() ) {
-    if ( split_data.empty() ) {
-      if ( not bs.writer().is_closed() ) {
-        bs.writer().close();
-      }
-    } else {
-      if ( split_data.front().size() <= bs.writer().available_capacity() ) {
-        bs.writer().push( move( split_data.front() ) );
-        split_data.pop();
+  {
+    ByteStream bs { config.capacity, config.storage };
+    while ( not bs.reader().is_finished() ) {
+      if ( split_data.empty() ) {
+        if ( not bs.writer().is_closed() ) {
+          bs.writer().close();
+        }
+      } else {
+        if ( split_data.front().size() <= bs.writer().available_capacity() ) {
+          bs.writer().push( move( split_data.front() ) );
+          split_data.pop();
+        }
       }
-    }
 
-    if ( bs.reader().bytes_buffered() ) {
-      auto peeked = bs.reader().peek().substr( 0, read_size );
-      if ( peeked.empty() ) {
-        throw runtime_error( "ByteStream::reader().peek() returned empty view" );
+      if ( bs.reader().bytes_buffered() ) {
+        auto peeked = bs.reader().peek().substr( 0, config.read_size );
+        if ( peeked.empty() ) {
+          throw runtime_error( "ByteStream::reader().peek() returned empty view" );
+        }
+        output_data += peeked;
+        bs.reader().pop( peeked.size() );
       }
-      output_data += peeked;
-      bs.reader().pop( peeked.size() );
     }
   }
-
   const auto stop_time = steady_clock::now();
+  allocations += allocation_count - allocations_before;
 
   if ( data != output_data ) {
     throw runtime_error( "Mismatch between data written and read" );
   }
 
-  auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
-  auto bytes_per_second = static_cast<double>( input_len ) / test_duration.count();
-  auto bits_per_second = 8 * bytes_per_second;
-  auto gigabits_per_second = bits_per_second / 1e9;
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  return 8 * static_cast<double>( data.size() ) / test_duration.count() / 1e9;
+}
 
-  fstream debug_output;
-  debug_output.open( "/dev/tty" );
+Result speed_test( const Config& config, const Options& options, const string& data )
+{
+  if ( config.storage == ByteStream::Storage::Chunked ) {
+    check_zero_copy( config.capacity, config.write_size );
+  }
 
-  cout << "ByteStream with capacity=" << capacity << ", write_size=" << write_size << ", read_size=" << read_size
-       << " reached " << fixed << setprecision( 2 ) << gigabits_per_second << " Gbit/s.\n";
+  uint64_t allocations = 0;
+  for ( unsigned i = 0; i < options.warmup; ++i ) {
+    run_trial( config, data, allocations );
+  }
 
-  debug_output << "             ByteStream throughput: " << fixed << setprecision( 2 ) << gigabits_per_second
-               << " Gbit/s\n";
+  allocations = 0;
+  vector<double> gbps;
+  for ( unsigned i = 0; i < options.trials; ++i ) {
+    gbps.push_back( run_trial( config, data, allocations ) );
+  }
+  sort( gbps.begin(), gbps.end() );
 
-  if ( gigabits_per_second < 0.1 ) {
-    throw runtime_error( "ByteStream did not meet minimum speed of 0.1 Gbit/s." );
+  const double megabytes_moved = static_cast<double>( data.size() ) * options.trials / 1e6;
+  const Result result { config,
+                        gbps[gbps.size() / 2],
+                        gbps.front(),
+                        gbps.back(),
+                        static_cast<double>( allocations ) / megabytes_moved };
+
+  cout << setw( 8 ) << storage_name( config.storage ) << " capacity=" << setw( 8 ) << config.capacity
+       << " write_size=" << setw( 5 ) << config.write_size << " read_size=" << setw( 5 ) << config.read_size << fixed
+       << setprecision( 2 ) << "  median " << setw( 6 ) << result.median_gbps << " Gbit/s (min " << result.min_gbps
+       << ", max " << result.max_gbps << "), " << result.allocations_per_mb << " allocations/MB\n";
+
+  return result;
+}
+
+void write_reports( const vector<Result>& results, const Options& options )
+{
+  // an unopened stream discards what is written to it, so a report that was not asked for is simply skipped
+  ofstream json;
+  ofstream csv;
+  if ( not options.json_path.empty() ) {
+    json.open( options.json_path );
+  }
+  if ( not options.csv_path.empty() ) {
+    csv.open( options.csv_path );
+  }
+  json << fixed << setprecision( 4 );
+  csv << fixed << setprecision( 4 );
+
+  json << "{\n  \"input_len\": " << options.input_len << ",\n  \"warmup\": " << options.warmup
+       << ",\n  \"trials\": " << options.trials << ",\n  \"results\": [\n";
+  csv << "storage,capacity,write_size,read_size,median_gbps,min_gbps,max_gbps,allocations_per_mb\n";
+
+  for ( size_t i = 0; i < results.size(); ++i ) {
+    const auto& [config, median, min, max, allocations] = results[i];
+    json << "    {\"storage\": \"" << storage_name( config.storage ) << "\", \"capacity\": " << config.capacity
+         << ", \"write_size\": " << config.write_size << ", \"read_size\": " << config.read_size
+         << ", \"median_gbps\": " << median << ", \"min_gbps\": " << min << ", \"max_gbps\": " << max
+         << ", \"allocations_per_mb\": " << allocations << "}" << ( i + 1 < results.size() ? ",\n" : "\n" );
+    csv << storage_name( config.storage ) << "," << config.capacity << "," << config.write_size << ","
+        << config.read_size << "," << median << "," << min << "," << max << "," << allocations << "\n";
+  }
+
+  json << "  ]\n}\n";
+}
+
+Options parse_options( span<char*> args )
+{
+  Options options;
+  for ( size_t i = 1; i + 1 < args.size(); i += 2 ) {
+    const string_view flag = args[i];
+    const string value = args[i + 1];
+    if ( flag == "--input-len" ) {
+      options.input_len = stoull( value );
+    } else if ( flag == "--warmup" ) {
+      options.warmup = stoul( value );
+    } else if ( flag == "--trials" ) {
+      options.trials = max( stoul( value ), 1UL );
+    } else if ( flag == "--json" ) {
+      options.json_path = value;
+    } else if ( flag == "--csv" ) {
+      options.csv_path = value;
+    } else {
+      throw runtime_error( "unknown option " + string { flag } );
+    }
   }
+  return options;
 }
 
-void program_body()
+void program_body( const Options& options )
 {
-  speed_test( 1e7, 32768, 789, 1500, 128 );
+  // Generate the data to be written
+  const string data = [&options] {
+    default_random_engine rd { 789 };
+    uniform_int_distribution<char> ud;
+    string ret;
+    for ( size_t i = 0; i < options.input_len; ++i ) {
+      ret += ud( rd );
+    }
+    return ret;
+  }();
+
+  vector<Config> configs;
+
+  // The ring buffer across the grid. Throughput should not depend on how much is buffered: with a large
+  // capacity the stream stays nearly full, so any per-pop cost proportional to bytes_buffered() would show up.
+  for ( const size_t capacity : { 32768, 1048576, 16777216 } ) {
+    for ( const size_t write_size : { 128, 1500, 16384 } ) {
+      for ( const size_t read_size : { 128, 1500, 16384 } ) {
+        configs.push_back( { ByteStream::Storage::Ring, capacity, write_size, read_size } );
+      }
+    }
+  }
+
+  // Every other storage at the classic configuration
+  configs.push_back( { ByteStream::Storage::Chunked, 32768, 1500, 128 } );
+  configs.push_back( { ByteStream::Storage::Mirrored, 1048576, 1500, 128 } );
+  configs.push_back( { ByteStream::Storage::Pooled, 1048576, 1500, 128 } );
+  configs.push_back( { ByteStream::Storage::Pipe, 1048576, 1500, 128 } );
+
+  // A spilled stream is a plain ring unless its capacity outgrows the memory window, so shrink the window to
+  // make this one go through its file
+  SpillBuffer::set_window( 1048576 );
+  configs.push_back( { ByteStream::Storage::Spilled, 16777216, 1500, 128 } );
+
+  vector<Result> results;
+  for ( const auto& config : configs ) {
+    results.push_back( speed_test( config, options, data ) );
+  }
+  write_reports( results, options );
+
+  const auto classic = ranges::find_if( results, []( const Result& result ) {
+    const auto& [storage, capacity, write_size, read_size] = result.config;
+    return storage == ByteStream::Storage::Ring and capacity == 32768 and write_size == 1500 and read_size == 128;
+  } );
+  if ( classic == results.end() ) {
+    throw runtime_error( "the sweep left out the classic configuration" );
+  }
+  if ( classic->median_gbps < 0.1 ) {
+    throw runtime_error( "ByteStream did not meet minimum speed of 0.1 Gbit/s." );
+  }
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+  debug_output << "             ByteStream throughput (capacity=32768, write_size=1500, read_size=128): " << fixed
+               << setprecision( 2 ) << classic->median_gbps << " Gbit/s\n";
 }
 
-int main()
+// Usage: byte_stream_speed_test [--input-len N] [--warmup N] [--trials N] [--json FILE] [--csv FILE]
+int main( int argc, char** argv )
 {
   try {
-    program_body();
+    program_body( parse_options( span( argv, argc ) ) );
   } catch ( const exception& e ) {
     cerr << "Exception: " << e.what() << "\n";
     return EXIT_FAILURE;
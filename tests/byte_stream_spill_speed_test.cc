@@ -0,0 +1,102 @@
+#include "byte_stream.hh"
+#include "spill_buffer.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace std::chrono;
+
+// Peak resident set size of this process (VmHWM), in MiB
+double peak_resident_mib()
+{
+  ifstream status { "/proc/self/status" };
+  string line;
+  while ( getline( status, line ) ) {
+    if ( line.starts_with( "VmHWM:" ) ) {
+      return stod( line.substr( 6 ) ) / 1024.0;
+    }
+  }
+  return 0;
+}
+
+// Byte expected at a given stream position: a pattern that shifts every page, so misordered pages show up
+char pattern_at( uint64_t position )
+{
+  return static_cast<char>( position / 4096 % 251 );
+}
+
+// A fast producer and a consumer at half its speed, so half of everything pushed piles up in the stream
+// (far more than the memory window), and then the backlog is drained.
+void spill_test( const uint64_t total, const uint64_t window )
+{
+  constexpr uint64_t write_size = 65536;
+
+  SpillBuffer::set_window( window );
+  ByteStream bs { total, ByteStream::Storage::Spilled };
+
+  string chunk( write_size, 0 );
+  uint64_t backlog_peak = 0;
+
+  const auto start_time = steady_clock::now();
+  while ( not bs.reader().is_finished() ) {
+    const uint64_t pushed = bs.writer().bytes_pushed();
+    if ( pushed < total ) {
+      const uint64_t len = min( write_size, total - pushed );
+      chunk.resize( len );
+      for ( uint64_t i = 0; i < len; i += 4096 ) {
+        fill_n( chunk.begin() + static_cast<ptrdiff_t>( i ), min( uint64_t { 4096 }, len - i ), pattern_at( pushed + i ) );
+      }
+      bs.writer().push( chunk );
+      if ( bs.writer().bytes_pushed() == total ) {
+        bs.writer().close();
+      }
+    }
+    backlog_peak = max( backlog_peak, bs.reader().bytes_buffered() );
+
+    // while the producer runs, read half as much as it writes
+    uint64_t to_read = bs.writer().is_closed() ? bs.reader().bytes_buffered() : write_size / 2;
+    while ( to_read > 0 and bs.reader().bytes_buffered() > 0 ) {
+      const string_view view = bs.reader().peek().substr( 0, to_read );
+      if ( view.front() != pattern_at( bs.reader().bytes_popped() ) ) {
+        throw runtime_error( "spilled ByteStream returned bytes out of order" );
+      }
+      bs.reader().pop( view.size() );
+      to_read -= view.size();
+    }
+  }
+  const double seconds = duration_cast<duration<double>>( steady_clock::now() - start_time ).count();
+
+  const double gigabits_per_second = 8.0 * static_cast<double>( total ) / 1e9 / seconds;
+  cout << fixed << setprecision( 2 ) << "spilled ByteStream moved " << static_cast<double>( total ) / 1048576 << " MiB (peak backlog "
+       << static_cast<double>( backlog_peak ) / 1048576 << " MiB) through a " << static_cast<double>( window ) / 1048576
+       << " MiB window at " << gigabits_per_second << " Gbit/s; peak RSS " << peak_resident_mib() << " MiB.\n";
+
+  if ( gigabits_per_second < 0.1 ) {
+    throw runtime_error( "spilled ByteStream did not meet minimum speed of 0.1 Gbit/s." );
+  }
+}
+
+// Usage: byte_stream_spill_speed_test [total_bytes] [window_bytes]
+// The default total keeps the test short; pass e.g. 8589934592 to push 8 GiB through the 64 MiB window.
+int main( int argc, char** argv )
+{
+  try {
+    const auto args = span( argv, argc );
+    const uint64_t total = argc > 1 ? stoull( args[1] ) : uint64_t { 1 } << 30;
+    const uint64_t window = argc > 2 ? stoull( args[2] ) : SpillBuffer::default_window;
+    spill_test( total, window );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+#include "byte_stream_test_harness.hh"
+#include "common.hh"
+#include "exception.hh"
+
+#include <exception>
+#include <fcntl.h>
+#include <iostream>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  int fds[2] {};
+  CheckSystemCall( "pipe2", ::pipe2( fds, O_NONBLOCK | O_CLOEXEC ) ); // NOLINT(*-array-to-pointer-decay)
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+string make_data( size_t len )
+{
+  default_random_engine rd { len };
+  uniform_int_distribution<char> ud;
+  string data;
+  for ( size_t i = 0; i < len; ++i ) {
+    data += ud( rd );
+  }
+  return data;
+}
+
+// read until EOF or until a non-blocking fd runs dry
+string read_all( FileDescriptor& fd )
+{
+  string out;
+  string chunk( 65536, 0 );
+  while ( const size_t bytes_read = fd.read( span { chunk } ) ) {
+    out.append( chunk, 0, bytes_read );
+  }
+  return out;
+}
+
+FileDescriptor make_file()
+{
+  return FileDescriptor { CheckSystemCall( "memfd_create", memfd_create( "byte_stream_splice", MFD_CLOEXEC ) ) };
+}
+
+// pipe -> stream -> pipe, with occasional user-space pushes, peeks and pops mixed in
+void relay_test( ByteStream::Storage storage, uint64_t capacity )
+{
+  const string data = make_data( 300000 );
+  auto [source_read, source_write] = make_pipe();
+  auto [sink_read, sink_write] = make_pipe();
+
+  ByteStream bs { capacity, storage };
+  string_view to_source = data;
+  string output;
+  bool closed = false;
+  size_t round = 0;
+
+  while ( not bs.reader().is_finished() ) {
+    if ( not to_source.empty() ) {
+      const auto written = source_write.write( to_source.substr( 0, 7000 ) );
+      to_source.remove_prefix( written );
+      if ( to_source.empty() ) {
+        source_write.close();
+      }
+    }
+
+    if ( not closed ) {
+      bs.writer().fill_from( source_read );
+      if ( source_read.eof() ) {
+        bs.writer().close();
+        closed = true;
+      }
+    }
+
+    if ( ++round % 3 == 0 and bs.reader().bytes_buffered() > 0 ) {
+      // pull some bytes through user space to make sure they stay in order with the spliced ones
+      const auto view = bs.reader().peek().substr( 0, 100 );
+      output += view;
+      bs.reader().pop( view.size() );
+    }
+
+    const auto before = bs.reader().bytes_popped();
+    const auto drained = bs.reader().drain_to( sink_write );
+    expect( bs.reader().bytes_popped() == before + drained, "bytes_popped should count drained bytes" );
+    expect( bs.writer().bytes_pushed() - bs.reader().bytes_popped() == bs.reader().bytes_buffered(),
+            "bytes_buffered should match pushed minus popped" );
+    expect( bs.reader().bytes_buffered() + bs.writer().available_capacity() <= capacity,
+            "available_capacity should never exceed capacity" );
+    output += read_all( sink_read );
+  }
+
+  expect( bs.writer().bytes_pushed() == data.size(), "every byte should have been pushed" );
+  expect( output == data, storage_name( storage ) + " stream corrupted the data" );
+}
+
+// 5 MB from a file or a pipe, through a pipe-backed stream, to a pipe, moved only by fill_from and drain_to
+void large_relay_test( const bool from_file )
+{
+  const string data = make_data( 5'000'000 );
+  auto [source_read, source_write] = make_pipe();
+  FileDescriptor file = make_file();
+  if ( from_file ) {
+    file.write( data );
+    CheckSystemCall( "lseek", static_cast<int>( ::lseek( file.fd_num(), 0, SEEK_SET ) ) );
+  }
+  FileDescriptor& source = from_file ? file : source_read;
+  auto [sink_read, sink_write] = make_pipe();
+
+  ByteStream bs { 1 << 20, ByteStream::Storage::Pipe };
+  if ( not from_file ) {
+    expect( bs.writer().fill_from( source ) == 0 and bs.reader().bytes_buffered() == 0 and not source.eof(),
+            "fill_from on an idle pipe should move nothing" );
+  }
+
+  string_view to_source = data;
+  string output;
+  while ( not bs.reader().is_finished() ) {
+    if ( not from_file and not to_source.empty() ) {
+      to_source.remove_prefix( source_write.write( to_source.substr( 0, 65536 ) ) );
+      if ( to_source.empty() ) {
+        source_write.close();
+      }
+    }
+    if ( not bs.writer().is_closed() ) {
+      bs.writer().fill_from( source );
+      if ( source.eof() ) {
+        bs.writer().close();
+      }
+    }
+    bs.reader().drain_to( sink_write );
+    output += read_all( sink_read );
+  }
+
+  expect( output == data, string { from_file ? "file" : "pipe" } + " relay corrupted the data" );
+}
+
+// splice() refuses to write to a file opened with O_APPEND, so drain_to has to fall back to write()
+void fallback_test()
+{
+  const string data = make_data( 100000 );
+  FileDescriptor file = make_file();
+  file.write( data );
+  CheckSystemCall( "lseek", static_cast<int>( ::lseek( file.fd_num(), 0, SEEK_SET ) ) );
+
+  FileDescriptor appended = make_file();
+  CheckSystemCall( "fcntl", fcntl( appended.fd_num(), F_SETFL, O_APPEND ) ); // NOLINT(*-vararg)
+
+  ByteStream bs { 65536, ByteStream::Storage::Pipe };
+  while ( not bs.reader().is_finished() ) {
+    bs.writer().fill_from( file ); // regular files can be spliced from
+    if ( file.eof() ) {
+      bs.writer().close();
+    }
+    bs.reader().drain_to( appended );
+  }
+
+  CheckSystemCall( "lseek", static_cast<int>( ::lseek( appended.fd_num(), 0, SEEK_SET ) ) );
+  expect( read_all( appended ) == data, "fallback to write() corrupted the data" );
+}
+
+int main()
+{
+  try {
+    for ( const auto storage : { ByteStream::Storage::Ring,
+                                 ByteStream::Storage::Chunked,
+                                 ByteStream::Storage::Mirrored,
+                                 ByteStream::Storage::Pooled,
+                                 ByteStream::Storage::Pipe } ) {
+      relay_test( storage, 65536 );
+      relay_test( storage, 5000 );
+    }
+    large_relay_test( true );
+    large_relay_test( false );
+    fallback_test();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
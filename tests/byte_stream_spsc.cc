@@ -0,0 +1,102 @@
+#include "common.hh"
+#include "spsc_byte_stream.hh"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+void single_thread_test()
+{
+  SPSCByteStream bs { 5 };
+  expect( bs.writer().available_capacity() == 5, "available_capacity of new stream" );
+
+  bs.writer().push( "hello world" );
+  expect( bs.writer().bytes_pushed() == 5, "push should be truncated to capacity" );
+  expect( bs.reader().peek() == "hello", "peek after push" );
+
+  bs.reader().pop( 3 );
+  expect( bs.reader().bytes_buffered() == 2, "bytes_buffered after pop" );
+  expect( bs.writer().available_capacity() == 3, "available_capacity after pop" );
+
+  bs.writer().push( "abc" ); // wraps around the end of the (8-byte) storage
+  string got;
+  vector<string_view> views;
+  bs.reader().peek( views );
+  for ( const auto view : views ) {
+    got += view;
+  }
+  expect( got == "loabc", "peek( views ) across the wrap point" );
+
+  bs.writer().close();
+  expect( not bs.reader().is_finished(), "finished while bytes are buffered" );
+  bs.reader().pop( 5 );
+  expect( bs.reader().is_finished(), "finished after close and pop" );
+  expect( bs.reader().bytes_popped() == 8, "bytes_popped" );
+}
+
+void two_thread_test( const size_t input_len, const size_t capacity, const size_t random_seed )
+{
+  default_random_engine rd { random_seed };
+  const string data = [&] {
+    uniform_int_distribution<char> ud;
+    string ret;
+    for ( size_t i = 0; i < input_len; ++i ) {
+      ret += ud( rd );
+    }
+    return ret;
+  }();
+
+  SPSCByteStream bs { capacity };
+
+  thread writer_thread { [&bs, &data, random_seed] {
+    default_random_engine writer_rd { random_seed + 1 };
+    uniform_int_distribution<size_t> write_size { 1, 3000 };
+    string_view remaining = data;
+    while ( not remaining.empty() ) {
+      const auto space = bs.writer().reserve( min( write_size( writer_rd ), remaining.size() ) );
+      if ( space.empty() ) {
+        this_thread::yield();
+        continue;
+      }
+      copy_n( remaining.begin(), space.size(), space.begin() );
+      bs.writer().commit( space.size() );
+      remaining.remove_prefix( space.size() );
+    }
+    bs.writer().close();
+  } };
+
+  string output;
+  uniform_int_distribution<size_t> read_size { 1, 3000 };
+  while ( not bs.reader().is_finished() ) {
+    const auto peeked = bs.reader().peek().substr( 0, read_size( rd ) );
+    if ( peeked.empty() ) {
+      this_thread::yield();
+      continue;
+    }
+    output += peeked;
+    bs.reader().pop( peeked.size() );
+  }
+
+  writer_thread.join();
+  expect( output == data, "data read from the stream does not match data written" );
+  expect( bs.writer().bytes_pushed() == input_len, "bytes_pushed after transfer" );
+}
+
+int main()
+{
+  try {
+    single_thread_test();
+    two_thread_test( 1000000, 4096, 1234 );
+    two_thread_test( 1000000, 1000, 5678 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
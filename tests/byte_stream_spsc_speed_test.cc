@@ -0,0 +1,127 @@
+#include "spsc_byte_stream.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+void throughput_test( const size_t input_len,   // NOLINT(bugprone-easily-swappable-parameters)
+                      const size_t capacity,    // NOLINT(bugprone-easily-swappable-parameters)
+                      const size_t random_seed, // NOLINT(bugprone-easily-swappable-parameters)
+                      const size_t write_size,  // NOLINT(bugprone-easily-swappable-parameters)
+                      const size_t read_size )  // NOLINT(bugprone-easily-swappable-parameters)
+{
+  const string data = [&random_seed, &input_len] {
+    default_random_engine rd { random_seed };
+    uniform_int_distribution<char> ud;
+    string ret;
+    for ( size_t i = 0; i < input_len; ++i ) {
+      ret += ud( rd );
+    }
+    return ret;
+  }();
+
+  SPSCByteStream bs { capacity };
+  string output_data;
+  output_data.reserve( data.size() );
+
+  const auto start_time = steady_clock::now();
+
+  // producer on its own thread, consumer on this one
+  thread producer { [&] {
+    string_view remaining = data;
+    while ( not remaining.empty() ) {
+      const auto segment = remaining.substr( 0, write_size );
+      if ( segment.size() > bs.writer().available_capacity() ) {
+        this_thread::yield();
+        continue;
+      }
+      bs.writer().push( segment );
+      remaining.remove_prefix( segment.size() );
+    }
+    bs.writer().close();
+  } };
+
+  while ( not bs.reader().is_finished() ) {
+    const auto peeked = bs.reader().peek().substr( 0, read_size );
+    if ( peeked.empty() ) {
+      this_thread::yield();
+      continue;
+    }
+    output_data += peeked;
+    bs.reader().pop( peeked.size() );
+  }
+
+  producer.join();
+  const auto stop_time = steady_clock::now();
+
+  if ( data != output_data ) {
+    throw runtime_error( "Mismatch between data written and read" );
+  }
+
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  const auto gigabits_per_second = 8 * static_cast<double>( input_len ) / test_duration.count() / 1e9;
+
+  cout << "SPSCByteStream (2 threads) with capacity=" << capacity << ", write_size=" << write_size
+       << ", read_size=" << read_size << " reached " << fixed << setprecision( 2 ) << gigabits_per_second
+       << " Gbit/s.\n";
+}
+
+// One byte bounces between two threads over a pair of streams; half the round trip is the handoff latency.
+void latency_test( const size_t round_trips )
+{
+  SPSCByteStream ping { 64 };
+  SPSCByteStream pong { 64 };
+
+  const auto await_byte = []( SPSCByteStream& bs ) {
+    while ( bs.reader().bytes_buffered() == 0 ) {
+      this_thread::yield();
+    }
+    bs.reader().pop( 1 );
+  };
+
+  thread echo { [&] {
+    for ( size_t i = 0; i < round_trips; ++i ) {
+      await_byte( ping );
+      pong.writer().push( "x" );
+    }
+  } };
+
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < round_trips; ++i ) {
+    ping.writer().push( "x" );
+    await_byte( pong );
+  }
+  const auto stop_time = steady_clock::now();
+  echo.join();
+
+  const auto handoff_ns
+    = duration_cast<duration<double, nano>>( stop_time - start_time ).count() / static_cast<double>( 2 * round_trips );
+
+  cout << "SPSCByteStream cross-thread handoff latency: " << fixed << setprecision( 0 ) << handoff_ns << " ns.\n";
+}
+
+void program_body()
+{
+  throughput_test( 1e8, 32768, 789, 1500, 128 );
+  throughput_test( 1e8, 1048576, 789, 1500, 16384 );
+  latency_test( 100000 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
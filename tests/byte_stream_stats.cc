@@ -0,0 +1,85 @@
+#include "byte_stream.hh"
+#include "common.hh"
+#include "file_descriptor.hh"
+
+#include <array>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+// Built without -DBYTE_STREAM_STATS=ON, the counters must not exist at all
+void disabled_test()
+{
+  ByteStream bs { 10 };
+  bs.writer().push( "hello, world" );
+  const auto stats = bs.stats();
+  expect( not stats.enabled, "stats should report being compiled out" );
+  expect( stats.high_water_mark == 0 and stats.truncated_pushes == 0, "compiled-out counters should be zero" );
+}
+
+void enabled_test()
+{
+  ByteStream bs { 10 };
+  bs.writer().push( "abc" );         // 3 bytes: bucket 1
+  bs.writer().push( "defghijklmn" ); // truncated to 7 bytes: bucket 2
+  bs.writer().push( "x" );           // dropped: stream is full
+  this_thread::sleep_for( milliseconds { 20 } );
+  bs.reader().pop( 8 ); // bucket 3
+  bs.reader().pop( 2 ); // bucket 1
+  this_thread::sleep_for( milliseconds { 20 } );
+
+  const auto stats = bs.stats();
+  expect( stats.enabled, "stats should be enabled" );
+  expect( stats.high_water_mark == 10, "high-water mark should be 10" );
+  expect( stats.truncated_pushes == 2, "two pushes should have been cut short" );
+  expect( stats.push_sizes[1] == 1 and stats.push_sizes[2] == 1, "push sizes land in the wrong buckets" );
+  expect( stats.pop_sizes[3] == 1 and stats.pop_sizes[1] == 1, "pop sizes land in the wrong buckets" );
+  expect( stats.time_full >= milliseconds { 20 }, "time spent full should include the first sleep" );
+  expect( stats.time_empty >= milliseconds { 20 }, "time spent empty should include the second sleep" );
+  expect( stats.time_full + stats.time_empty < milliseconds { 1000 }, "stall times are implausibly long" );
+
+  // reserve() and fill_from() are cut short too: by the stream's capacity, not by what the caller or fd had
+  ByteStream small { 4 };
+  small.writer().reserve( 3 );
+  small.writer().commit( 3 );
+  small.writer().reserve( 3 ); // only 1 byte fits
+  small.writer().reserve();    // "as much as fits" is not cut short while something does
+  small.writer().commit( 1 );
+  small.writer().reserve(); // now nothing fits
+  expect( small.stats().truncated_pushes == 2, "two reservations should have been cut short" );
+
+  array<int, 2> fds {};
+  expect( ::pipe( fds.data() ) == 0, "pipe() failed" );
+  FileDescriptor read_end { fds[0] };
+  FileDescriptor write_end { fds[1] };
+  write_end.write( "efgh" );
+  small.reader().pop( 2 );
+  small.writer().fill_from( read_end ); // reads 2 of the 4 bytes waiting
+  small.writer().fill_from( read_end ); // the stream is full
+  expect( small.stats().truncated_pushes == 4, "two fills should have been cut short" );
+
+  // copies carry the counters with them
+  const ByteStream copy = bs;
+  expect( copy.stats().high_water_mark == 10, "a copy should keep the counters" );
+}
+
+int main()
+{
+  try {
+#ifdef BYTE_STREAM_STATS
+    enabled_test();
+#else
+    disabled_test();
+#endif
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,13 +1,16 @@
 #include "byte_stream_test_harness.hh"
+#include "spill_buffer.hh"
 
 #include <iostream>
 #include <random>
+#include <unistd.h>
 
 using namespace std;
 
-void stress_test( const size_t input_len,    // NOLINT(bugprone-easily-swappable-parameters)
-                  const size_t capacity,     // NOLINT(bugprone-easily-swappable-parameters)
-                  const size_t random_seed ) // NOLINT(bugprone-easily-swappable-parameters)
+void stress_test( const size_t input_len,   // NOLINT(bugprone-easily-swappable-parameters)
+                  const size_t capacity,    // NOLINT(bugprone-easily-swappable-parameters)
+                  const size_t random_seed, // NOLINT(bugprone-easily-swappable-parameters)
+                  const ByteStream::Storage storage )
 {
   default_random_engine rd { random_seed };
 
@@ -21,11 +24,17 @@ void stress_test( const size_t input_len,    // NOLINT(bugprone-easily-swappable
   }();
 
   ByteStreamTestHarness bs { "stress test input=" + to_string( input_len ) + ", capacity=" + to_string( capacity ),
-                             capacity };
+                             capacity,
+                             storage };
+
+  // a mirrored buffer covering whole pages always peeks at everything buffered
+  const bool contiguous_peek = storage == ByteStream::Storage::Mirrored
+                               and capacity % static_cast<size_t>( sysconf( _SC_PAGESIZE ) ) == 0;
 
   size_t expected_bytes_pushed {};
   size_t expected_bytes_popped {};
   size_t expected_available_capacity { capacity };
+  size_t round {};
   while ( expected_bytes_pushed < data.size() or expected_bytes_popped < data.size() ) {
     bs.execute( BytesPushed { expected_bytes_pushed } );
     bs.execute( BytesPopped { expected_bytes_popped } );
@@ -35,7 +44,11 @@ void stress_test( const size_t input_len,    // NOLINT(bugprone-easily-swappable
     /* write something */
     uniform_int_distribution<size_t> bytes_to_push_dist { 0, data.size() - expected_bytes_pushed };
     const size_t amount_to_push = bytes_to_push_dist( rd );
-    bs.execute( Push { data.substr( expected_bytes_pushed, amount_to_push ) } );
+    if ( round++ % 2 ) {
+      bs.execute( PushReserved { data.substr( expected_bytes_pushed, amount_to_push ) } );
+    } else {
+      bs.execute( Push { data.substr( expected_bytes_pushed, amount_to_push ) } );
+    }
     expected_bytes_pushed += min( amount_to_push, expected_available_capacity );
     expected_available_capacity -= min( amount_to_push, expected_available_capacity );
 
@@ -54,13 +67,21 @@ void stress_test( const size_t input_len,    // NOLINT(bugprone-easily-swappable
     if ( expected_bytes_popped + peek_size > expected_bytes_pushed ) {
       throw runtime_error( "ByteStream::reader().peek() returned too-large view" );
     }
+    if ( contiguous_peek and expected_bytes_popped + peek_size != expected_bytes_pushed ) {
+      throw runtime_error( "mirrored ByteStream::reader().peek() did not return every buffered byte" );
+    }
 
     bs.execute( PeekOnce { data.substr( expected_bytes_popped, peek_size ) } );
+    bs.execute( PeekViews { data.substr( expected_bytes_popped, expected_bytes_pushed - expected_bytes_popped ) } );
 
     uniform_int_distribution<size_t> bytes_to_pop_dist { 0, peek_size };
     const size_t amount_to_pop = bytes_to_pop_dist( rd );
 
-    bs.execute( Pop { amount_to_pop } );
+    if ( round % 3 ) {
+      bs.execute( Pop { amount_to_pop } );
+    } else {
+      bs.execute( Read { data.substr( expected_bytes_popped, amount_to_pop ) } );
+    }
     expected_bytes_popped += amount_to_pop;
     expected_available_capacity += amount_to_pop;
     bs.execute( BytesPopped { expected_bytes_popped } );
@@ -70,12 +91,56 @@ void stress_test( const size_t input_len,    // NOLINT(bugprone-easily-swappable
   bs.execute( IsFinished { true } );
 }
 
+// A spilled stream whose file wraps while the consumed part of it is not yet punched out (that happens in
+// 1 MiB steps): the punch must not reach bytes written since
+void spill_wrap_test()
+{
+  constexpr size_t capacity = 4 << 20;
+  default_random_engine rd { capacity };
+  uniform_int_distribution<char> ud;
+  string data;
+  for ( size_t i = 0; i < 5 * capacity; ++i ) {
+    data += ud( rd );
+  }
+
+  ByteStreamTestHarness bs { "spill wrap", capacity, ByteStream::Storage::Spilled };
+  bs.execute( Push { data.substr( 0, capacity ) } );
+  bs.execute( Pop { 512 << 10 } );
+  bs.execute( Push { data.substr( capacity, 512 << 10 ) } );
+  bs.execute( Pop { 600 << 10 } );
+
+  // then keep the file full, going around it a few more times
+  size_t pushed = capacity + ( 512 << 10 );
+  size_t popped = ( 512 << 10 ) + ( 600 << 10 );
+  while ( pushed < data.size() ) {
+    bs.execute( PeekViews { data.substr( popped, pushed - popped ) } );
+    const size_t chunk = min( capacity - ( pushed - popped ), data.size() - pushed );
+    bs.execute( Push { data.substr( pushed, chunk ) } );
+    pushed += chunk;
+    bs.execute( Pop { 300000 } );
+    popped += 300000;
+  }
+  bs.execute( PeekViews { data.substr( popped ) } );
+}
+
 void program_body()
 {
-  stress_test( 19, 3, 10110 );
-  stress_test( 18, 17, 12345 );
-  stress_test( 1111, 17, 98765 );
-  stress_test( 4097, 4096, 11101 );
+  // a tiny memory window, so spilled streams of every capacity below really go through their file
+  SpillBuffer::set_window( 16 );
+
+  for ( const auto storage : { ByteStream::Storage::Ring,
+                               ByteStream::Storage::Chunked,
+                               ByteStream::Storage::Mirrored,
+                               ByteStream::Storage::Pooled,
+                               ByteStream::Storage::Pipe,
+                               ByteStream::Storage::Spilled } ) {
+    stress_test( 19, 3, 10110, storage );
+    stress_test( 18, 17, 12345, storage );
+    stress_test( 1111, 17, 98765, storage );
+    stress_test( 4097, 4096, 11101, storage );
+    stress_test( 20000, 8192, 24680, storage );
+  }
+  spill_wrap_test();
 }
 
 int main()
@@ -3,6 +3,7 @@
 #include "byte_stream.hh"
 #include "common.hh"
 
+#include <algorithm>
 #include <concepts>
 #include <optional>
 #include <utility>
@@ -13,6 +14,25 @@ static_assert( sizeof( Reader ) == sizeof( ByteStream ),
 static_assert( sizeof( Writer ) == sizeof( ByteStream ),
                "Please add member variables to the ByteStream base, not the ByteStream Writer." );
 
+inline std::string storage_name( ByteStream::Storage storage )
+{
+  switch ( storage ) {
+    case ByteStream::Storage::Ring:
+      return "ring";
+    case ByteStream::Storage::Chunked:
+      return "chunked";
+    case ByteStream::Storage::Mirrored:
+      return "mirrored";
+    case ByteStream::Storage::Pooled:
+      return "pooled";
+    case ByteStream::Storage::Pipe:
+      return "pipe";
+    case ByteStream::Storage::Spilled:
+      return "spilled";
+  }
+  return "unknown";
+}
+
 class ByteStreamTestHarness : public TestHarness<ByteStream>
 {
 public:
@@ -20,6 +40,12 @@ public:
     : TestHarness( move( test_name ), "capacity=" + std::to_string( capacity ), ByteStream { capacity } )
   {}
 
+  ByteStreamTestHarness( std::string test_name, uint64_t capacity, ByteStream::Storage storage )
+    : TestHarness( move( test_name ),
+                   "capacity=" + std::to_string( capacity ) + ", storage=" + storage_name( storage ),
+                   ByteStream { capacity, storage } )
+  {}
+
   size_t peek_size() { return object().reader().peek().size(); }
 };
 
@@ -34,6 +60,33 @@ struct Push : public Action<ByteStream>
   void execute( ByteStream& bs ) const override { bs.writer().push( data_ ); }
 };
 
+struct PushReserved : public Push
+{
+  using Push::Push;
+
+  std::string description() const override
+  {
+    return "reserve+commit \"" + Printer::prettify( data_ ) + "\" to the stream";
+  }
+
+  void execute( ByteStream& bs ) const override
+  {
+    std::string_view remaining = data_;
+    while ( not remaining.empty() ) {
+      const auto space = bs.writer().reserve( remaining.size() );
+      if ( space.empty() ) {
+        break;
+      }
+      if ( space.size() > remaining.size() ) {
+        throw ExpectationViolation { "Writer::reserve() returned more space than requested" };
+      }
+      std::copy( remaining.begin(), remaining.begin() + space.size(), space.begin() );
+      bs.writer().commit( space.size() );
+      remaining.remove_prefix( space.size() );
+    }
+  }
+};
+
 struct Close : public Action<ByteStream>
 {
   std::string description() const override { return "close"; }
@@ -107,6 +160,33 @@ struct PeekOnce : public Peek
   }
 };
 
+struct PeekViews : public Peek
+{
+  using Peek::Peek;
+
+  std::string description() const override
+  {
+    return "peek( views ) covers exactly \"" + Printer::prettify( output_ ) + "\"";
+  }
+
+  void execute( ByteStream& bs ) const override
+  {
+    std::vector<std::string_view> views;
+    bs.reader().peek( views );
+    std::string got;
+    for ( const auto view : views ) {
+      if ( view.empty() ) {
+        throw ExpectationViolation { "Reader::peek( views ) returned an empty string_view" };
+      }
+      got += view;
+    }
+    if ( got != output_ ) {
+      throw ExpectationViolation { "Expected views of \"" + Printer::prettify( output_ ) + "\", but found \""
+                                   + Printer::prettify( got ) + "\"" };
+    }
+  }
+};
+
 struct IsClosed : public ConstExpectBool<ByteStream>
 {
   using ConstExpectBool::ConstExpectBool;
@@ -163,6 +243,25 @@ struct BytesPopped : public ExpectNumber<ByteStream, uint64_t>
   size_t value( ByteStream& bs ) const override { return bs.reader().bytes_popped(); }
 };
 
+struct Read : public Expectation<ByteStream>
+{
+  std::string output_;
+
+  explicit Read( std::string output ) : output_( move( output ) ) {}
+
+  std::string description() const override { return "reading gives \"" + Printer::prettify( output_ ) + "\""; }
+
+  void execute( ByteStream& bs ) const override
+  {
+    std::string got;
+    read( bs.reader(), output_.size(), got );
+    if ( got != output_ ) {
+      throw ExpectationViolation { "Expected to read \"" + Printer::prettify( output_ ) + "\", but found \""
+                                   + Printer::prettify( got ) + "\"" };
+    }
+  }
+};
+
 struct ReadAll : public Expectation<ByteStream>
 {
   std::string output_;
@@ -0,0 +1,173 @@
+#include "eventloop.hh"
+#include "exception.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+
+using namespace std;
+using namespace std::chrono;
+
+// Nanoseconds per rule for each phase of a churn workload
+struct Cost
+{
+  double add;    // add a rule
+  double cancel; // cancel it (the loop drops it on its next pass)
+  double pass;   // per standing rule, one call to wait_next_event that asks each rule's interest()
+  double churn;  // rules added and cancelled per second, with a pass after every batch
+};
+
+// The kinds of rules churned
+enum class Kind
+{
+  NonFD,
+  NotifiedNonFD,
+  FD,        // with an interest() predicate
+  NotifiedFD // told their interest through the handle (add_notified_rule)
+};
+
+// `standing` rules stay in the loop throughout, while `churned` more come and go in batches, each batch added,
+// the oldest batch cancelled, and the loop called once -- as connections would come and go on a busy server.
+// No rule is ever interested, so the loop never waits and the cost is all in keeping track of the rules.
+Cost measure( const Kind kind, const EventLoop::Backend backend, const size_t standing, const size_t churned )
+{
+  constexpr size_t batch = 64;
+  EventLoop loop { backend };
+  const size_t category = loop.add_category( "churn" );
+
+  array<int, 2> ends {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, ends.data() ) );
+  FileDescriptor here { ends[0] };
+  FileDescriptor there { ends[1] };
+
+  const auto callback = [] { throw runtime_error( "an uninterested rule was served" ); };
+  const auto interest = [] { return false; };
+  const auto add = [&] {
+    switch ( kind ) {
+      case Kind::NonFD:
+        return loop.add_rule( category, callback, interest );
+      case Kind::NotifiedNonFD:
+        return loop.add_notified_rule( category, callback );
+      case Kind::FD:
+        return loop.add_rule( category, here, Direction::In, callback, interest );
+      case Kind::NotifiedFD:
+        break;
+    }
+    return loop.add_notified_rule( category, here, Direction::In, callback );
+  };
+  const auto per_rule = []( auto elapsed, size_t rules ) {
+    return static_cast<double>( duration_cast<nanoseconds>( elapsed ).count() ) / static_cast<double>( rules );
+  };
+
+  Cost cost {};
+  deque<EventLoop::RuleHandle> handles;
+  auto start = steady_clock::now();
+  for ( size_t i = 0; i < standing; ++i ) {
+    handles.push_back( add() );
+  }
+  cost.add = per_rule( steady_clock::now() - start, standing );
+
+  constexpr size_t passes = 16;
+  loop.wait_next_event( 0 ); // the first pass takes in the new rules
+  start = steady_clock::now();
+  for ( size_t i = 0; i < passes; ++i ) {
+    loop.wait_next_event( 0 );
+  }
+  cost.pass = per_rule( steady_clock::now() - start, standing * passes );
+
+  start = steady_clock::now();
+  for ( size_t i = 0; i < churned; i += batch ) {
+    for ( size_t j = 0; j < batch; ++j ) {
+      handles.push_back( add() );
+    }
+    for ( size_t j = 0; j < batch; ++j ) {
+      handles.front().cancel();
+      handles.pop_front();
+    }
+    loop.wait_next_event( 0 );
+  }
+  const auto churn_time = steady_clock::now() - start;
+  cost.churn = static_cast<double>( churned ) / duration<double>( churn_time ).count();
+
+  start = steady_clock::now();
+  for ( auto& handle : handles ) {
+    handle.cancel();
+  }
+  cost.cancel = per_rule( steady_clock::now() - start, handles.size() );
+  if ( loop.wait_next_event( 0 ) != EventLoop::Result::Exit ) {
+    throw runtime_error( "rules were left after all were cancelled" );
+  }
+
+  return cost;
+}
+
+struct Options
+{
+  size_t max_standing = 1000; // the largest count of standing rules; the sweep goes up by tens from 100
+  size_t churned = 50'000;    // rules added and cancelled in each run
+};
+
+Options parse_options( span<char*> args )
+{
+  Options options;
+  for ( size_t i = 1; i + 1 < args.size(); i += 2 ) {
+    const string_view flag = args[i];
+    const string value = args[i + 1];
+    if ( flag == "--max-standing" ) {
+      options.max_standing = stoull( value );
+    } else if ( flag == "--churned" ) {
+      options.churned = stoull( value );
+    } else {
+      throw runtime_error( "unknown option " + string { flag } );
+    }
+  }
+  return options;
+}
+
+void program_body( const Options& options )
+{
+  struct Config
+  {
+    Kind kind;
+    EventLoop::Backend backend;
+    string_view name;
+  };
+  for ( const auto& [kind, backend, name] : { Config { Kind::NonFD, EventLoop::Backend::Poll, "non-fd rules" },
+                                              Config { Kind::NotifiedNonFD, EventLoop::Backend::Poll,
+                                                       "notified non-fd rules" },
+                                              Config { Kind::FD, EventLoop::Backend::Poll, "fd rules, poll" },
+                                              Config { Kind::FD, EventLoop::Backend::Epoll, "fd rules, epoll" },
+                                              Config { Kind::NotifiedFD, EventLoop::Backend::Epoll,
+                                                       "notified fd rules, epoll" } } ) {
+    cout << name << ", " << options.churned << " churned:\n";
+    for ( size_t standing = 100; standing <= options.max_standing; standing *= 10 ) {
+      const Cost cost = measure( kind, backend, standing, options.churned );
+      cout << fixed << setprecision( 1 ) << "  " << setw( 6 ) << standing << " standing: " << setw( 6 ) << cost.add
+           << " ns/add, " << setw( 6 ) << cost.cancel << " ns/cancel, " << setw( 5 ) << cost.pass
+           << " ns/rule/pass, " << setprecision( 0 ) << setw( 9 ) << cost.churn << " rules/s churned\n";
+    }
+  }
+}
+
+// Usage: eventloop_churn_speed_test [--max-standing N] [--churned N]
+// --max-standing 10000 adds the rows where every pass walks ten thousand standing rules.
+int main( int argc, char** argv )
+{
+  try {
+    program_body( parse_options( span( argv, argc ) ) );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
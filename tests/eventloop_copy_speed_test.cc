@@ -0,0 +1,254 @@
+#include "byte_stream.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+#include "socket.hh"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fcntl.h>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// How the rules' callbacks are handed to EventLoop::add_rule
+enum class Callbacks
+{
+  StdFunction, // wrapped in std::function first, as the non-template overloads take them
+  Lambdas      // as they are
+};
+
+template<Callbacks kind, typename F>
+auto wrap( F&& f )
+{
+  if constexpr ( kind == Callbacks::StdFunction ) {
+    return function { std::forward<F>( f ) };
+  } else {
+    return std::forward<F>( f );
+  }
+}
+
+pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe2", ::pipe2( fds.data(), O_NONBLOCK ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+// The four rules of bidirectional_stream_copy (apps/bidirectional_stream_copy.cc), with pipes standing in for
+// stdin and stdout and a socket pair for the connection. The same loop runs the other side of each: a rule
+// writing `total` bytes into "stdin" in `chunk`-byte writes, one echoing everything back from the far end of the
+// socket, and one draining "stdout". Returns rule callbacks served per second.
+template<Callbacks kind>
+double events_per_second( const size_t total, const size_t chunk )
+{
+  constexpr size_t buffer_size = 1048576;
+
+  EventLoop loop { EventLoop::Backend::Epoll };
+  auto [input, feed] = make_pipe();
+  auto [drain, output] = make_pipe();
+  array<int, 2> ends {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, ends.data() ) );
+  LocalStreamSocket socket { FileDescriptor { ends[0] } };
+  LocalStreamSocket peer { FileDescriptor { ends[1] } };
+
+  ByteStream outbound { buffer_size, ByteStream::Storage::Pipe };
+  ByteStream inbound { buffer_size, ByteStream::Storage::Mirrored };
+  bool outbound_shutdown = false;
+  bool inbound_shutdown = false;
+  vector<string_view> inbound_views {};
+
+  // rule 1: read from stdin into outbound byte stream
+  loop.add_rule(
+    "read from stdin into outbound byte stream",
+    input,
+    Direction::In,
+    wrap<kind>( [&] {
+      outbound.writer().fill_from( input );
+      if ( input.eof() ) {
+        outbound.writer().close();
+      }
+    } ),
+    wrap<kind>( [&] {
+      return !outbound.has_error() and !inbound.has_error() and ( outbound.writer().available_capacity() > 0 )
+             and !outbound.writer().is_closed();
+    } ),
+    wrap<kind>( [&] { outbound.writer().close(); } ),
+    wrap<kind>( [&] {
+      outbound.set_error();
+      inbound.set_error();
+    } ) );
+
+  // rule 2: read from outbound byte stream into socket
+  loop.add_rule(
+    "read from outbound byte stream into socket",
+    socket,
+    Direction::Out,
+    wrap<kind>( [&] {
+      if ( outbound.reader().bytes_buffered() ) {
+        outbound.reader().drain_to( socket );
+      }
+      if ( outbound.reader().is_finished() ) {
+        socket.shutdown( SHUT_WR );
+        outbound_shutdown = true;
+      }
+    } ),
+    wrap<kind>( [&] {
+      return outbound.reader().bytes_buffered() or ( outbound.reader().is_finished() and not outbound_shutdown );
+    } ),
+    wrap<kind>( [&] { outbound.writer().close(); } ),
+    wrap<kind>( [&] {
+      outbound.set_error();
+      inbound.set_error();
+    } ) );
+
+  // rule 3: read from socket into inbound byte stream
+  loop.add_rule(
+    "read from socket into inbound byte stream",
+    socket,
+    Direction::In,
+    wrap<kind>( [&] {
+      inbound.writer().commit( socket.read( inbound.writer().reserve() ) );
+      if ( socket.eof() ) {
+        inbound.writer().close();
+      }
+    } ),
+    wrap<kind>( [&] {
+      return !inbound.has_error() and !outbound.has_error() and ( inbound.writer().available_capacity() > 0 )
+             and !inbound.writer().is_closed();
+    } ),
+    wrap<kind>( [&] { inbound.writer().close(); } ),
+    wrap<kind>( [&] {
+      outbound.set_error();
+      inbound.set_error();
+    } ) );
+
+  // rule 4: read from inbound byte stream into stdout
+  loop.add_rule(
+    "read from inbound byte stream into stdout",
+    output,
+    Direction::Out,
+    wrap<kind>( [&] {
+      if ( inbound.reader().bytes_buffered() ) {
+        inbound.reader().peek( inbound_views );
+        inbound.reader().pop( output.write( inbound_views ) );
+      }
+      if ( inbound.reader().is_finished() ) {
+        output.close();
+        inbound_shutdown = true;
+      }
+    } ),
+    wrap<kind>( [&] {
+      return inbound.reader().bytes_buffered() or ( inbound.reader().is_finished() and not inbound_shutdown );
+    } ),
+    wrap<kind>( [&] { inbound.writer().close(); } ),
+    wrap<kind>( [&] {
+      outbound.set_error();
+      inbound.set_error();
+    } ) );
+
+  // the other sides: whoever writes to stdin, the peer (an echo server), and whoever reads stdout
+  const string bytes( chunk, 'x' );
+  size_t fed = 0;
+  loop.add_rule(
+    "feed stdin",
+    feed,
+    Direction::Out,
+    wrap<kind>( [&] {
+      fed += feed.write( string_view { bytes }.substr( 0, total - fed ) );
+      if ( fed == total ) {
+        feed.close();
+      }
+    } ),
+    wrap<kind>( [&] { return fed < total; } ) );
+
+  ByteStream echo { buffer_size };
+  bool echo_shutdown = false;
+  loop.add_rule(
+    "peer reads",
+    peer,
+    Direction::In,
+    wrap<kind>( [&] {
+      echo.writer().commit( peer.read( echo.writer().reserve() ) );
+      if ( peer.eof() ) {
+        echo.writer().close();
+      }
+    } ),
+    wrap<kind>( [&] { return echo.writer().available_capacity() > 0 and not echo.writer().is_closed(); } ) );
+  loop.add_rule(
+    "peer echoes",
+    peer,
+    Direction::Out,
+    wrap<kind>( [&] {
+      echo.reader().drain_to( peer );
+      if ( echo.reader().is_finished() ) {
+        peer.shutdown( SHUT_WR );
+        echo_shutdown = true;
+      }
+    } ),
+    wrap<kind>( [&] {
+      return echo.reader().bytes_buffered() or ( echo.reader().is_finished() and not echo_shutdown );
+    } ) );
+
+  size_t drained = 0;
+  array<char, 65536> scratch {};
+  loop.add_rule(
+    "drain stdout",
+    drain,
+    Direction::In,
+    wrap<kind>( [&] { drained += drain.read( scratch ); } ),
+    wrap<kind>( [&] { return not drain.eof(); } ) );
+
+  size_t events = 0;
+  const auto start = steady_clock::now();
+  while ( loop.wait_next_event( 1000 ) != EventLoop::Result::Exit ) {
+    ++events;
+  }
+  const auto elapsed = steady_clock::now() - start;
+
+  if ( drained != total ) {
+    throw runtime_error( "copied " + to_string( drained ) + " bytes, expected " + to_string( total ) );
+  }
+  return static_cast<double>( events ) / duration<double>( elapsed ).count();
+}
+
+void program_body( const size_t total )
+{
+  // each the best of a few runs, taking turns: the rate is mostly syscalls, and noisy
+  constexpr unsigned runs = 3;
+  for ( const size_t chunk : { 64, 1024, 16384 } ) {
+    double with_function = 0;
+    double with_lambdas = 0;
+    for ( unsigned run = 0; run < runs; ++run ) {
+      with_function = max( with_function, events_per_second<Callbacks::StdFunction>( total, chunk ) );
+      with_lambdas = max( with_lambdas, events_per_second<Callbacks::Lambdas>( total, chunk ) );
+    }
+    cout << fixed << setprecision( 0 ) << setw( 5 ) << chunk << "-byte writes: " << setw( 7 ) << with_function
+         << " events/s with std::function, " << setw( 7 ) << with_lambdas << " with lambdas\n";
+  }
+}
+
+// Usage: eventloop_copy_speed_test [total_bytes]   (default 4 MiB)
+int main( int argc, char** argv )
+{
+  try {
+    auto args = span( argv, argc );
+    program_body( args.size() > 1 ? stoull( args[1] ) : size_t { 1 } << 22U );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
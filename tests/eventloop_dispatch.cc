@@ -0,0 +1,252 @@
+#include "common.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+using namespace std;
+
+// `fds` socket pairs with bytes waiting on every one, each read one byte at a time by a read rule, plus
+// `non_fd` non-fd rules that are each interested once per round
+struct Setup
+{
+  EventLoop loop;
+  vector<FileDescriptor> ends {};
+  vector<size_t> fd_served {};
+  vector<unsigned> non_fd_pending {};
+  vector<size_t> non_fd_served {};
+
+  Setup( EventLoop::Backend backend, size_t fds, size_t non_fd ) : loop( backend )
+  {
+    const size_t category = loop.add_category( "read one byte" );
+    fd_served.resize( fds );
+    for ( size_t i = 0; i < fds; ++i ) {
+      array<int, 2> pair {};
+      CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair.data() ) );
+      ends.emplace_back( pair[0] );
+      ends.emplace_back( pair[1] );
+      ends.back().write( string( 1000, 'x' ) );
+      loop.add_read_rule(
+        category, ends[2 * i], [] { return 1; }, [this, i]( string_view ) { ++fd_served[i]; } );
+    }
+
+    non_fd_pending.resize( non_fd );
+    non_fd_served.resize( non_fd );
+    for ( size_t i = 0; i < non_fd; ++i ) {
+      loop.add_rule(
+        "non-fd",
+        [this, i] {
+          --non_fd_pending[i];
+          ++non_fd_served[i];
+        },
+        [this, i] { return non_fd_pending[i] > 0; } );
+    }
+  }
+
+  size_t total_served() const
+  {
+    size_t total = 0;
+    for ( const auto count : fd_served ) {
+      total += count;
+    }
+    for ( const auto count : non_fd_served ) {
+      total += count;
+    }
+    return total;
+  }
+
+  void step()
+  {
+    expect( loop.wait_next_event( 1000 ) == EventLoop::Result::Success, "a call served nothing" );
+  }
+};
+
+void one_per_call_test( const EventLoop::Backend backend )
+{
+  Setup setup { backend, 8, 2 };
+  setup.non_fd_pending = { 1, 1 };
+  setup.step();
+  expect( setup.total_served() == 1, "Dispatch::One served more than one rule" );
+  setup.step();
+  setup.step();
+  expect( setup.non_fd_served == vector<size_t> { 1, 1 }, "non-fd rules not served first" );
+  expect( setup.fd_served.front() == 1, "fd rules not served in order" );
+}
+
+void all_ready_test( const EventLoop::Backend backend )
+{
+  Setup setup { backend, 8, 3 };
+  setup.loop.set_dispatch( EventLoop::Dispatch::AllReady );
+  setup.non_fd_pending = { 1, 1, 1 };
+  setup.step();
+  expect( setup.non_fd_served == vector<size_t> { 1, 1, 1 }, "not every ready non-fd rule was served" );
+  expect( ranges::all_of( setup.fd_served, []( size_t count ) { return count == 1; } ),
+          "not every ready fd rule was served by one call" );
+}
+
+void budget_test( const EventLoop::Backend backend )
+{
+  // 8 ready fds, 3 per call: after 8 calls, each should have been served 3 times
+  Setup setup { backend, 8, 0 };
+  setup.loop.set_dispatch( EventLoop::Dispatch::AllReady, 3 );
+  for ( size_t call = 1; call <= 8; ++call ) {
+    setup.step();
+    expect( setup.total_served() == 3 * call, "a call did not serve exactly the budget" );
+  }
+  // io_uring serves completions in the order the kernel posts them, which is only roughly submission order
+  const auto [fewest, most] = ranges::minmax( setup.fd_served );
+  expect( most - fewest <= ( backend == EventLoop::Backend::IoUring ? 2 : 0 ), "budgeted dispatch was not fair" );
+
+  // non-fd rules share the budget, and take turns too
+  Setup mixed { backend, 2, 4 };
+  mixed.loop.set_dispatch( EventLoop::Dispatch::AllReady, 3 );
+  for ( size_t call = 0; call < 4; ++call ) {
+    mixed.non_fd_pending = { 1, 1, 1, 1 };
+    mixed.step();
+  }
+  expect( mixed.non_fd_served == vector<size_t> { 3, 3, 3, 3 }, "budgeted non-fd rules were not served fairly" );
+}
+
+// Rules keep the order they were added in while others are cancelled and added around them (Dispatch::One serves
+// the first ready one), and a handle to a cancelled rule can't cancel the rule that took its place
+void order_test( const EventLoop::Backend backend, const bool fd_rules )
+{
+  EventLoop loop { backend };
+  const size_t category = loop.add_category( "order" );
+  vector<FileDescriptor> ends {};
+  vector<unsigned> pending( 8 );
+  vector<size_t> served {};
+  vector<EventLoop::RuleHandle> handles {};
+
+  const auto add = [&]( size_t i ) {
+    if ( not fd_rules ) {
+      handles.push_back( loop.add_rule(
+        category,
+        [&, i] {
+          --pending[i];
+          served.push_back( i );
+        },
+        [&, i] { return pending[i] > 0; } ) );
+      return;
+    }
+    array<int, 2> pair {};
+    CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair.data() ) );
+    ends.emplace_back( pair[0] );
+    ends.emplace_back( pair[1] );
+    ends.back().write( string( 8, 'x' ) );
+    handles.push_back( loop.add_read_rule(
+      category,
+      ends[ends.size() - 2],
+      [&, i] { return size_t { pending[i] > 0 }; },
+      [&, i]( string_view ) {
+        --pending[i];
+        served.push_back( i );
+      } ) );
+  };
+
+  for ( size_t i = 0; i < 6; ++i ) {
+    add( i );
+  }
+  handles[1].cancel();
+  handles[3].cancel();
+  loop.wait_next_event( 0 ); // drops the cancelled rules, freeing their places
+  add( 6 );
+  add( 7 );
+  handles[1].cancel();
+  handles[3].cancel();
+
+  pending.assign( pending.size(), 1 );
+  while ( loop.wait_next_event( 0 ) == EventLoop::Result::Success ) {}
+  expect( served == vector<size_t> { 0, 2, 4, 5, 6, 7 }, "rules were not served in the order they were added" );
+}
+
+// The add_rule templates take any callables, move-only or too big to keep in place
+void callables_test( const EventLoop::Backend backend )
+{
+  EventLoop loop { backend };
+  const size_t category = loop.add_category( "callables" );
+  array<int, 2> pair {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair.data() ) );
+  FileDescriptor here { pair[0] };
+  FileDescriptor there { pair[1] };
+
+  auto owned = make_unique<size_t>( 0 );
+  size_t* const count = owned.get();
+  auto moved_in = loop.add_rule(
+    category, [owned = move( owned )] { ++*owned; }, [count] { return *count == 0; } );
+
+  array<char, 256> big {};
+  big.back() = 'x';
+  char seen {};
+  auto too_big = loop.add_rule(
+    category,
+    here,
+    Direction::Out,
+    [big, &seen] { seen = big.back(); },
+    [&seen] { return seen == 0; },
+    [big] {},
+    [big] {} );
+
+  while ( loop.wait_next_event( 1000 ) == EventLoop::Result::Success and ( *count == 0 or seen == 0 ) ) {}
+  expect( *count == 1 and seen == 'x', "rules added with the templates were not served" );
+}
+
+// A cancelled rule lets go of what its callables captured (an fd rule, also of its fd) on the next call
+void release_test( const EventLoop::Backend backend )
+{
+  EventLoop loop { backend };
+  const size_t category = loop.add_category( "release" );
+  array<int, 2> pair {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair.data() ) );
+  FileDescriptor here { pair[0] };
+  FileDescriptor there { pair[1] };
+
+  auto captured = make_shared<int>();
+  auto non_fd = loop.add_rule(
+    category, [captured] {}, [] { return false; } );
+  auto fd = loop.add_rule(
+    category, here, Direction::In, [captured] {}, [captured] { return false; } );
+  loop.wait_next_event( 0 );
+  expect( captured.use_count() == 4, "a rule let go of its callables too soon" );
+  non_fd.cancel();
+  fd.cancel();
+  loop.wait_next_event( 0 );
+  expect( captured.use_count() == 1, "a cancelled rule kept its callables" );
+
+  // and the fd rule's duplicate of `here` is closed, so closing `here` gives the peer EOF
+  here.close();
+  string bytes;
+  there.read( bytes );
+  expect( there.eof(), "a cancelled rule kept its fd open" );
+}
+
+int main()
+{
+  try {
+    for ( const auto backend :
+          { EventLoop::Backend::Poll, EventLoop::Backend::Epoll, EventLoop::Backend::IoUring } ) {
+      if ( backend != EventLoop::Backend::IoUring ) { // io_uring handles every completion regardless
+        one_per_call_test( backend );
+        order_test( backend, false );
+        order_test( backend, true );
+      }
+      all_ready_test( backend );
+      release_test( backend );
+      callables_test( backend );
+      budget_test( backend );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+#include "common.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+using namespace std;
+
+array<int, 2> socket_pair()
+{
+  array<int, 2> pair {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair.data() ) );
+  return pair;
+}
+
+// A callback closes its fd and opens another that gets the same number (as an accept() might): a rule on the
+// new fd must be polled for it, not for the one that was closed
+void reused_fd_test( const EventLoop::Backend backend )
+{
+  EventLoop loop { backend };
+  const size_t category = loop.add_category( "reused fd" );
+
+  const auto first = socket_pair();
+  FileDescriptor old_end { first[0] };
+  FileDescriptor old_peer { first[1] };
+  const int number = old_end.fd_num();
+  old_peer.write( "x" );
+
+  vector<FileDescriptor> new_ends;
+  bool new_served = false;
+  loop.add_rule( category, old_end, Direction::In, [&] {
+    old_end.close();
+    const auto second = socket_pair();
+    new_ends.emplace_back( second[0] );
+    new_ends.emplace_back( second[1] );
+    if ( new_ends[1].fd_num() == number ) {
+      swap( new_ends[0], new_ends[1] );
+    }
+    loop.add_rule( category, new_ends[0], Direction::In, [&] {
+      string bytes;
+      new_ends[0].read( bytes );
+      new_served = true;
+    } );
+  } );
+
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Success, "the first fd was not served" );
+  expect( new_ends.size() == 2 and new_ends[0].fd_num() == number, "the fd number was not reused" );
+  new_ends[1].write( "y" );
+  for ( unsigned i = 0; i < 10 and not new_served; ++i ) {
+    expect( loop.wait_next_event( 100 ) != EventLoop::Result::Timeout,
+            "the fd with the reused number was never polled" );
+  }
+  expect( new_served, "the fd with the reused number was not served" );
+}
+
+int main()
+{
+  try {
+    for ( const auto backend :
+          { EventLoop::Backend::Poll, EventLoop::Backend::Epoll, EventLoop::Backend::IoUring } ) {
+      reused_fd_test( backend );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,198 @@
+#include "common.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+
+#include <array>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+
+using namespace std;
+
+pair<FileDescriptor, FileDescriptor> socket_pair()
+{
+  array<int, 2> ends {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, ends.data() ) );
+  return { FileDescriptor { ends[0] }, FileDescriptor { ends[1] } };
+}
+
+// Call wait_next_event until `done`, or give up
+template<typename Done>
+void run_until( EventLoop& loop, Done done, const string& what )
+{
+  for ( unsigned i = 0; i < 100 and not done(); ++i ) {
+    loop.wait_next_event( 100 );
+  }
+  expect( done(), what );
+}
+
+// A rule is served only while it says it is interested, and nothing asks it
+void read_test( const EventLoop::Backend backend )
+{
+  EventLoop loop { backend };
+  const size_t category = loop.add_category( "read" );
+  auto [here, there] = socket_pair();
+  there.write( string( 8, 'x' ) );
+
+  array<char, 1> byte {};
+  unsigned reads = 0;
+  optional<EventLoop::RuleHandle> handle;
+  handle = loop.add_notified_rule( category, here, Direction::In, [&] {
+    here.read( byte );
+    if ( ++reads % 4 == 0 ) {
+      handle->set_interest( false );
+    }
+  } );
+
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Exit, "a rule not yet interested was waited for" );
+  expect( reads == 0, "a rule not yet interested was served" );
+
+  handle->set_interest( true );
+  run_until( loop, [&] { return reads == 4; }, "an interested rule was not served" );
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Exit, "the rule was still waited for after opting out" );
+  expect( reads == 4, "the rule was served after opting out" );
+
+  handle->set_interest( true );
+  run_until( loop, [&] { return reads == 8; }, "the rule was not served once interested again" );
+  expect( loop.profile().categories.at( category ).interest_evaluations == 0, "interest() was asked" );
+}
+
+// EOF cancels a notified rule, as it does any other
+void eof_test( const EventLoop::Backend backend )
+{
+  EventLoop loop { backend };
+  auto [here, there] = socket_pair();
+  bool cancelled = false;
+  string bytes;
+  auto handle = loop.add_notified_rule(
+    loop.add_category( "eof" ), here, Direction::In, [&] { here.read( bytes ); }, [&] { cancelled = true; } );
+  handle.set_interest( true );
+
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, "an idle rule was served" );
+  there.close();
+  run_until( loop, [&] { return cancelled; }, "EOF did not cancel the rule" );
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Exit, "a rule was left after EOF" );
+}
+
+// Cancelling through the handle drops the rule, even though nothing else makes the loop look at it
+void cancel_test( const EventLoop::Backend backend )
+{
+  EventLoop loop { backend };
+  auto [here, there] = socket_pair();
+  auto handle = loop.add_notified_rule( loop.add_category( "cancel" ), here, Direction::In, [] {} );
+  handle.set_interest( true );
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, "an idle rule was served" );
+  handle.cancel();
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Exit, "a cancelled rule was waited for" );
+  handle.set_interest( true ); // harmless once the rule is gone
+}
+
+// Two notified rules on one fd, each opting out on its own: the fd is watched for what is still wanted
+void directions_test( const EventLoop::Backend backend )
+{
+  EventLoop loop { backend };
+  const size_t category = loop.add_category( "directions" );
+  auto [here, there] = socket_pair();
+  there.write( "pong" );
+
+  optional<EventLoop::RuleHandle> writer;
+  optional<EventLoop::RuleHandle> reader;
+  bool wrote = false;
+  string received;
+  writer = loop.add_notified_rule( category, here, Direction::Out, [&] {
+    here.write( "ping" );
+    wrote = true;
+    writer->set_interest( false );
+  } );
+  reader = loop.add_notified_rule( category, here, Direction::In, [&] {
+    string bytes;
+    here.read( bytes );
+    received += bytes;
+    if ( received.size() == 4 ) {
+      reader->set_interest( false );
+    }
+  } );
+  writer->set_interest( true );
+  reader->set_interest( true );
+
+  run_until( loop, [&] { return wrote and received == "pong"; }, "the rules on one fd were not both served" );
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Exit, "the fd was still watched after both opted out" );
+  string bytes;
+  there.read( bytes );
+  expect( bytes == "ping", "the writer wrote \"" + bytes + "\"" );
+
+  // and one rule's interest comes back on its own
+  there.write( "more" );
+  reader->set_interest( true );
+  run_until( loop, [&] { return received == "pongmore"; }, "the reader was not served again" );
+}
+
+// A notified rule without an fd runs while interested; predicates and timers can't be told their interest
+void non_fd_test()
+{
+  EventLoop loop;
+  const size_t category = loop.add_category( "non-fd" );
+  unsigned runs = 0;
+  optional<EventLoop::RuleHandle> handle;
+  handle = loop.add_notified_rule( category, [&] {
+    ++runs;
+    handle->set_interest( false );
+  } );
+
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Exit and runs == 0, "an uninterested rule ran" );
+  handle->set_interest( true );
+  loop.wait_next_event( 0 );
+  expect( runs == 1, "an interested rule ran " + to_string( runs ) + " times, not once" );
+
+  // with Dispatch::One, a rule the budget leaves out is served on the next call; a cancelled one is not
+  unsigned second_runs = 0;
+  optional<EventLoop::RuleHandle> second;
+  second = loop.add_notified_rule( category, [&] {
+    ++second_runs;
+    second->set_interest( false );
+  } );
+  handle->set_interest( true );
+  second->set_interest( true );
+  loop.wait_next_event( 0 );
+  expect( runs == 2 and second_runs == 0, "Dispatch::One did not serve the first notified rule alone" );
+  loop.wait_next_event( 0 );
+  expect( second_runs == 1, "a notified rule the budget left out was not served on the next call" );
+  second->set_interest( true );
+  second->cancel();
+  loop.wait_next_event( 0 );
+  expect( second_runs == 1, "a cancelled notified rule ran" );
+
+  auto predicate = loop.add_rule( category, [] {}, [] { return false; } );
+  auto timer = loop.add_timer( category, chrono::milliseconds { 1000 }, [] {} );
+  for ( auto* const other : { &predicate, &timer } ) {
+    bool threw = false;
+    try {
+      other->set_interest( true );
+    } catch ( const runtime_error& ) {
+      threw = true;
+    }
+    expect( threw, "set_interest() on a rule that isn't notified did not throw" );
+  }
+}
+
+int main()
+{
+  try {
+    for ( const auto backend :
+          { EventLoop::Backend::Poll, EventLoop::Backend::Epoll, EventLoop::Backend::IoUring } ) {
+      read_test( backend );
+      eof_test( backend );
+      cancel_test( backend );
+      directions_test( backend );
+    }
+    non_fd_test();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+#include "common.hh"
+#include "eventloop_pool.hh"
+#include "socket.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// An echo server: each connection gets one rule, which lives until the client closes. Counts the connections
+// each loop was given.
+class EchoServer
+{
+public:
+  explicit EchoServer( const EventLoopPool::Options& options )
+    : pool_(
+      Address { "127.0.0.1" },
+      [this]( EventLoop& loop, TCPSocket&& connection ) { serve( loop, move( connection ) ); },
+      options )
+  {}
+
+  EventLoopPool& pool() { return pool_; }
+
+  map<EventLoop*, size_t> served()
+  {
+    const lock_guard lock { mutex_ };
+    return served_;
+  }
+
+private:
+  mutex mutex_ {};
+  map<EventLoop*, size_t> served_ {};
+  EventLoopPool pool_; // last, so its threads stop before the rest goes away
+
+  void serve( EventLoop& loop, TCPSocket&& connection )
+  {
+    {
+      const lock_guard lock { mutex_ };
+      ++served_[&loop];
+    }
+    thread_local const size_t category = loop.add_category( "echo" );
+    FileDescriptor fd = connection.duplicate();
+    loop.add_rule( category, fd, Direction::In, [socket = move( connection )]() mutable {
+      string bytes;
+      socket.read( bytes );
+      if ( not bytes.empty() ) {
+        socket.write( bytes );
+      }
+    } );
+  }
+};
+
+TCPSocket connect_and_echo( const Address& address, const string& message )
+{
+  TCPSocket client;
+  client.connect( address );
+  client.write( message );
+  string echoed;
+  while ( echoed.size() < message.size() and not client.eof() ) {
+    string bytes;
+    client.read( bytes );
+    echoed += bytes;
+  }
+  expect( echoed == message, "echoed \"" + echoed + "\" instead of \"" + message + "\"" );
+  return client;
+}
+
+// Connections one after another, each closed before the next: the kernel spreads them, and all are served
+void sharding_test()
+{
+  EchoServer server { { .threads = 4, .pin = true } };
+  expect( server.pool().size() == 4, "wrong number of loops" );
+  for ( size_t i = 0; i < 64; ++i ) {
+    connect_and_echo( server.pool().local_address(), "hello " + to_string( i ) );
+  }
+  server.pool().stop();
+
+  size_t total = 0;
+  for ( const auto& [loop, count] : server.served() ) {
+    total += count;
+  }
+  expect( total == 64, "served " + to_string( total ) + " connections instead of 64" );
+  expect( server.pool().handoffs() == 0, "connections were passed over with handoff off" );
+}
+
+// Connections that stay open, with handoff at a margin of 0: however the kernel spreads them, each goes to a loop
+// with the fewest, so the loops end up with the same number
+void handoff_test()
+{
+  EchoServer server { { .threads = 2, .handoff = true, .handoff_margin = 0 } };
+  vector<TCPSocket> clients;
+  for ( size_t i = 0; i < 16; ++i ) {
+    clients.push_back( connect_and_echo( server.pool().local_address(), "connection " + to_string( i ) ) );
+  }
+  const auto served = server.served();
+  expect( served.size() == 2, "only one loop was given connections" );
+  for ( const auto& [loop, count] : served ) {
+    expect( count == 8, "a loop was given " + to_string( count ) + " of 16 connections" );
+  }
+
+  // and each of them still works
+  for ( auto& client : clients ) {
+    client.write( "again" );
+    string bytes;
+    client.read( bytes );
+    expect( bytes == "again", "a connection stopped echoing" );
+  }
+  server.pool().stop();
+}
+
+// An exception from the handler stops the pool, and stop() rethrows it
+void error_test()
+{
+  EventLoopPool pool {
+    Address { "127.0.0.1" },
+    []( EventLoop&, TCPSocket&& ) { throw runtime_error( "handler failed" ); },
+    { .threads = 2 } };
+  TCPSocket client;
+  client.connect( pool.local_address() );
+  string bytes;
+  client.read( bytes ); // EOF once the connection is dropped
+  try {
+    pool.stop();
+  } catch ( const runtime_error& e ) {
+    expect( string { e.what() } == "handler failed", "stop() threw the wrong exception" );
+    return;
+  }
+  expect( false, "stop() did not rethrow the handler's exception" );
+}
+
+int main()
+{
+  try {
+    sharding_test();
+    handoff_test();
+    error_test();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,109 @@
+#include "eventloop_pool.hh"
+#include "socket.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// Each connection gets one rule, which echoes what arrives and closes the connection: the server closes first,
+// so the clients' ports don't linger in TIME_WAIT
+void echo_once( EventLoop& loop, TCPSocket&& connection )
+{
+  thread_local const size_t category = loop.add_category( "echo once" );
+  FileDescriptor fd = connection.duplicate();
+  loop.add_rule( category, fd, Direction::In, [socket = move( connection )]() mutable {
+    string bytes;
+    socket.read( bytes );
+    if ( not bytes.empty() ) {
+      socket.write( bytes );
+    }
+    socket.close();
+  } );
+}
+
+// `connections` loopback connections, each a connect, a one-byte echo and a close, made by `clients` threads
+// at once against a pool of `loops` loops. Returns connections per second.
+double connections_per_second( const size_t loops,
+                               const bool handoff,
+                               const size_t clients,
+                               const size_t connections )
+{
+  EventLoopPool pool { Address { "127.0.0.1" }, echo_once, { .threads = loops, .handoff = handoff } };
+  const Address address = pool.local_address();
+
+  atomic<size_t> failures {};
+  vector<thread> threads;
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < clients; ++i ) {
+    threads.emplace_back( [&, share = connections / clients + ( i < connections % clients )] {
+      for ( size_t j = 0; j < share; ++j ) {
+        TCPSocket client;
+        client.connect( address );
+        client.write( "x" );
+        string echoed;
+        while ( not client.eof() ) {
+          string bytes;
+          client.read( bytes );
+          echoed += bytes;
+        }
+        failures += echoed != "x";
+      }
+    } );
+  }
+  for ( auto& client : threads ) {
+    client.join();
+  }
+  const auto elapsed = steady_clock::now() - start;
+  pool.stop();
+
+  if ( failures ) {
+    throw runtime_error( to_string( failures ) + " connections were not echoed" );
+  }
+  return static_cast<double>( connections ) / duration<double>( elapsed ).count();
+}
+
+void program_body( const size_t connections )
+{
+  const size_t cpus = max( thread::hardware_concurrency(), 1U );
+  vector<size_t> loop_counts;
+  for ( size_t loops = 1; loops < cpus; loops *= 2 ) {
+    loop_counts.push_back( loops );
+  }
+  loop_counts.push_back( cpus );
+
+  cout << cpus << " CPU(s), " << connections << " connections per run:\n";
+  for ( const size_t loops : loop_counts ) {
+    const size_t clients = max( size_t { 4 }, 2 * loops );
+    const double sharded = connections_per_second( loops, false, clients, connections );
+    const double handed_off = connections_per_second( loops, true, clients, connections );
+    cout << fixed << setprecision( 0 ) << "  " << setw( 3 ) << loops << " loop(s), " << setw( 3 ) << clients
+         << " clients: " << setw( 7 ) << sharded << " connections/s, " << setw( 7 ) << handed_off
+         << " with handoff\n";
+  }
+}
+
+// Usage: eventloop_pool_speed_test [connections]   (default 10,000 for each run)
+int main( int argc, char** argv )
+{
+  try {
+    auto args = span( argv, argc );
+    program_body( args.size() > 1 ? stoull( args[1] ) : 10'000 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
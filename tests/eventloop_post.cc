@@ -0,0 +1,155 @@
+#include "common.hh"
+#include "eventloop.hh"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+uint64_t wakeups( const EventLoop& loop )
+{
+  const auto profile = loop.profile();
+  const auto it = ranges::find( profile.categories, "posted tasks", &EventLoop::CategoryProfile::name );
+  expect( it != profile.categories.end(), "no \"posted tasks\" category" );
+  return it->invocations;
+}
+
+// Posts from several threads, made while the loop isn't looking, all run on its next call: one wakeup
+void burst_test( const EventLoop::Backend backend )
+{
+  constexpr unsigned producers = 4;
+  constexpr unsigned posts = 1000;
+  EventLoop loop { backend };
+  loop.accept_posts();
+
+  vector<vector<unsigned>> ran( producers );
+  unsigned wrong_thread = 0;
+  const auto loop_thread = this_thread::get_id();
+  vector<thread> threads;
+  for ( unsigned p = 0; p < producers; ++p ) {
+    threads.emplace_back( [&, p] {
+      for ( unsigned i = 0; i < posts; ++i ) {
+        loop.post( [&, p, i] {
+          ran[p].push_back( i );
+          wrong_thread += this_thread::get_id() != loop_thread;
+        } );
+      }
+    } );
+  }
+  for ( auto& producer : threads ) {
+    producer.join();
+  }
+
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Success, "the posts did not wake the loop" );
+  for ( const auto& in_order : ran ) {
+    expect( in_order.size() == posts, "ran " + to_string( in_order.size() ) + " of one thread's posts" );
+    expect( ranges::is_sorted( in_order ), "one thread's posts ran out of order" );
+  }
+  expect( wrong_thread == 0, "a task ran on the thread that posted it" );
+  expect( wakeups( loop ) == 1, to_string( wakeups( loop ) ) + " wakeups for one burst" );
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, "the loop woke with nothing posted" );
+}
+
+// Threads post while the loop waits and runs their tasks; a task may post another, and capture what can't be
+// copied
+void concurrent_test( const EventLoop::Backend backend )
+{
+  constexpr unsigned producers = 3;
+  constexpr unsigned posts = 20'000;
+  EventLoop loop { backend };
+  loop.accept_posts();
+
+  vector<unsigned> next( producers );
+  unsigned out_of_order = 0;
+  unsigned reposted = 0;
+  vector<thread> threads;
+  for ( unsigned p = 0; p < producers; ++p ) {
+    threads.emplace_back( [&, p] {
+      for ( unsigned i = 0; i < posts; ++i ) {
+        loop.post( [&, p, i, owned = make_unique<unsigned>( i )] {
+          out_of_order += next[p]++ != *owned;
+          if ( i + 1 == posts ) {
+            loop.post( [&] { ++reposted; } );
+          }
+        } );
+      }
+    } );
+  }
+
+  for ( unsigned calls = 0; reposted < producers and calls < 1'000'000; ++calls ) {
+    loop.wait_next_event( 1000 );
+  }
+  for ( auto& producer : threads ) {
+    producer.join();
+  }
+
+  expect( reposted == producers, "the tasks posted by tasks did not all run" );
+  expect( ranges::all_of( next, []( unsigned n ) { return n == posts; } ), "not every post ran" );
+  expect( out_of_order == 0, to_string( out_of_order ) + " posts ran out of order" );
+  expect( wakeups( loop ) <= producers * posts, "more wakeups than posts" );
+}
+
+// A task that throws stops that call, and the tasks after it run on the next
+void throw_test()
+{
+  EventLoop loop;
+  loop.accept_posts();
+  bool after = false;
+  loop.post( [] { throw runtime_error( "from a task" ); } );
+  loop.post( [&] { after = true; } );
+
+  bool threw = false;
+  try {
+    loop.wait_next_event( 0 );
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  expect( threw, "the task's exception was not passed on" );
+  expect( not after, "a task ran after one that threw, in the same call" );
+  loop.wait_next_event( 0 );
+  expect( after, "the task after one that threw never ran" );
+}
+
+// Posting needs accept_posts(), which keeps the loop from exiting
+void accept_test()
+{
+  EventLoop loop;
+  bool threw = false;
+  try {
+    loop.post( [] {} );
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  expect( threw, "post() to a loop that doesn't accept posts did not throw" );
+
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Exit, "an empty loop did not exit" );
+  loop.accept_posts();
+  loop.accept_posts();
+  expect( loop.rule_count() == 1, "accept_posts() twice added two rules" );
+  expect( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, "a loop that accepts posts exited" );
+}
+
+int main()
+{
+  try {
+    for ( const auto backend :
+          { EventLoop::Backend::Poll, EventLoop::Backend::Epoll, EventLoop::Backend::IoUring } ) {
+      burst_test( backend );
+      concurrent_test( backend );
+    }
+    throw_test();
+    accept_test();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
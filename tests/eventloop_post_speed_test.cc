@@ -0,0 +1,128 @@
+#include "eventfd.hh"
+#include "eventloop.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+struct Run
+{
+  double tasks_per_second;
+  double tasks_per_wakeup;
+};
+
+// `producers` threads each post `posts` tasks to a loop on this thread, which runs them all
+Run post_run( const size_t producers, const size_t posts )
+{
+  EventLoop loop { EventLoop::Backend::Epoll };
+  loop.accept_posts();
+
+  size_t ran = 0;
+  vector<thread> threads;
+  const auto start = steady_clock::now();
+  for ( size_t p = 0; p < producers; ++p ) {
+    threads.emplace_back( [&] {
+      for ( size_t i = 0; i < posts; ++i ) {
+        loop.post( [&ran] { ++ran; } );
+      }
+    } );
+  }
+  while ( ran < producers * posts ) {
+    loop.wait_next_event( 1000 );
+  }
+  const auto elapsed = steady_clock::now() - start;
+  for ( auto& producer : threads ) {
+    producer.join();
+  }
+
+  const auto profile = loop.profile();
+  const auto wakeups = ranges::find( profile.categories, "posted tasks", &EventLoop::CategoryProfile::name );
+  return { static_cast<double>( ran ) / duration<double>( elapsed ).count(),
+           static_cast<double>( ran ) / static_cast<double>( max( wakeups->invocations, uint64_t { 1 } ) ) };
+}
+
+// The same, through what a loop had to use before post(): a vector under a mutex, and an EventFD signalled
+// (under the mutex too, as EventFD::signal() isn't thread-safe) with every task
+Run locked_run( const size_t producers, const size_t posts )
+{
+  EventLoop loop { EventLoop::Backend::Epoll };
+  EventFD wakeup;
+  mutex inbox_mutex;
+  vector<function<void()>> inbox;
+  size_t ran = 0;
+  size_t wakeups = 0;
+  loop.add_rule( "locked inbox", wakeup, Direction::In, [&] {
+    wakeup.clear();
+    ++wakeups;
+    vector<function<void()>> tasks;
+    {
+      const lock_guard lock { inbox_mutex };
+      tasks.swap( inbox );
+    }
+    for ( const auto& task : tasks ) {
+      task();
+    }
+  } );
+
+  vector<thread> threads;
+  const auto start = steady_clock::now();
+  for ( size_t p = 0; p < producers; ++p ) {
+    threads.emplace_back( [&] {
+      for ( size_t i = 0; i < posts; ++i ) {
+        const lock_guard lock { inbox_mutex };
+        inbox.emplace_back( [&ran] { ++ran; } );
+        wakeup.signal();
+      }
+    } );
+  }
+  while ( ran < producers * posts ) {
+    loop.wait_next_event( 1000 );
+  }
+  const auto elapsed = steady_clock::now() - start;
+  for ( auto& producer : threads ) {
+    producer.join();
+  }
+
+  return { static_cast<double>( ran ) / duration<double>( elapsed ).count(),
+           static_cast<double>( ran ) / static_cast<double>( max( wakeups, size_t { 1 } ) ) };
+}
+
+void program_body( const size_t posts )
+{
+  cout << posts << " tasks posted by each producer:\n";
+  for ( const size_t producers : { 1, 2, 4, 8 } ) {
+    const Run posted = post_run( producers, posts );
+    const Run locked = locked_run( producers, posts );
+    cout << fixed << setprecision( 1 ) << "  " << producers << " producer(s): post() " << setw( 6 )
+         << posted.tasks_per_second / 1e6 << " M tasks/s, " << setw( 8 ) << posted.tasks_per_wakeup
+         << " tasks per wakeup; locked inbox " << setw( 6 ) << locked.tasks_per_second / 1e6 << " M tasks/s, "
+         << setw( 8 ) << locked.tasks_per_wakeup << " tasks per wakeup\n";
+  }
+}
+
+// Usage: eventloop_post_speed_test [posts]   (default 200,000 for each producer)
+int main( int argc, char** argv )
+{
+  try {
+    auto args = span( argv, argc );
+    program_body( args.size() > 1 ? stoull( args[1] ) : 200'000 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+#include "common.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+const EventLoop::CategoryProfile& category( const EventLoop::Profile& profile, const string& name )
+{
+  const auto it = ranges::find( profile.categories, name, &EventLoop::CategoryProfile::name );
+  expect( it != profile.categories.end(), "no category \"" + name + "\"" );
+  return *it;
+}
+
+// Invocations and interest() calls are counted exactly, timers included, and a slow callback is caught
+void counters_test()
+{
+  EventLoop loop;
+  const size_t counted = loop.add_category( "counted" );
+  const size_t sleeps = loop.add_category( "sleeps" );
+  const size_t timer = loop.add_category( "timer" );
+  loop.set_watchdog( milliseconds { 2 } );
+
+  unsigned count = 0;
+  loop.add_rule( counted, [&] { ++count; }, [&] { return count < 3; } );
+  bool slept = false;
+  loop.add_rule(
+    sleeps,
+    [&] {
+      this_thread::sleep_for( milliseconds { 10 } );
+      slept = true;
+    },
+    [&] { return not slept; } );
+  loop.add_timer( timer, milliseconds::zero(), [] {} );
+  this_thread::sleep_for( milliseconds { 2 } ); // so the timer is due from the first call on
+
+  while ( loop.wait_next_event( 100 ) != EventLoop::Result::Exit ) {}
+
+  const auto profile = loop.profile();
+  expect( category( profile, "counted" ).invocations == 3, "three callbacks, but not three counted" );
+  // the first call fires the timer and asks until the rule says no (4 times); the sleeper's call and the last
+  // call once each
+  expect( category( profile, "counted" ).interest_evaluations == 6,
+          "counted " + to_string( category( profile, "counted" ).interest_evaluations ) + " interest() calls" );
+  expect( category( profile, "timer" ).invocations == 1, "the timer's callback was not counted" );
+
+  const auto& sleeper = category( profile, "sleeps" );
+  expect( sleeper.invocations == 1 and sleeper.slow == 1, "the watchdog missed a slow callback" );
+  expect( sleeper.max_time >= milliseconds { 10 } and sleeper.total_time >= sleeper.max_time,
+          "the slow callback's time was not counted" );
+  expect( category( profile, "counted" ).slow == 0, "the watchdog flagged a fast callback" );
+  expect( profile.dispatch_time >= milliseconds { 10 }, "the time in callbacks is not dispatch time" );
+
+  ostringstream dump;
+  loop.dump_profile( dump );
+  expect( dump.str().find( "sleeps" ) < dump.str().find( "counted" ), "the dump does not start with the slowest" );
+
+  loop.reset_profile();
+  expect( loop.profile().calls == 0 and category( loop.profile(), "sleeps" ).invocations == 0,
+          "reset_profile() left counts" );
+}
+
+// Waiting on an idle fd is wait time, not dispatch time
+void wait_time_test( const EventLoop::Backend backend )
+{
+  EventLoop loop { backend };
+  array<int, 2> ends {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, ends.data() ) );
+  FileDescriptor here { ends[0] };
+  FileDescriptor there { ends[1] };
+  loop.add_rule( "idle", here, Direction::In, [] {} );
+
+  expect( loop.wait_next_event( 30 ) == EventLoop::Result::Timeout, "an idle fd was ready" );
+  const auto profile = loop.profile();
+  expect( profile.calls == 1, "the call was not counted" );
+  expect( profile.wait_time >= milliseconds { 25 }, "the wait was not counted" );
+  expect( profile.dispatch_time < profile.wait_time, "waiting was counted as dispatch" );
+}
+
+// Two rules on one ready fd, one served per call: each call the second is starved
+void starved_test( const EventLoop::Backend backend )
+{
+  EventLoop loop { backend };
+  array<int, 2> ends {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, ends.data() ) );
+  FileDescriptor here { ends[0] };
+  FileDescriptor there { ends[1] };
+  there.write( string( 16, 'x' ) );
+
+  array<char, 1> byte {};
+  loop.add_rule( "first", here, Direction::In, [&] { here.read( byte ); } );
+  loop.add_rule( "second", here, Direction::In, [&] { here.read( byte ); } );
+  for ( unsigned i = 0; i < 4; ++i ) {
+    loop.wait_next_event( 0 );
+  }
+
+  const auto profile = loop.profile();
+  expect( category( profile, "first" ).invocations == 4, "the first rule was not served every call" );
+  expect( category( profile, "second" ).invocations == 0, "the second rule was served" );
+  expect( category( profile, "second" ).starved == 4,
+          "the second rule was starved " + to_string( category( profile, "second" ).starved ) + " times, not 4" );
+  expect( category( profile, "first" ).starved == 0, "the first rule was counted as starved" );
+}
+
+int main()
+{
+  try {
+    counters_test();
+    for ( const auto backend : { EventLoop::Backend::Poll, EventLoop::Backend::Epoll } ) {
+      wait_time_test( backend );
+      starved_test( backend );
+    }
+    wait_time_test( EventLoop::Backend::IoUring );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
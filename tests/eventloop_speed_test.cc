@@ -0,0 +1,220 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "socket.hh"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+struct Cost
+{
+  double total_ns;  // wall-clock time per event
+  double kernel_ns; // system time per event
+};
+
+// CPU time this process has spent in the kernel, in nanoseconds
+double kernel_nanoseconds()
+{
+  rusage usage {};
+  CheckSystemCall( "getrusage", getrusage( RUSAGE_SELF, &usage ) );
+  return static_cast<double>( usage.ru_stime.tv_sec ) * 1e9 + static_cast<double>( usage.ru_stime.tv_usec ) * 1e3;
+}
+
+// Cost per event with one busy fd among `idle` fds that never become ready. With poll(2) every call hands the
+// kernel the whole fd set; with epoll the kernel only reports the busy one. Both backends still ask every
+// rule's interest() on each call, so the user-space part of the cost grows with the rule count either way.
+Cost cost_per_event( const EventLoop::Backend backend, const size_t idle, const size_t events )
+{
+  EventLoop loop { backend };
+
+  // Unconnected UDP sockets: registered for reading, never readable
+  const size_t idle_category = loop.add_category( "idle" );
+  vector<UDPSocket> idle_sockets( idle );
+  for ( auto& socket : idle_sockets ) {
+    loop.add_rule(
+      idle_category, socket, Direction::In, [] { throw runtime_error( "idle socket became readable" ); } );
+  }
+
+  // The busy fd: a byte circulating through a socket pair, read from one end and written back into the other
+  array<int, 2> ends {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, ends.data() ) );
+  FileDescriptor here { ends[0] };
+  FileDescriptor there { ends[1] };
+
+  size_t served = 0;
+  array<char, 1> byte {};
+  loop.add_rule( "busy", here, Direction::In, [&] {
+    here.read( byte );
+    there.write( string_view { byte.data(), byte.size() } );
+    ++served;
+  } );
+  there.write( "x" );
+
+  const double kernel_before = kernel_nanoseconds();
+  const auto start_time = steady_clock::now();
+  while ( served < events ) {
+    if ( loop.wait_next_event( 1000 ) != EventLoop::Result::Success ) {
+      throw runtime_error( "busy socket pair stalled" );
+    }
+  }
+  const auto stop_time = steady_clock::now();
+  const double kernel_after = kernel_nanoseconds();
+
+  const auto total = static_cast<double>( duration_cast<nanoseconds>( stop_time - start_time ).count() );
+  return { .total_ns = total / static_cast<double>( events ),
+           .kernel_ns = ( kernel_after - kernel_before ) / static_cast<double>( events ) };
+}
+
+struct Load
+{
+  double ns_per_event;    // wall-clock time per callback
+  double calls_per_event; // wait_next_event calls per callback
+  size_t worst_gap;       // most callbacks between two turns of the same rule (0: some rule never got one)
+};
+
+// `busy` socket pairs that are always ready: each rule reads the byte waiting on its fd and writes it back from
+// the other end. Dispatch::One serves whichever comes first every time; Dispatch::AllReady takes turns.
+Load under_load( const EventLoop::Backend backend,
+                 const EventLoop::Dispatch dispatch,
+                 const size_t budget,
+                 const size_t busy,
+                 const size_t events )
+{
+  EventLoop loop { backend };
+  loop.set_dispatch( dispatch, budget );
+  const size_t category = loop.add_category( "busy" );
+
+  vector<FileDescriptor> ends;
+  vector<size_t> last_turn( busy );
+  size_t served = 0;
+  size_t worst_gap = 0;
+  array<char, 1> byte {};
+  ends.reserve( 2 * busy );
+  for ( size_t i = 0; i < busy; ++i ) {
+    array<int, 2> pair {};
+    CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair.data() ) );
+    ends.emplace_back( pair[0] );
+    ends.emplace_back( pair[1] );
+    ends.back().write( "x" );
+    loop.add_rule( category, ends[2 * i], Direction::In, [&, i] {
+      ends[2 * i].read( byte );
+      ends[2 * i + 1].write( string_view { byte.data(), byte.size() } );
+      worst_gap = max( worst_gap, ++served - last_turn[i] );
+      last_turn[i] = served;
+    } );
+  }
+
+  size_t calls = 0;
+  const auto start_time = steady_clock::now();
+  while ( served < events ) {
+    loop.wait_next_event( 1000 );
+    ++calls;
+  }
+  const auto stop_time = steady_clock::now();
+
+  const bool starved = ranges::any_of( last_turn, []( size_t turn ) { return turn == 0; } );
+  const auto total = static_cast<double>( duration_cast<nanoseconds>( stop_time - start_time ).count() );
+  return { .ns_per_event = total / static_cast<double>( served ),
+           .calls_per_event = static_cast<double>( calls ) / static_cast<double>( served ),
+           .worst_gap = starved ? 0 : worst_gap };
+}
+
+struct Options
+{
+  size_t max_idle = 1000; // the largest count of idle fds; the sweep goes up by tens from 10
+  size_t events = 100000; // events timed with 10 idle fds (fewer with more), half as many per dispatch mode
+};
+
+Options parse_options( span<char*> args )
+{
+  Options options;
+  for ( size_t i = 1; i + 1 < args.size(); i += 2 ) {
+    const string_view flag = args[i];
+    const string value = args[i + 1];
+    if ( flag == "--max-idle" ) {
+      options.max_idle = stoull( value );
+    } else if ( flag == "--events" ) {
+      options.events = stoull( value );
+    } else {
+      throw runtime_error( "unknown option " + string { flag } );
+    }
+  }
+  return options;
+}
+
+void program_body( const Options& options )
+{
+  cout << "                        ns/event           kernel ns/event\n";
+  cout << "   idle fds          poll        epoll        poll        epoll\n";
+  for ( size_t idle = 10; idle <= options.max_idle; idle *= 10 ) {
+    // Fewer events at large fd counts, so the poll side stays quick; epoll keeps enough events for the
+    // (coarse) system time to be measurable
+    const size_t events = options.events * 10 / idle;
+    const auto poll = cost_per_event( EventLoop::Backend::Poll, idle, max( events, size_t { 200 } ) );
+    const auto epoll = cost_per_event( EventLoop::Backend::Epoll, idle, max( events, size_t { 5000 } ) );
+    cout << setw( 11 ) << idle << fixed << setprecision( 0 ) << setw( 14 ) << poll.total_ns << setw( 13 )
+         << epoll.total_ns << setw( 12 ) << poll.kernel_ns << setw( 13 ) << epoll.kernel_ns << "\n";
+
+    if ( epoll.kernel_ns > poll.kernel_ns * 2 and idle >= 1000 ) {
+      throw runtime_error( "epoll backend spent more time in the kernel than poll" );
+    }
+  }
+
+  struct Mode
+  {
+    string_view name;
+    EventLoop::Dispatch dispatch;
+    size_t budget;
+  };
+  const array modes { Mode { "one", EventLoop::Dispatch::One, 0 },
+                      Mode { "all ready", EventLoop::Dispatch::AllReady, 0 },
+                      Mode { "budget 16", EventLoop::Dispatch::AllReady, 16 } };
+
+  cout << "\n100 always-ready fds     ns/event  calls/event  worst gap (events)\n";
+  for ( const auto backend : { EventLoop::Backend::Poll, EventLoop::Backend::Epoll } ) {
+    for ( const auto& [name, dispatch, budget] : modes ) {
+      const auto load = under_load( backend, dispatch, budget, 100, options.events / 2 );
+      cout << setw( 6 ) << ( backend == EventLoop::Backend::Poll ? "poll" : "epoll" ) << setw( 11 ) << name
+           << fixed << setprecision( 0 ) << setw( 12 ) << load.ns_per_event << setprecision( 3 ) << setw( 13 )
+           << load.calls_per_event << setw( 20 );
+      if ( load.worst_gap ) {
+        cout << load.worst_gap << "\n";
+      } else {
+        cout << "starved" << "\n";
+      }
+
+      if ( dispatch == EventLoop::Dispatch::AllReady and load.worst_gap == 0 ) {
+        throw runtime_error( "a rule starved with Dispatch::AllReady" );
+      }
+    }
+  }
+}
+
+// Usage: eventloop_speed_test [--max-idle N] [--events N]
+// The default sweep stops at 1000 idle fds; --max-idle 10000 (which needs a file descriptor limit above that)
+// adds the row where poll's cost per event reaches milliseconds.
+int main( int argc, char** argv )
+{
+  try {
+    program_body( parse_options( span( argv, argc ) ) );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
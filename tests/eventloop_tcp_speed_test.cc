@@ -0,0 +1,126 @@
+#include "address.hh"
+#include "eventloop.hh"
+#include "socket.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+struct Throughput
+{
+  double gbps;                // payload bits per second, in billions
+  double calls_per_mb;        // wait_next_event calls per megabyte moved
+  EventLoop::Backend backend; // the backend actually used (io_uring may fall back)
+};
+
+// Move `per_connection` bytes over each of `connections` loopback TCP connections, one loop driving both ends
+// with read and write rules. The poll and epoll backends make a read or write syscall for each one; with
+// io_uring the kernel does them, and a wait_next_event call can pick up many completions.
+Throughput loopback( const EventLoop::Backend backend, const size_t connections, const size_t per_connection )
+{
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  listener.bind( Address { "127.0.0.1" } );
+  listener.listen( static_cast<int>( connections ) );
+
+  vector<TCPSocket> senders( connections );
+  vector<TCPSocket> receivers;
+  for ( auto& sender : senders ) {
+    sender.connect( listener.local_address() );
+    receivers.push_back( listener.accept() );
+    sender.set_blocking( false );
+    receivers.back().set_blocking( false );
+  }
+
+  EventLoop loop { backend };
+  const size_t send_category = loop.add_category( "send" );
+  const size_t receive_category = loop.add_category( "receive" );
+  const string chunk( 65536, 'x' );
+  vector<size_t> sent( connections );
+  vector<size_t> received( connections );
+
+  for ( size_t i = 0; i < connections; ++i ) {
+    loop.add_write_rule(
+      send_category,
+      senders[i],
+      [&, i] { return string_view { chunk }.substr( 0, per_connection - sent[i] ); },
+      [&, i]( size_t len ) {
+        sent[i] += len;
+        if ( sent[i] == per_connection ) {
+          senders[i].shutdown( SHUT_WR );
+        }
+      } );
+    loop.add_read_rule(
+      receive_category, receivers[i], [] { return 65536; }, [&, i]( string_view bytes ) {
+        received[i] += bytes.size();
+      } );
+  }
+
+  size_t calls = 0;
+  const auto start_time = steady_clock::now();
+  while ( loop.wait_next_event( 1000 ) != EventLoop::Result::Exit ) {
+    ++calls;
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( ranges::any_of( received, [&]( size_t len ) { return len != per_connection; } ) ) {
+    throw runtime_error( "a connection did not deliver all of its bytes" );
+  }
+
+  const double total = static_cast<double>( connections * per_connection );
+  const double seconds = duration_cast<duration<double>>( stop_time - start_time ).count();
+  return { 8 * total / seconds / 1e9, static_cast<double>( calls ) / ( total / 1e6 ), loop.backend() };
+}
+
+string_view backend_name( const EventLoop::Backend backend )
+{
+  switch ( backend ) {
+    case EventLoop::Backend::Poll:
+      return "poll";
+    case EventLoop::Backend::Epoll:
+      return "epoll";
+    case EventLoop::Backend::IoUring:
+      return "io_uring";
+  }
+  return "unknown";
+}
+
+void program_body( const size_t total )
+{
+  for ( const size_t connections : { 1, 16 } ) {
+    for ( const auto backend :
+          { EventLoop::Backend::Poll, EventLoop::Backend::Epoll, EventLoop::Backend::IoUring } ) {
+      const auto result = loopback( backend, connections, total / connections );
+      cout << setw( 3 ) << connections << " connection(s), " << setw( 8 ) << backend_name( backend );
+      if ( result.backend != backend ) {
+        cout << " (fell back to " << backend_name( result.backend ) << ")";
+      }
+      cout << fixed << setprecision( 2 ) << ": " << setw( 6 ) << result.gbps << " Gbit/s, " << setw( 6 )
+           << result.calls_per_mb << " wait_next_event calls/MB\n";
+    }
+  }
+}
+
+// Usage: eventloop_tcp_speed_test [total_bytes]   (default 1 GiB, split across the connections)
+int main( int argc, char** argv )
+{
+  try {
+    auto args = span( argv, argc );
+    program_body( args.size() > 1 ? stoull( args[1] ) : size_t { 1 } << 30U );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
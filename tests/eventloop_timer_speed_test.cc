@@ -0,0 +1,163 @@
+#include "timer_wheel.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// Nanoseconds per operation for each phase of a timer workload
+struct Cost
+{
+  double add;    // arm a timer
+  double rearm;  // cancel a timer and arm it again further out, as a retransmission or idle timeout does
+  double cancel; // cancel a timer
+  double fire;   // advance the clock past a timer's deadline and run it
+};
+
+// The same operations on an ordered map keyed by deadline, for comparison: O(log n) each
+class MapTimers
+{
+  multimap<uint64_t, function<void()>> timers_ {};
+
+public:
+  using TimerId = multimap<uint64_t, function<void()>>::iterator;
+
+  TimerId add( uint64_t deadline, uint64_t /* period */, function<void()> callback )
+  {
+    return timers_.emplace( deadline, move( callback ) );
+  }
+
+  void cancel( TimerId id ) { timers_.erase( id ); }
+
+  size_t advance( uint64_t now )
+  {
+    size_t fired = 0;
+    while ( not timers_.empty() and timers_.begin()->first <= now ) {
+      auto callback = move( timers_.begin()->second );
+      timers_.erase( timers_.begin() );
+      callback();
+      ++fired;
+    }
+    return fired;
+  }
+
+  bool empty() const { return timers_.empty(); }
+};
+
+template<typename Timers>
+Cost measure( const size_t count, const uint64_t horizon_ms )
+{
+  default_random_engine rd { count };
+  uniform_int_distribution<uint64_t> deadline { 1, horizon_ms };
+  Timers timers;
+  size_t fired = 0;
+  const auto callback = [&fired] { ++fired; };
+  const auto per_op = []( auto elapsed, size_t ops ) {
+    return static_cast<double>( duration_cast<nanoseconds>( elapsed ).count() ) / static_cast<double>( ops );
+  };
+
+  vector<typename Timers::TimerId> ids;
+  ids.reserve( count );
+  auto start = steady_clock::now();
+  for ( size_t i = 0; i < count; ++i ) {
+    ids.push_back( timers.add( deadline( rd ), 0, callback ) );
+  }
+  Cost cost {};
+  cost.add = per_op( steady_clock::now() - start, count );
+
+  start = steady_clock::now();
+  for ( auto& id : ids ) {
+    timers.cancel( id );
+    id = timers.add( deadline( rd ), 0, callback );
+  }
+  cost.rearm = per_op( steady_clock::now() - start, count );
+
+  start = steady_clock::now();
+  for ( size_t i = 0; i < count; i += 2 ) {
+    timers.cancel( ids[i] );
+  }
+  cost.cancel = per_op( steady_clock::now() - start, ( count + 1 ) / 2 );
+
+  // the clock moves a millisecond at a time, as it would under EventLoop
+  start = steady_clock::now();
+  for ( uint64_t now = 1; now <= horizon_ms; ++now ) {
+    timers.advance( now );
+  }
+  cost.fire = per_op( steady_clock::now() - start, count / 2 );
+
+  if ( fired != count / 2 or not timers.empty() ) {
+    throw runtime_error( "fired " + to_string( fired ) + " timers, expected " + to_string( count / 2 ) );
+  }
+  return cost;
+}
+
+void print( const string& name, const Cost& cost )
+{
+  cout << fixed << setprecision( 1 ) << "  " << setw( 12 ) << name << ": " << setw( 6 ) << cost.add
+       << " ns/add, " << setw( 6 ) << cost.rearm << " ns/rearm, " << setw( 6 ) << cost.cancel << " ns/cancel, "
+       << setw( 6 ) << cost.fire << " ns/fire\n";
+}
+
+struct Options
+{
+  size_t max_timers = 400'000;   // the largest count of pending timers; the sweep goes up by fours from 100,000
+  size_t max_multimap = 100'000; // the largest count also run on the multimap, which is much slower
+};
+
+Options parse_options( span<char*> args )
+{
+  Options options;
+  for ( size_t i = 1; i + 1 < args.size(); i += 2 ) {
+    const string_view flag = args[i];
+    const string value = args[i + 1];
+    if ( flag == "--max-timers" ) {
+      options.max_timers = stoull( value );
+    } else if ( flag == "--max-multimap" ) {
+      options.max_multimap = stoull( value );
+    } else {
+      throw runtime_error( "unknown option " + string { flag } );
+    }
+  }
+  return options;
+}
+
+void program_body( const Options& options )
+{
+  // deadlines spread over ten minutes of milliseconds, so every level of the wheel is in use
+  constexpr uint64_t horizon_ms = 600'000;
+  for ( size_t count = 100'000; count <= options.max_timers; count *= 4 ) {
+    cout << count << " pending timers:\n";
+    print( "timer wheel", measure<TimerWheel>( count, horizon_ms ) );
+    if ( count <= options.max_multimap ) {
+      print( "multimap", measure<MapTimers>( count, horizon_ms ) );
+    }
+  }
+}
+
+// Usage: eventloop_timer_speed_test [--max-timers N] [--max-multimap N]
+// The default run stays within the speed-test time limit; --max-timers 6400000 --max-multimap 400000 is the
+// million-scale comparison.
+int main( int argc, char** argv )
+{
+  try {
+    program_body( parse_options( span( argv, argc ) ) );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,224 @@
+#include "common.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+#include "timer_wheel.hh"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// Timers from 1 tick to well past the top level's reach, some cancelled, with time moving in steps of every
+// size: each must fire exactly once, in the first advance() that reaches its deadline, in deadline order
+void wheel_test()
+{
+  default_random_engine rd { 19 };
+  TimerWheel wheel;
+  uint64_t previous = 0;
+  uint64_t target = 0;
+  uint64_t last_fired = 0;
+
+  struct Pending
+  {
+    uint64_t deadline {};
+    bool cancelled {};
+    unsigned fired {};
+    TimerWheel::TimerId id {};
+  };
+  vector<Pending> timers( 20000 );
+
+  for ( size_t i = 0; i < timers.size(); ++i ) {
+    const auto bits = uniform_int_distribution<unsigned> { 0, 34 }( rd );
+    const uint64_t deadline = uniform_int_distribution<uint64_t> { 1, uint64_t { 1 } << bits }( rd );
+    timers[i] = { deadline, false, 0, {} };
+    timers[i].id = wheel.add( deadline, 0, [&, i] {
+      expect( timers[i].deadline > previous and timers[i].deadline <= target, "a timer fired at the wrong time" );
+      expect( timers[i].deadline >= last_fired, "timers fired out of order" );
+      last_fired = timers[i].deadline;
+      ++timers[i].fired;
+    } );
+  }
+  for ( size_t i = 0; i < timers.size(); i += 3 ) {
+    wheel.cancel( timers[i].id );
+    timers[i].cancelled = true;
+  }
+
+  // steps from one tick to a few days
+  while ( not wheel.empty() ) {
+    const auto bits = uniform_int_distribution<unsigned> { 0, 28 }( rd );
+    target = previous + uniform_int_distribution<uint64_t> { 1, uint64_t { 1 } << bits }( rd );
+    wheel.advance( target );
+    previous = target;
+  }
+
+  for ( const auto& timer : timers ) {
+    expect( timer.fired == ( timer.cancelled ? 0 : 1 ), "a timer fired " + to_string( timer.fired ) + " times" );
+  }
+}
+
+void periodic_test()
+{
+  TimerWheel wheel;
+  vector<uint64_t> fired_at;
+  uint64_t now = 0;
+  const auto id = wheel.add( 3, 7, [&] { fired_at.push_back( now ); } );
+  for ( now = 1; now <= 30; ++now ) {
+    wheel.advance( now );
+  }
+  expect( fired_at == vector<uint64_t> { 3, 10, 17, 24 }, "a periodic timer fired at the wrong ticks" );
+
+  // falling far behind: one firing, not one per missed period, then back on the original schedule
+  now = 1000;
+  expect( wheel.advance( now ) == 1, "a periodic timer that fell behind fired more than once" );
+  expect( wheel.next_event() <= 1004, "a periodic timer lost its schedule" );
+  now = 1004;
+  wheel.advance( now );
+  expect( fired_at.back() == 1004, "a periodic timer did not resume its schedule" );
+
+  wheel.cancel( id );
+  expect( wheel.empty(), "cancelling a periodic timer left it pending" );
+
+  // a periodic timer can cancel itself, and a stale id can't cancel the timer that reuses its place
+  TimerWheel::TimerId self {};
+  unsigned count = 0;
+  self = wheel.add( 2000, 1, [&] {
+    if ( ++count == 3 ) {
+      wheel.cancel( self );
+    }
+  } );
+  wheel.advance( 2100 );
+  expect( count == 1, "a periodic timer did not skip the periods it missed" );
+  for ( now = 2101; now < 2110; ++now ) {
+    wheel.advance( now );
+  }
+  expect( count == 3 and wheel.empty(), "a periodic timer did not cancel itself" );
+
+  bool reused_fired = false;
+  wheel.add( 2200, 0, [&] { reused_fired = true; } );
+  wheel.cancel( self );
+  wheel.advance( 2200 );
+  expect( reused_fired, "a stale id cancelled another timer" );
+
+  // callbacks may add timers, including ones already due
+  unsigned chained = 0;
+  function<void()> chain = [&] {
+    if ( ++chained < 5 ) {
+      wheel.add( 0, 0, chain );
+    }
+  };
+  wheel.add( 2300, 0, chain );
+  wheel.advance( 2300 );
+  expect( chained == 1, "a timer added by a callback fired in the same tick" );
+  for ( now = 2301; now < 2310; ++now ) {
+    wheel.advance( now );
+  }
+  expect( chained == 5, "timers added by callbacks did not fire" );
+}
+
+void eventloop_test( const EventLoop::Backend backend )
+{
+  optional<EventLoop::RuleHandle> stale;
+  {
+    EventLoop loop { backend };
+    const size_t category = loop.add_category( "timer" );
+
+    // wait_next_event sleeps until the timers are due, and exits once they are all done
+    const auto start = steady_clock::now();
+    unsigned ticks = 0;
+    bool one_shot = false;
+    auto periodic = make_shared<optional<EventLoop::RuleHandle>>();
+    *periodic = loop.add_timer(
+      category,
+      10ms,
+      [&, periodic] {
+        if ( ++ticks == 3 ) {
+          ( *periodic )->cancel();
+        }
+      },
+      10ms );
+    loop.add_timer( category, 25ms, [&] { one_shot = true; } );
+    auto cancelled = loop.add_timer( category, 5ms, [] { throw runtime_error( "a cancelled timer fired" ); } );
+    cancelled.cancel();
+
+    while ( loop.wait_next_event( -1 ) != EventLoop::Result::Exit ) {}
+    const auto elapsed = steady_clock::now() - start;
+    expect( ticks == 3 and one_shot, "timers did not all fire" );
+    expect( elapsed >= 30ms and elapsed < 1s, "the loop did not wait for the timers" );
+    periodic->reset();
+
+    // a timeout shorter than the next timer still times out
+    bool late = false;
+    stale = loop.add_timer( category, 200ms, [&] { late = true; } );
+    expect( loop.wait_next_event( 20 ) == EventLoop::Result::Timeout, "wait_next_event did not time out" );
+    expect( not late, "a timer fired early" );
+  }
+  stale->cancel(); // the loop is gone: nothing to do
+}
+
+// A periodic timer that is due again on every call (its callback outlasts its period) must not starve a ready
+// fd rule, even with Dispatch::One
+void always_due_test( const EventLoop::Backend backend )
+{
+  EventLoop loop { backend };
+  const size_t category = loop.add_category( "always due" );
+
+  unsigned ticks = 0;
+  loop.add_timer(
+    category,
+    1ms,
+    [&] {
+      ++ticks;
+      this_thread::sleep_for( 2ms );
+    },
+    1ms );
+
+  array<int, 2> pair {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair.data() ) );
+  FileDescriptor here { pair[0] };
+  FileDescriptor there { pair[1] };
+  there.write( "x" );
+  bool served = false;
+  loop.add_rule( category, here, Direction::In, [&] {
+    string bytes;
+    here.read( bytes );
+    served = true;
+  } );
+
+  this_thread::sleep_for( 2ms ); // so the timer is due from the first call on
+  for ( unsigned i = 0; i < 10 and not served; ++i ) {
+    loop.wait_next_event( 100 );
+  }
+  expect( ticks > 0, "the periodic timer never fired" );
+  expect( served, "a timer that was always due starved a ready fd rule" );
+}
+
+int main()
+{
+  try {
+    wheel_test();
+    periodic_test();
+    for ( const auto backend :
+          { EventLoop::Backend::Poll, EventLoop::Backend::Epoll, EventLoop::Backend::IoUring } ) {
+      eventloop_test( backend );
+      always_due_test( backend );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
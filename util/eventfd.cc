@@ -0,0 +1,32 @@
+#include "eventfd.hh"
+#include "exception.hh"
+
+#include <cerrno>
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+EventFD::EventFD() : FileDescriptor( ::CheckSystemCall( "eventfd", eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) ) {}
+
+void EventFD::signal()
+{
+  signal_from_any_thread();
+  register_write();
+}
+
+void EventFD::signal_from_any_thread() const
+{
+  const uint64_t one = 1;
+  ::CheckSystemCall( "write", static_cast<int>( ::write( fd_num(), &one, sizeof( one ) ) ) );
+}
+
+bool EventFD::clear()
+{
+  uint64_t value = 0;
+  const ssize_t bytes_read = ::read( fd_num(), &value, sizeof( value ) );
+  if ( bytes_read < 0 and errno != EAGAIN ) {
+    throw unix_error { "read" };
+  }
+  register_read();
+  return bytes_read > 0 and value > 0;
+}
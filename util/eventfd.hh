@@ -0,0 +1,28 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+//! A FileDescriptor to an [eventfd(2)](\ref man2::eventfd) counter, used to make in-process
+//! conditions pollable: the fd is readable while the counter is nonzero.
+class EventFD : public FileDescriptor
+{
+public:
+  //! Create a non-blocking eventfd with its counter at zero.
+  EventFD();
+
+  //! Make the fd readable (add one to the counter).
+  void signal();
+
+  //! signal() without counting the write, so any thread may call it, even while another thread does (the count
+  //! EventLoop's busy-wait check reads is not thread-safe)
+  void signal_from_any_thread() const;
+
+  //! Reset the counter to zero, so the fd is no longer readable.
+  //! \returns `true` if the fd had been signalled
+  bool clear();
+
+  //! Count a unit of work done on behalf of this fd without touching the kernel counter
+  //! (e.g. bytes consumed from whatever the fd signals), so EventLoop's busy-wait check sees progress.
+  using FileDescriptor::register_read;
+  using FileDescriptor::register_write;
+};
@@ -2,37 +2,172 @@
 #include "exception.hh"
 #include "socket.hh"
 
+#include <algorithm>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <span>
 
 using namespace std;
+using namespace std::chrono;
+
+namespace {
+// Backend::IoUring: submission entries, registered buffers in each pool, and the size of every buffer
+constexpr unsigned kUringEntries = 256;
+constexpr unsigned kUringBuffers = 32;
+constexpr size_t kIOBufferSize = 65536;
+
+// An io_uring operation's user_data: what kind of operation it is, the registered buffer of a write, and the
+// rule's slot and generation -- all a completion needs, even once the rule is gone
+constexpr unsigned kTagBufferBits = 5;
+constexpr unsigned kTagIndexBits = 25;
+static_assert( kUringBuffers <= 1U << kTagBufferBits );
+
+uint64_t tag( SlotHandle rule, uint16_t buffer, uint8_t operation )
+{
+  if ( rule.index >= 1U << kTagIndexBits ) {
+    throw runtime_error( "EventLoop: too many fd rules for io_uring" );
+  }
+  return uint64_t { rule.generation } << 32U | uint64_t { rule.index } << ( 2U + kTagBufferBits )
+         | uint64_t { buffer } << 2U | operation;
+}
+
+SlotHandle tagged_rule( uint64_t user_data )
+{
+  return { static_cast<uint32_t>( user_data >> ( 2U + kTagBufferBits ) ) & ( ( 1U << kTagIndexBits ) - 1 ),
+           static_cast<uint32_t>( user_data >> 32U ) };
+}
+
+uint16_t tagged_buffer( uint64_t user_data )
+{
+  return static_cast<uint16_t>( user_data >> 2U ) & ( ( 1U << kTagBufferBits ) - 1 );
+}
+} // namespace
 
 unsigned int EventLoop::FDRule::service_count() const
 {
   return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
+// poll and epoll use the same bits for the events both know about, so results can share one handler
+static_assert( EPOLLIN == POLLIN and EPOLLOUT == POLLOUT and EPOLLERR == POLLERR and EPOLLHUP == POLLHUP );
+
+EventLoop::EventLoop( Backend backend ) : _backend( backend )
+{
+  _rule_categories.reserve( 64 );
+  if ( _backend == Backend::IoUring ) {
+    try {
+      _uring = make_unique<IOUring>( kUringEntries, kUringBuffers, kIOBufferSize );
+    } catch ( const exception& ) {
+      _backend = Backend::Epoll; // an old kernel, or io_uring turned off by policy
+    }
+  }
+  if ( _backend == Backend::Epoll ) {
+    _epoll.emplace( CheckSystemCall( "epoll_create1", epoll_create1( EPOLL_CLOEXEC ) ) );
+  }
+  _rules->track_changes = _backend != Backend::Poll;
+}
+
+void EventLoop::set_dispatch( Dispatch dispatch, size_t budget )
+{
+  _dispatch = dispatch;
+  _budget = budget;
+}
+
 size_t EventLoop::add_category( const string& name )
 {
   if ( _rule_categories.size() >= _rule_categories.capacity() ) {
     throw runtime_error( "maximum categories reached" );
   }
 
-  _rule_categories.push_back( { name } );
+  RuleCategory category;
+  category.name = name;
+  category.watchdog = _watchdog;
+  _rule_categories.push_back( move( category ) );
   return _rule_categories.size() - 1;
 }
 
-EventLoop::BasicRule::BasicRule( size_t s_category_id, InterestT s_interest, CallbackT s_callback )
+void EventLoop::set_watchdog( const nanoseconds budget )
+{
+  _watchdog = budget;
+  for ( auto& category : _rule_categories ) {
+    category.watchdog = budget;
+  }
+}
+
+EventLoop::Profile EventLoop::profile() const
+{
+  Profile profile { _calls, _wait_time, _dispatch_time, {} };
+  profile.categories.assign( _rule_categories.begin(), _rule_categories.end() );
+  return profile;
+}
+
+void EventLoop::reset_profile()
+{
+  _calls = 0;
+  _wait_time = _dispatch_time = {};
+  for ( auto& category : _rule_categories ) {
+    static_cast<CategoryProfile&>( category ) = { category.name };
+  }
+}
+
+void EventLoop::dump_profile( ostream& out ) const
+{
+  const auto ms = []( nanoseconds time ) { return duration<double, milli>( time ).count(); };
+  Profile snapshot = profile();
+  ranges::stable_sort( snapshot.categories, greater {}, &CategoryProfile::total_time );
+
+  const auto flags = out.flags();
+  out << fixed << setprecision( 3 ) << "EventLoop: " << snapshot.calls << " calls, " << ms( snapshot.wait_time )
+      << " ms waiting, " << ms( snapshot.dispatch_time ) << " ms dispatching\n";
+  out << "  " << left << setw( 40 ) << "category" << right << setw( 12 ) << "callbacks" << setw( 12 ) << "total ms"
+      << setw( 10 ) << "max ms" << setw( 12 ) << "interest" << setw( 10 ) << "starved" << setw( 8 ) << "slow\n";
+  for ( const auto& category : snapshot.categories ) {
+    out << "  " << left << setw( 40 ) << category.name << right << setw( 12 ) << category.invocations << setw( 12 )
+        << ms( category.total_time ) << setw( 10 ) << ms( category.max_time ) << setw( 12 )
+        << category.interest_evaluations << setw( 10 ) << category.starved << setw( 7 ) << category.slow << "\n";
+  }
+  out.flags( flags );
+}
+
+template<typename Callback>
+void EventLoop::timed( RuleCategory& category, const Callback& callback )
+{
+  const auto start = steady_clock::now();
+  callback();
+  const auto elapsed = duration_cast<nanoseconds>( steady_clock::now() - start );
+
+  ++category.invocations;
+  category.total_time += elapsed;
+  category.max_time = max( category.max_time, elapsed );
+  if ( category.watchdog > nanoseconds::zero() and elapsed > category.watchdog ) {
+    ++category.slow;
+    cerr << "EventLoop watchdog: a callback of rule \"" << category.name << "\" took "
+         << duration<double, milli>( elapsed ).count() << " ms (budget "
+         << duration<double, milli>( category.watchdog ).count() << " ms)\n";
+  }
+}
+
+bool EventLoop::interest( BasicRule& rule )
+{
+  if ( rule.notified ) {
+    return rule.interested;
+  }
+  ++_rule_categories[rule.category_id].interest_evaluations;
+  return rule.interest();
+}
+
+EventLoop::BasicRule::BasicRule( size_t s_category_id, StoredInterestT s_interest, StoredCallbackT s_callback )
   : category_id( s_category_id ), interest( move( s_interest ) ), callback( move( s_callback ) )
 {}
 
 EventLoop::FDRule::FDRule( BasicRule&& base,
                            FileDescriptor&& s_fd,
                            Direction s_direction,
-                           CallbackT s_cancel,
-                           CallbackT s_error )
-  : BasicRule( base )
+                           StoredCallbackT s_cancel,
+                           StoredCallbackT s_error )
+  : BasicRule( move( base ) )
   , fd( move( s_fd ) )
   , direction( s_direction )
   , cancel( move( s_cancel ) )
@@ -47,54 +182,434 @@ EventLoop::RuleHandle EventLoop::add_rule( size_t category_id,
                                            const CallbackT& cancel, // NOLINT(*-easily-swappable-*)
                                            const CallbackT& error )
 {
-  if ( category_id >= _rule_categories.size() ) {
+  return add_fd_rule(
+    FDRule { BasicRule { category_id, interest, callback }, fd.duplicate(), direction, cancel, error }, fd );
+}
+
+EventLoop::RuleHandle EventLoop::add_fd_rule( FDRule&& rule, FileDescriptor& fd )
+{
+  if ( rule.category_id >= _rule_categories.size() ) {
     throw out_of_range( "bad category_id" );
   }
 
-  _fd_rules.emplace_back( make_shared<FDRule>(
-    BasicRule { category_id, interest, callback }, fd.duplicate(), direction, cancel, error ) );
+  const SlotHandle id = _rules->fd_rules.insert( move( rule ) );
+
+  if ( _epoll ) {
+    // register the fd with no events yet: like a poll placeholder, that still reports errors and hangups
+    auto [it, inserted] = _epoll_registrations.try_emplace( fd.fd_num(), EpollRegistration { fd.fd_num() } );
+    EpollRegistration& registration = it->second;
+
+    // a registration whose rules' fds are all closed is for an fd that is gone (closing it took it out of the
+    // epoll set), and this one only reuses its number: register it afresh
+    const bool stale = not inserted and ranges::all_of( registration.rules, [&]( const SlotHandle other ) {
+                         return _rules->fd_rules.find( other )->fd.closed();
+                       } );
+    if ( inserted or stale ) {
+      erase( _epoll_armed, &registration ); // it is armed afresh like a new registration
+      registration.armed = false;
+      registration.registered_events = 0;
+      registration.always_ready = false;
+      epoll_event event { 0, { .ptr = &registration } };
+      if ( epoll_ctl( _epoll->fd_num(), EPOLL_CTL_ADD, fd.fd_num(), &event ) != 0 ) {
+        if ( errno == EEXIST ) {
+          // the old fd's file is still open elsewhere (e.g. dup2()ed onto this number): take over its entry
+          CheckSystemCall( "epoll_ctl", epoll_ctl( _epoll->fd_num(), EPOLL_CTL_MOD, fd.fd_num(), &event ) );
+        } else if ( errno != EPERM ) {
+          throw unix_error( "epoll_ctl" );
+        } else {
+          registration.always_ready = true;
+        }
+      }
+    }
+    registration.rules.push_back( id );
+    _rules->fd_rules.find( id )->registration = &registration;
+  }
 
-  return RuleHandle { _fd_rules.back() };
+  return RuleHandle { _rules, RuleHandle::Kind::FD, id };
 }
 
 EventLoop::RuleHandle EventLoop::add_rule( const size_t category_id,
                                            const CallbackT& callback,
                                            const InterestT& interest )
 {
-  if ( category_id >= _rule_categories.size() ) {
+  return add_non_fd_rule( BasicRule { category_id, interest, callback } );
+}
+
+EventLoop::RuleHandle EventLoop::add_non_fd_rule( BasicRule&& rule )
+{
+  if ( rule.category_id >= _rule_categories.size() ) {
     throw out_of_range( "bad category_id" );
   }
 
-  _non_fd_rules.emplace_back( make_shared<BasicRule>( category_id, interest, callback ) );
+  if ( rule.notified ) {
+    return RuleHandle { _rules, RuleHandle::Kind::NotifiedNonFD, _rules->notified_rules.insert( move( rule ) ) };
+  }
+  return RuleHandle { _rules, RuleHandle::Kind::NonFD, _rules->non_fd_rules.insert( move( rule ) ) };
+}
+
+EventLoop::RuleHandle EventLoop::add_read_rule( const size_t category_id,
+                                                FileDescriptor& fd,
+                                                const ReadLengthT& read_length,
+                                                const ReadCallbackT& on_read,
+                                                const CallbackT& cancel, // NOLINT(*-easily-swappable-*)
+                                                const CallbackT& error )
+{
+  auto handle = add_rule(
+    category_id, fd, Direction::In, [] {}, [read_length] { return read_length() > 0; }, cancel, error );
+  FDRule& rule = *_rules->fd_rules.find( handle.rule_ );
+  rule.read_length = read_length;
+  rule.on_read = on_read;
+  return handle;
+}
+
+EventLoop::RuleHandle EventLoop::add_write_rule( const size_t category_id,
+                                                 FileDescriptor& fd,
+                                                 const WriteSourceT& write_source,
+                                                 const WriteCallbackT& on_written,
+                                                 const CallbackT& cancel, // NOLINT(*-easily-swappable-*)
+                                                 const CallbackT& error )
+{
+  auto handle = add_rule(
+    category_id, fd, Direction::Out, [] {}, [write_source] { return not write_source().empty(); }, cancel, error );
+  FDRule& rule = *_rules->fd_rules.find( handle.rule_ );
+  rule.write_source = write_source;
+  rule.on_written = on_written;
+  return handle;
+}
+
+void EventLoop::forget( const SlotHandle id )
+{
+  FDRule& rule = *_rules->fd_rules.find( id );
+  if ( rule.operation ) {
+    // the kernel still holds an operation for this rule; stop it. Its completion won't find the rule, and is
+    // dropped
+    uring_cancel( rule );
+  }
+
+  const bool notified_interest = rule.notified and rule.interested;
+  if ( notified_interest ) {
+    --_rules->notified_interested;
+  }
+
+  if ( rule.registration ) {
+    auto& rules = rule.registration->rules;
+    erase( rules, id );
+    if ( rules.empty() ) {
+      erase( _epoll_armed, rule.registration );
+      // fails harmlessly if the fd has already been closed, which removes it from the epoll set anyway
+      epoll_ctl( _epoll->fd_num(), EPOLL_CTL_DEL, rule.registration->fd, nullptr );
+      _epoll_registrations.erase( rule.registration->fd );
+    } else if ( notified_interest ) {
+      renotify( *rule.registration );
+    }
+    rule.registration = nullptr;
+  }
+
+  _rules->fd_rules.erase( id );
+}
+
+void EventLoop::arm( EpollRegistration& registration )
+{
+  if ( not registration.armed ) {
+    registration.armed = true;
+    _epoll_armed.push_back( &registration );
+  }
+}
+
+void EventLoop::renotify( EpollRegistration& registration )
+{
+  registration.notified_events = 0;
+  for ( const SlotHandle id : registration.rules ) {
+    const FDRule* const rule = _rules->fd_rules.find( id );
+    if ( rule->notified and rule->interested and not rule->cancel_requested ) {
+      registration.notified_events |= static_cast<uint16_t>( rule->direction );
+    }
+  }
+  arm( registration );
+}
+
+void EventLoop::Rules::attend( const SlotHandle id, FDRule& rule )
+{
+  if ( rule.notified and track_changes and not rule.queued ) {
+    rule.queued = true;
+    changed.push_back( { id, true } );
+  }
+}
+
+void EventLoop::Rules::attend( const SlotHandle id, BasicRule& rule )
+{
+  if ( rule.notified and not rule.queued ) {
+    rule.queued = true;
+    changed.push_back( { id, false } );
+  }
+}
+
+size_t EventLoop::serve_changed( const size_t budget )
+{
+  // only the rules on the list when the pass starts (all in the dense array, so they stay put while callbacks
+  // add rules); the fd rules, and the non-fd rules left over once the budget runs out, are kept for later.
+  // The list is compacted as it goes, so a callback that throws loses none of it.
+  auto& changed = _rules->changed;
+  const size_t count = changed.size();
+  size_t kept = 0;
+  size_t served = 0;
+  for ( size_t n = 0; n < count; ++n ) {
+    const Rules::Change change = changed[n];
+    BasicRule* const rule = change.fd_rule ? nullptr : _rules->notified_rules.find( change.id );
+    if ( change.fd_rule or ( rule and rule->interested and budget and served == budget ) ) {
+      changed[kept++] = change;
+      continue;
+    }
+    if ( not rule ) {
+      continue; // cancelled
+    }
+    rule->queued = false;
+
+    bool rule_fired = false;
+    uint8_t iterations = 0;
+    while ( interest( *rule ) ) {
+      if ( iterations++ >= 128 ) {
+        throw runtime_error( "EventLoop: busy wait detected: rule \""
+                             + _rule_categories.at( rule->category_id ).name + "\" is still interested after "
+                             + to_string( iterations ) + " iterations" );
+      }
 
-  return RuleHandle { _non_fd_rules.back() };
+      rule_fired = true;
+      timed( _rule_categories[rule->category_id], rule->callback );
+    }
+    served += rule_fired ? 1 : 0;
+  }
+  changed.erase( changed.begin() + static_cast<ptrdiff_t>( kept ),
+                 changed.begin() + static_cast<ptrdiff_t>( count ) );
+
+  return served;
+}
+
+bool EventLoop::attend_changed()
+{
+  // a cancel() callback may change other rules' interest; those wait for the next call
+  _attending.swap( _rules->changed );
+  for ( const auto& [id, fd_rule] : _attending ) {
+    if ( not fd_rule ) {
+      _rules->changed.push_back( { id, false } ); // a non-fd rule the budget left for the next call
+      continue;
+    }
+    FDRule* const rule = _rules->fd_rules.find( id );
+    if ( not rule ) {
+      continue;
+    }
+    rule->queued = false;
+
+    if ( rule->cancel_requested ) {
+      forget( id );
+      continue;
+    }
+    if ( rule->fd.closed() or ( rule->direction == Direction::In and rule->fd.eof() ) ) {
+      rule->cancel();
+      forget( id );
+      continue;
+    }
+
+    if ( _backend == Backend::IoUring ) {
+      uring_update( *rule, id );
+    } else if ( rule->registration ) {
+      renotify( *rule->registration );
+    }
+  }
+  _attending.clear();
+
+  return _rules->notified_interested > 0;
+}
+
+EventLoop::RuleHandle EventLoop::add_timer( const size_t category_id,
+                                            const milliseconds delay,
+                                            CallbackT callback,
+                                            const milliseconds period )
+{
+  if ( category_id >= _rule_categories.size() ) {
+    throw out_of_range( "EventLoop: no such rule category" );
+  }
+  // round the deadline up, so the timer never fires early (the wheel's clock rounds down)
+  const auto deadline = ceil<milliseconds>( steady_clock::now() - _timer_epoch + delay );
+  // the timer is tagged with its category (there are at most 64), so advance_timers() can time it
+  const auto id = _rules->timers.add( static_cast<uint64_t>( max( deadline, milliseconds::zero() ).count() ),
+                                      static_cast<uint64_t>( max( period, milliseconds::zero() ).count() ),
+                                      move( callback ),
+                                      static_cast<uint8_t>( category_id ) );
+  return RuleHandle { _rules, id };
+}
+
+size_t EventLoop::advance_timers()
+{
+  // each callback is timed against its category, which the wheel keeps as the timer's tag
+  return _rules->timers.advance( timer_now(),
+                                 [this]( uint8_t category_id, TimerWheel::CallbackT& callback ) {
+                                   timed( _rule_categories[category_id], callback );
+                                 } );
+}
+
+void EventLoop::accept_posts()
+{
+  if ( _posted ) {
+    return;
+  }
+  _posted = make_unique<Posted>();
+  auto handle = add_notified_rule(
+    add_category( "posted tasks" ), _posted->wakeup, Direction::In, [&posted = *_posted] {
+      // clear before draining: a post that finds the queue drained (after the clear) signals again
+      posted.wakeup.clear();
+      try {
+        posted.tasks.drain( []( auto&& task ) { task(); } );
+      } catch ( ... ) {
+        posted.wakeup.signal_from_any_thread(); // the tasks after the one that threw still wait
+        throw;
+      }
+    } );
+  handle.set_interest( true );
+}
+
+void EventLoop::post( InlineFunction<void( void )> task )
+{
+  if ( not _posted ) {
+    throw runtime_error( "EventLoop: post() to a loop that doesn't accept_posts()" );
+  }
+  if ( _posted->tasks.push( move( task ) ) ) {
+    _posted->wakeup.signal_from_any_thread();
+  }
+}
+
+uint64_t EventLoop::timer_now() const
+{
+  return static_cast<uint64_t>( duration_cast<milliseconds>( steady_clock::now() - _timer_epoch ).count() );
 }
 
 void EventLoop::RuleHandle::cancel()
 {
-  const shared_ptr<BasicRule> rule_shared_ptr = rule_weak_ptr_.lock();
-  if ( rule_shared_ptr ) {
-    rule_shared_ptr->cancel_requested = true;
+  const shared_ptr<Rules> rules = rules_.lock();
+  if ( not rules ) {
+    return;
+  }
+
+  switch ( kind_ ) {
+    case Kind::FD:
+      // dropped on the loop's next pass, which also takes the fd out of epoll or io_uring
+      if ( FDRule* const rule = rules->fd_rules.find( rule_ ) ) {
+        rule->cancel_requested = true;
+        rules->attend( rule_, *rule );
+      }
+      break;
+    case Kind::NonFD:
+      rules->non_fd_rules.erase( rule_ );
+      break;
+    case Kind::NotifiedNonFD:
+      rules->notified_rules.erase( rule_ );
+      break;
+    case Kind::Timer:
+      rules->timers.cancel( timer_ );
+      break;
+  }
+}
+
+void EventLoop::RuleHandle::set_interest( const bool interested )
+{
+  const shared_ptr<Rules> rules = rules_.lock();
+  if ( not rules ) {
+    return;
+  }
+
+  BasicRule* rule = nullptr;
+  if ( kind_ == Kind::FD ) {
+    rule = rules->fd_rules.find( rule_ );
+  } else if ( kind_ == Kind::NonFD ) {
+    rule = rules->non_fd_rules.find( rule_ );
+  } else if ( kind_ == Kind::NotifiedNonFD ) {
+    rule = rules->notified_rules.find( rule_ );
+  } else {
+    throw runtime_error( "EventLoop: set_interest() on a timer" );
+  }
+  if ( not rule or rule->interested == interested ) {
+    return;
+  }
+  if ( not rule->notified ) {
+    throw runtime_error( "EventLoop: set_interest() on a rule with an interest() predicate" );
   }
+
+  rule->interested = interested;
+  if ( kind_ == Kind::FD ) {
+    rules->notified_interested += interested ? 1 : -1;
+    rules->attend( rule_, static_cast<FDRule&>( *rule ) );
+  } else {
+    rules->attend( rule_, *rule );
+  }
+}
+
+namespace {
+// The `n`th position of a pass over `count` rules that starts at `start`
+size_t rotated( size_t start, size_t n, size_t count )
+{
+  return start + n < count ? start + n : start + n - count;
+}
+} // namespace
+
+EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
+{
+  // each pass waits at most until the timer wheel next has something to do; a pass that only moved timers
+  // between levels of the wheel is not an event, so wait again for the rest of the timeout
+  const auto start = steady_clock::now();
+  const auto waited_before = _wait_time;
+  const auto deadline = start + milliseconds { timeout_ms };
+  int remaining_ms = timeout_ms;
+  Result result {};
+  while ( true ) {
+    result = wait_once( remaining_ms );
+    if ( result != Result::Timeout or timeout_ms == 0 ) {
+      break;
+    }
+    if ( timeout_ms > 0 ) {
+      remaining_ms = static_cast<int>( ceil<milliseconds>( deadline - steady_clock::now() ).count() );
+      if ( remaining_ms <= 0 ) {
+        break;
+      }
+    }
+  }
+
+  ++_calls;
+  _dispatch_time += duration_cast<nanoseconds>( steady_clock::now() - start ) - ( _wait_time - waited_before );
+  return result;
 }
 
 // NOLINTBEGIN(*-cognitive-complexity)
 // NOLINTBEGIN(*-signed-bitwise)
-EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
+EventLoop::Result EventLoop::wait_once( const int timeout_ms )
 {
-  // first, handle the non-file-descriptor-related rules
-  {
-    for ( auto it = _non_fd_rules.begin(); it != _non_fd_rules.end(); ) {
-      auto& this_rule = **it;
-      bool rule_fired = false;
+  // timers that are due come first. They don't count against the budget, so even with Dispatch::One a rule
+  // that is ready still gets its turn: a timer that is always due (a short period on a slow loop) can't
+  // starve the rules.
+  const bool timers_fired = advance_timers() > 0;
 
-      if ( this_rule.cancel_requested ) {
-        it = _non_fd_rules.erase( it );
-        continue;
+  // with Dispatch::One, serve one rule (io_uring still handles every completion it has); else up to the budget
+  size_t budget = _dispatch == Dispatch::One ? 1 : _budget;
+  size_t served = 0;
+
+  // first, handle the non-file-descriptor-related rules (dropping the cancelled ones, and taking in new ones):
+  // the notified ones that were set interested, and then those with interest() predicates
+  {
+    auto& rules = _rules->non_fd_rules;
+    rules.compact( _non_fd_start );
+    _rules->notified_rules.compact();
+    served = serve_changed( budget );
+    const size_t count = budget and served == budget ? 0 : rules.dense_size();
+    size_t resume = _non_fd_start;
+    for ( size_t n = 0; n < count; ++n ) {
+      const size_t i = rotated( _non_fd_start, n, count );
+      if ( not rules.live( i ) ) {
+        continue; // cancelled by a callback earlier in this pass
       }
+      auto& this_rule = rules[i];
+      bool rule_fired = false;
 
       uint8_t iterations = 0;
-      while ( this_rule.interest() ) {
+      while ( interest( this_rule ) ) {
         if ( iterations++ >= 128 ) {
           throw runtime_error( "EventLoop: busy wait detected: rule \""
                                + _rule_categories.at( this_rule.category_id ).name + "\" is still interested after "
@@ -102,125 +617,536 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
         }
 
         rule_fired = true;
-        this_rule.callback();
+        timed( _rule_categories[this_rule.category_id], this_rule.callback );
       }
 
       if ( rule_fired ) {
-        return Result::Success; /* only serve one rule on each iteration */
+        resume = i + 1;
+        if ( ++served == budget ) {
+          break; /* only serve one rule on each iteration, or as many as the budget allows */
+        }
       }
+    }
 
-      ++it;
+    if ( served ) {
+      if ( _dispatch == Dispatch::AllReady and count ) {
+        _non_fd_start = resume < count ? resume : 0; // start after the last rule served next time
+      }
+      if ( served == budget ) {
+        return Result::Success;
+      }
+      budget = budget ? budget - served : 0;
     }
   }
 
-  // now the file-descriptor-related rules. poll any "interested" file descriptors
-  vector<pollfd> pollfds {};
-  pollfds.reserve( _fd_rules.size() );
+  // now the file-descriptor-related rules: drop finished ones, and find out which of the rest are interested
+  auto& fd_rules = _rules->fd_rules;
+  fd_rules.compact( _fd_start );
+  const size_t fd_count = fd_rules.dense_size();
+  // Backend::Poll: one entry per rule, by position; those of dropped rules stay negative, which poll ignores
+  _pollfds.assign( _backend == Backend::Poll ? fd_count : 0, { -1, 0, 0 } );
   bool something_to_poll = false;
 
-  // set up the pollfd for each rule
-  for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ) { // NOTE: it gets erased or incremented in loop body
-    auto& this_rule = **it;
+  for ( size_t n = 0; n < fd_count; ++n ) {
+    const size_t i = rotated( _fd_start, n, fd_count );
+    if ( not fd_rules.live( i ) ) {
+      continue;
+    }
+    auto& this_rule = fd_rules[i];
+    if ( this_rule.notified and _rules->track_changes ) {
+      continue; // looked at only once it changes
+    }
+    const SlotHandle id = fd_rules.handle_at( i );
 
     if ( this_rule.cancel_requested ) {
       //      this_rule.cancel();
       //      if rule is cancelled externally, no need to call the cancellation callback
       //      this makes it easier to cancel rules and delete captured objects right away
-      it = _fd_rules.erase( it );
+      forget( id );
       continue;
     }
 
     if ( this_rule.direction == Direction::In && this_rule.fd.eof() ) {
       // no more reading on this rule, it's reached eof
       this_rule.cancel();
-      it = _fd_rules.erase( it );
+      forget( id );
       continue;
     }
 
     if ( this_rule.fd.closed() ) {
       this_rule.cancel();
-      it = _fd_rules.erase( it );
+      forget( id );
       continue;
     }
 
-    if ( this_rule.interest() ) {
-      pollfds.push_back( { this_rule.fd.fd_num(), static_cast<int16_t>( this_rule.direction ), 0 } );
-      something_to_poll = true;
-    } else {
-      pollfds.push_back( { this_rule.fd.fd_num(), 0, 0 } ); // placeholder --- we still want errors
+    this_rule.interested = interest( this_rule );
+    something_to_poll |= this_rule.interested;
+
+    if ( _backend == Backend::Poll ) {
+      // an uninterested rule still gets a placeholder --- we still want errors
+      const auto events = this_rule.interested ? static_cast<int16_t>( this_rule.direction ) : int16_t {};
+      _pollfds[i] = { this_rule.fd.fd_num(), events, 0 };
+    } else if ( _backend == Backend::IoUring ) {
+      uring_update( this_rule, id );
+    } else if ( this_rule.interested ) {
+      arm( *this_rule.registration );
+      this_rule.registration->wanted_events |= static_cast<uint16_t>( this_rule.direction );
     }
-    ++it;
   }
+  something_to_poll |= attend_changed();
+  fd_rules.release(); // what the rules just dropped captured (and their fds) goes now, not on the next call
 
-  // quit if there is nothing left to poll
-  if ( not something_to_poll ) {
-    return Result::Exit;
+  // quit if there is nothing left to poll and no timer to wait for (unless a rule was just served)
+  if ( not something_to_poll and _rules->timers.empty() ) {
+    erase_if( _epoll_armed, []( auto* registration ) {
+      registration->wanted_events = 0;
+      registration->armed = registration->registered_events != 0;
+      return not registration->armed;
+    } );
+    return served or timers_fired ? Result::Success : Result::Exit;
   }
 
+  // having served a rule already, only pick up fds that are ready now; otherwise wake for the next timer
+  int fd_timeout_ms = served or timers_fired ? 0 : timeout_ms;
+  if ( not _rules->timers.empty() ) {
+    const uint64_t now = timer_now();
+    const uint64_t until_timer = _rules->timers.next_event() - min( now, _rules->timers.next_event() );
+    if ( fd_timeout_ms < 0 or until_timer < static_cast<uint64_t>( fd_timeout_ms ) ) {
+      fd_timeout_ms = static_cast<int>( min( until_timer, uint64_t { numeric_limits<int>::max() } ) );
+    }
+  }
+
+  Result result {};
+  switch ( _backend ) {
+    case Backend::Poll:
+      result = wait_poll( fd_timeout_ms, budget );
+      break;
+    case Backend::Epoll:
+      result = wait_epoll( fd_timeout_ms, budget );
+      break;
+    case Backend::IoUring:
+      result = wait_uring( fd_timeout_ms, _dispatch == Dispatch::One ? 0 : budget );
+      break;
+  }
+  if ( result == Result::Timeout and advance_timers() > 0 ) {
+    result = Result::Success;
+  }
+  return served or timers_fired ? Result::Success : result;
+}
+
+EventLoop::Result EventLoop::wait_poll( const int timeout_ms, const size_t budget )
+{
   // call poll -- wait until one of the fds satisfies one of the rules (writeable/readable)
-  if ( 0 == CheckSystemCall( "poll", ::poll( pollfds.data(), pollfds.size(), timeout_ms ) ) ) {
+  const auto start = steady_clock::now();
+  const int ready = ::poll( _pollfds.data(), _pollfds.size(), timeout_ms );
+  _wait_time += duration_cast<nanoseconds>( steady_clock::now() - start );
+  if ( 0 == CheckSystemCall( "poll", ready ) ) {
     return Result::Timeout;
   }
 
-  // go through the poll results
-  for ( auto [it, idx] = make_pair( _fd_rules.begin(), static_cast<size_t>( 0 ) ); it != _fd_rules.end(); ++idx ) {
-    const auto& this_pollfd = pollfds.at( idx );
-    auto& this_rule = **it;
-
-    const auto poll_error = static_cast<bool>( this_pollfd.revents & ( POLLERR | POLLNVAL ) );
-    if ( poll_error ) {
-      /* see if fd is a socket */
-      int socket_error = 0;
-      socklen_t optlen = sizeof( socket_error );
-      const int ret = getsockopt( this_rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
-      if ( ret == -1 and errno == ENOTSOCK ) {
-        cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( this_rule.category_id ).name
-             << "\"\n";
-      } else if ( ret == -1 ) {
-        throw unix_error( "getsockopt" );
-      } else if ( optlen != sizeof( socket_error ) ) {
-        throw runtime_error( "unexpected length from getsockopt: " + to_string( optlen ) );
-      } else if ( socket_error ) {
-        cerr << "error on polled socket for rule \"" << _rule_categories.at( this_rule.category_id ).name
-             << "\": " << strerror( socket_error ) << "\n";
-      }
-
-      this_rule.error();
-      this_rule.cancel();
-      it = _fd_rules.erase( it );
-      continue;
+  // go through the poll results, in the same order as the rules were gone through
+  auto& fd_rules = _rules->fd_rules;
+  const size_t count = _pollfds.size();
+  size_t served = 0;
+  size_t resume = _fd_start;
+  size_t n = 0;
+  for ( ; n < count; ++n ) {
+    const size_t i = rotated( _fd_start, n, count );
+    if ( not fd_rules.live( i ) or fd_rules[i].cancel_requested ) {
+      continue; // dropped already, or cancelled by a callback earlier in this pass
+    }
+    const auto outcome = handle_fd_event( fd_rules[i], _pollfds[i].events, _pollfds[i].revents );
+    if ( outcome == Outcome::Cancelled ) {
+      forget( fd_rules.handle_at( i ) );
+    } else if ( outcome == Outcome::Served ) {
+      resume = i + 1;
+      if ( ++served == budget ) {
+        break; /* only serve one rule on each iteration, or as many as the budget allows */
+      }
     }
+  }
 
-    const auto poll_ready = static_cast<bool>( this_pollfd.revents & this_pollfd.events );
-    const auto poll_hup = static_cast<bool>( this_pollfd.revents & POLLHUP );
-    if ( poll_hup && ( ( this_pollfd.events && !poll_ready ) or ( this_rule.direction == Direction::Out ) ) ) {
-      // if we asked for the status, and the _only_ condition was a hangup, this FD is defunct:
-      //   - if it was POLLIN and nothing is readable, no more will ever be readable
-      //   - if it was POLLOUT, it will not be writable again
-      // additionally, consider FD defunct if rule will only query for Direction::Out
-      this_rule.cancel();
-      it = _fd_rules.erase( it );
-      continue;
+  // the rules after the last one served that were ready too have to wait for the next call
+  for ( ++n; n < count; ++n ) {
+    const size_t i = rotated( _fd_start, n, count );
+    const bool was_ready = _pollfds[i].revents & _pollfds[i].events;
+    if ( was_ready and fd_rules.live( i ) and not fd_rules[i].cancel_requested ) {
+      ++_rule_categories[fd_rules[i].category_id].starved;
     }
+  }
 
-    if ( poll_ready ) {
-      // we only want to call callback if revents includes the event we asked for
-      const auto count_before = this_rule.service_count();
-      this_rule.callback();
+  // start after the last rule served next time, so the rules at the front can't starve the rest
+  if ( served and _dispatch == Dispatch::AllReady ) {
+    _fd_start = resume < count ? resume : 0;
+  }
 
-      if ( count_before == this_rule.service_count() and ( not this_rule.fd.closed() ) and this_rule.interest() ) {
-        throw runtime_error( "EventLoop: busy wait detected: rule \""
-                             + _rule_categories.at( this_rule.category_id ).name
-                             + "\" did not read/write fd and is still interested" );
-      }
+  return Result::Success;
+}
 
-      return Result::Success; /* only serve one rule on each iteration */
+EventLoop::Result EventLoop::wait_epoll( const int timeout_ms, const size_t budget )
+{
+  // tell the kernel about fds whose interest changed since the last call, and only those. Only armed
+  // registrations can have changed, so idle fds cost nothing here.
+  // fds epoll can't watch are always ready, so their events go straight into the results, and epoll_wait
+  // only checks for more without blocking.
+  // Notified rules' events last until they change, so a registration with only those is looked at again only then.
+  _epoll_events.resize( _epoll_registrations.size() + 1 );
+  size_t always_ready = 0;
+  for ( auto* registration : _epoll_armed ) {
+    const uint32_t events = registration->wanted_events | registration->notified_events;
+    if ( registration->always_ready ) {
+      if ( events ) {
+        _epoll_events[always_ready++] = { events, { .ptr = registration } };
+      }
+    } else if ( events != registration->registered_events ) {
+      epoll_event event { events, { .ptr = registration } };
+      CheckSystemCall( "epoll_ctl", epoll_ctl( _epoll->fd_num(), EPOLL_CTL_MOD, registration->fd, &event ) );
+      registration->registered_events = events;
     }
+    registration->predicate_events = registration->wanted_events;
+    registration->wanted_events = 0;
+  }
+  erase_if( _epoll_armed, []( auto* registration ) {
+    registration->armed = registration->predicate_events != 0
+                          or ( registration->always_ready and registration->notified_events != 0 );
+    return not registration->armed;
+  } );
+
+  // with a budget, ask for no more fds than it allows: epoll moves the fds it reports to the back of its ready
+  // list, so the ones left out now come first next time
+  size_t max_events = _epoll_events.size() - always_ready;
+  if ( budget ) {
+    max_events = max( min( max_events, budget - min( budget, always_ready ) ), size_t { 1 } );
+  }
+  const auto start = steady_clock::now();
+  const int ready = epoll_wait( _epoll->fd_num(),
+                                _epoll_events.data() + always_ready,
+                                static_cast<int>( max_events ),
+                                always_ready ? 0 : timeout_ms );
+  _wait_time += duration_cast<nanoseconds>( steady_clock::now() - start );
+  if ( CheckSystemCall( "epoll_wait", ready ) == 0 and always_ready == 0 ) {
+    return Result::Timeout;
+  }
 
-    ++it; // if we got here, it means we didn't call _fd_rules.erase()
+  // go through the ready fds, and each interested rule on them
+  size_t served = 0;
+  const auto events = span( _epoll_events ).first( always_ready + ready );
+  for ( size_t e = 0; e < events.size(); ++e ) {
+    const auto& event = events[e];
+    auto* const registration = static_cast<EpollRegistration*>( event.data.ptr );
+    // rules a callback adds on this fd wait for the next call (the loop has not asked their interest yet)
+    const size_t count = registration->rules.size();
+    for ( size_t i = 0; i < count; ++i ) {
+      FDRule* const this_rule = _rules->fd_rules.find( registration->rules[i] );
+      if ( this_rule->cancel_requested ) {
+        continue;
+      }
+      const auto wanted = this_rule->interested ? static_cast<int16_t>( this_rule->direction ) : int16_t {};
+      switch ( handle_fd_event( *this_rule, wanted, static_cast<int16_t>( event.events ) ) ) {
+        case Outcome::Served:
+          if ( ++served == budget ) {
+            count_starved( events.subspan( e ), i + 1 );
+            return Result::Success; /* only serve one rule on each iteration, or as many as the budget allows */
+          }
+          break;
+        case Outcome::Cancelled:
+          // erasing it now would disturb registration->rules; the next call drops it without a second cancel()
+          this_rule->cancel_requested = true;
+          _rules->attend( registration->rules[i], *this_rule );
+          break;
+        case Outcome::Idle:
+          break;
+      }
+    }
   }
 
   return Result::Success;
 }
+
+void EventLoop::count_starved( const span<const epoll_event> events, size_t first )
+{
+  for ( const auto& event : events ) {
+    const auto& rules = static_cast<EpollRegistration*>( event.data.ptr )->rules;
+    for ( size_t i = first; i < rules.size(); ++i ) {
+      const FDRule* const rule = _rules->fd_rules.find( rules[i] );
+      if ( rule and rule->interested and not rule->cancel_requested
+           and ( event.events & static_cast<uint16_t>( rule->direction ) ) ) {
+        ++_rule_categories[rule->category_id].starved;
+      }
+    }
+    first = 0;
+  }
+}
+
+EventLoop::Result EventLoop::wait_uring( const int timeout_ms, const size_t budget )
+{
+  // the operations were queued while going through the rules: submit them, and wait for the first completion
+  // (completions left over from a previous call count, so this returns at once if there are any)
+  const auto start = steady_clock::now();
+  _uring->submit( 1, timeout_ms );
+  _wait_time += duration_cast<nanoseconds>( steady_clock::now() - start );
+
+  // then handle every completion that has arrived, not just one -- or as many as the budget allows, leaving the
+  // rest in the completion ring, oldest first, for the next call
+  bool completed = false;
+  size_t served = 0;
+  io_uring_cqe cqe {};
+  while ( budget == 0 or served < budget ) {
+    if ( not _uring->next_completion( cqe ) ) {
+      break;
+    }
+    served += handle_completion( cqe ) == Outcome::Served;
+    completed = true;
+  }
+
+  return completed ? Result::Success : Result::Timeout;
+}
+
+void EventLoop::uring_update( FDRule& rule, const SlotHandle id )
+{
+  if ( not rule.operation and rule.interested ) {
+    uring_submit( rule, id );
+  } else if ( rule.operation and not rule.interested and not rule.on_written ) {
+    uring_cancel( rule ); // a poll or read that is no longer wanted (writes always finish)
+  }
+}
+
+void EventLoop::uring_submit( FDRule& rule, const SlotHandle id )
+{
+  auto operation = Operation::Poll;
+  uint16_t buffer_index = 0;
+  if ( rule.on_read and not rule.poll_first ) {
+    operation = Operation::Read;
+  } else if ( rule.on_written and not rule.poll_first ) {
+    operation = Operation::Write;
+  }
+
+  if ( operation == Operation::Write ) {
+    // the bytes go to the kernel in a registered buffer; if every one is busy, try again on the next call
+    const auto index = _uring->take_fixed_buffer();
+    if ( not index ) {
+      return;
+    }
+    const auto data = rule.write_source();
+    const auto buffer = _uring->fixed_buffer( *index );
+    const size_t len = min( data.size(), buffer.size() );
+    copy_n( data.begin(), len, buffer.begin() );
+
+    auto& sqe = _uring->next_sqe();
+    sqe.opcode = IORING_OP_WRITE_FIXED;
+    sqe.addr = reinterpret_cast<uint64_t>( buffer.data() ); // NOLINT(*-reinterpret-cast)
+    sqe.len = len;
+    sqe.off = -1; // at the current position
+    sqe.buf_index = *index;
+    buffer_index = *index;
+  } else if ( operation == Operation::Read ) {
+    // the kernel picks one of the provided buffers once there is something to read
+    auto& sqe = _uring->next_sqe();
+    sqe.opcode = IORING_OP_READ;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = IOUring::kProvidedGroup;
+    sqe.len = min( rule.read_length(), _uring->buffer_size() );
+    sqe.off = -1;
+  } else {
+    auto& sqe = _uring->next_sqe();
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.poll32_events = static_cast<uint16_t>( rule.direction );
+  }
+
+  // fill in what every kind of operation shares (the entry just handed out is the last one)
+  rule.operation = tag( id, buffer_index, static_cast<uint8_t>( operation ) );
+  rule.poll_first = false;
+  _uring->last_sqe().fd = rule.fd.fd_num();
+  _uring->last_sqe().user_data = rule.operation;
+}
+
+void EventLoop::uring_cancel( FDRule& rule )
+{
+  if ( rule.cancel_submitted ) {
+    return;
+  }
+  auto& sqe = _uring->next_sqe();
+  sqe.opcode = IORING_OP_ASYNC_CANCEL;
+  sqe.addr = rule.operation;
+  sqe.user_data = tag( {}, 0, static_cast<uint8_t>( Operation::Cancel ) );
+  rule.cancel_submitted = true;
+}
+
+EventLoop::Outcome EventLoop::handle_completion( const io_uring_cqe& cqe )
+{
+  const auto operation = static_cast<Operation>( cqe.user_data & 3U );
+  if ( operation == Operation::Cancel ) {
+    return Outcome::Idle;
+  }
+  if ( operation == Operation::Write ) {
+    _uring->release_fixed_buffer( tagged_buffer( cqe.user_data ) );
+  }
+
+  // a read's buffer goes back to the kernel once on_read is done with it
+  const bool has_buffer = cqe.flags & IORING_CQE_F_BUFFER;
+  const auto buffer_id = static_cast<uint16_t>( cqe.flags >> IORING_CQE_BUFFER_SHIFT );
+  const auto recycle = [&] {
+    if ( has_buffer ) {
+      _uring->recycle_provided_buffer( buffer_id );
+    }
+  };
+
+  // the rule stays in place until the next pass, even if a callback below cancels it
+  FDRule* const found = _rules->fd_rules.find( tagged_rule( cqe.user_data ) );
+  if ( not found or found->operation != cqe.user_data ) {
+    recycle(); // the rule was erased while its operation was in flight
+    return Outcome::Idle;
+  }
+  FDRule& rule = *found;
+  rule.operation = 0;
+  rule.cancel_submitted = false;
+  _rules->attend( tagged_rule( cqe.user_data ), rule ); // a notified rule may want another operation
+
+  if ( rule.cancel_requested or cqe.res == -ECANCELED ) {
+    recycle();
+    return Outcome::Idle;
+  }
+
+  if ( cqe.res == -EAGAIN or cqe.res == -ENOBUFS ) {
+    // the fd would have blocked (so wait for it to be ready first), or every provided buffer was taken
+    rule.poll_first = cqe.res == -EAGAIN;
+    return Outcome::Idle;
+  }
+
+  if ( cqe.res < 0 ) {
+    recycle();
+    return handle_error( rule, -cqe.res );
+  }
+
+  switch ( operation ) {
+    case Operation::Poll: {
+      if ( rule.on_read or rule.on_written ) {
+        return Outcome::Idle; // was waiting for readiness; the read or write itself follows on the next call
+      }
+      const auto events = rule.interested ? static_cast<int16_t>( rule.direction ) : int16_t {};
+      const auto outcome = handle_fd_event( rule, events, static_cast<int16_t>( cqe.res ) );
+      if ( outcome == Outcome::Cancelled ) {
+        rule.cancel_requested = true; // dropped on the next call, without a second cancel()
+      }
+      return outcome;
+    }
+
+    case Operation::Read: {
+      // keep the read count (and so busy-wait detection) and EOF the same as if the loop had read the fd
+      const auto len = static_cast<size_t>( cqe.res );
+      rule.fd.record_read( len );
+      if ( len > 0 ) {
+        timed( _rule_categories[rule.category_id],
+               [&] { rule.on_read( string_view { _uring->provided_buffer( buffer_id ).data(), len } ); } );
+      }
+      recycle();
+      return Outcome::Served;
+    }
+
+    case Operation::Write:
+      if ( cqe.res == 0 ) {
+        throw runtime_error( "EventLoop: busy wait detected: rule \"" + _rule_categories.at( rule.category_id ).name
+                             + "\" wrote nothing and is still interested" );
+      }
+      rule.fd.record_write();
+      timed( _rule_categories[rule.category_id], [&] { rule.on_written( static_cast<size_t>( cqe.res ) ); } );
+      return Outcome::Served;
+
+    case Operation::Cancel:
+      break;
+  }
+
+  return Outcome::Idle;
+}
+
+EventLoop::Outcome EventLoop::handle_error( FDRule& rule, const int error )
+{
+  cerr << "error on file descriptor for rule \"" << _rule_categories.at( rule.category_id ).name
+       << "\": " << strerror( error ) << "\n";
+  rule.error();
+  rule.cancel();
+  rule.cancel_requested = true;
+  return Outcome::Cancelled;
+}
+
+void EventLoop::serve( FDRule& rule )
+{
+  if ( rule.on_read ) {
+    if ( _read_buffer.empty() ) {
+      _read_buffer.resize( kIOBufferSize );
+    }
+    const size_t len = rule.fd.read( span( _read_buffer ).first( min( rule.read_length(), _read_buffer.size() ) ) );
+    if ( len > 0 ) {
+      rule.on_read( string_view { _read_buffer.data(), len } );
+    }
+  } else if ( rule.on_written ) {
+    const size_t len = rule.fd.write( rule.write_source() );
+    if ( len > 0 ) {
+      rule.on_written( len );
+    }
+  } else {
+    rule.callback();
+  }
+}
+
+EventLoop::Outcome EventLoop::handle_fd_event( FDRule& this_rule, const int16_t events, const int16_t revents )
+{
+  const auto poll_error = static_cast<bool>( revents & ( POLLERR | POLLNVAL ) );
+  if ( poll_error ) {
+    /* see if fd is a socket */
+    int socket_error = 0;
+    socklen_t optlen = sizeof( socket_error );
+    const int ret = getsockopt( this_rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
+    if ( ret == -1 and errno == ENOTSOCK ) {
+      cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( this_rule.category_id ).name
+           << "\"\n";
+    } else if ( ret == -1 ) {
+      throw unix_error( "getsockopt" );
+    } else if ( optlen != sizeof( socket_error ) ) {
+      throw runtime_error( "unexpected length from getsockopt: " + to_string( optlen ) );
+    } else if ( socket_error ) {
+      cerr << "error on polled socket for rule \"" << _rule_categories.at( this_rule.category_id ).name
+           << "\": " << strerror( socket_error ) << "\n";
+    }
+
+    this_rule.error();
+    this_rule.cancel();
+    return Outcome::Cancelled;
+  }
+
+  const auto poll_ready = static_cast<bool>( revents & events );
+  const auto poll_hup = static_cast<bool>( revents & POLLHUP );
+  if ( poll_hup && ( ( events && !poll_ready ) or ( this_rule.direction == Direction::Out ) ) ) {
+    // if we asked for the status, and the _only_ condition was a hangup, this FD is defunct:
+    //   - if it was POLLIN and nothing is readable, no more will ever be readable
+    //   - if it was POLLOUT, it will not be writable again
+    // additionally, consider FD defunct if rule will only query for Direction::Out
+    this_rule.cancel();
+    return Outcome::Cancelled;
+  }
+
+  if ( poll_ready ) {
+    // we only want to call callback if revents includes the event we asked for
+    const auto count_before = this_rule.service_count();
+    timed( _rule_categories[this_rule.category_id], [&] { serve( this_rule ); } );
+
+    if ( count_before == this_rule.service_count() and ( not this_rule.fd.closed() ) and interest( this_rule ) ) {
+      throw runtime_error( "EventLoop: busy wait detected: rule \""
+                           + _rule_categories.at( this_rule.category_id ).name
+                           + "\" did not read/write fd and is still interested" );
+    }
+
+    // other rules are checked for EOF before each poll, but a notified one isn't looked at until it changes
+    if ( this_rule.notified and _rules->track_changes
+         and ( this_rule.fd.closed() or ( this_rule.direction == Direction::In and this_rule.fd.eof() ) ) ) {
+      this_rule.cancel();
+      return Outcome::Cancelled;
+    }
+
+    return Outcome::Served;
+  }
+
+  return Outcome::Idle;
+}
 // NOLINTEND(*-signed-bitwise)
 // NOLINTEND(*-cognitive-complexity)
@@ -1,13 +1,25 @@
 #pragma once
 
+#include <chrono>
 #include <functional>
-#include <list>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <poll.h>
+#include <span>
+#include <string>
 #include <string_view>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <vector>
 
+#include "eventfd.hh"
 #include "file_descriptor.hh"
+#include "inline_function.hh"
+#include "io_uring.hh"
+#include "mpsc_queue.hh"
+#include "slot_map.hh"
+#include "timer_wheel.hh"
 
 //! Waits for events on file descriptors and executes corresponding callbacks.
 class EventLoop
@@ -20,67 +32,326 @@ public:
     Out = POLLOUT //!< Callback will be triggered when Rule::fd is writable.
   };
 
+  //! How EventLoop::wait_next_event waits for file descriptors.
+  enum class Backend
+  {
+    Poll, //!< [poll(2)](\ref man2::poll) on every interested fd, each call. Cost grows with the number of fds.
+    Epoll, //!< [epoll(7)](\ref man7::epoll): fds registered once, interest updated only when it changes.
+    IoUring //!< [io_uring(7)](\ref man7::io_uring): read and write rules (add_read_rule(), add_write_rule())
+            //!< have their I/O done by the kernel into registered buffers, and their completions are handled in
+            //!< batches; other fd rules wait for readiness with one-shot polls. Falls back to Epoll if the kernel
+            //!< does not support io_uring.
+  };
+
+  //! How many ready rules one call to EventLoop::wait_next_event serves.
+  enum class Dispatch
+  {
+    One,     //!< The first ready rule, in the order the rules were added (the default). With Backend::IoUring,
+             //!< every completion that has arrived is handled anyway.
+    AllReady //!< Every ready rule (up to the budget given to set_dispatch), non-fd rules first, then fd rules
+             //!< after a single poll. The next call starts after the last rule served, so none is starved.
+  };
+
+  //! Returned by each call to EventLoop::wait_next_event.
+  enum class Result
+  {
+    Success, //!< At least one Rule was triggered.
+    Timeout, //!< No rules were triggered before timeout.
+    Exit     //!< All rules have been canceled or were uninterested; make no further calls to
+             //!< EventLoop::wait_next_event.
+  };
+
+  class RuleHandle;
+
+  //! What the rules of one category have cost, since the category was added (or reset_profile())
+  struct CategoryProfile
+  {
+    std::string name {};
+    uint64_t invocations {};                  //!< callbacks run (for read and write rules, reads and writes)
+    std::chrono::nanoseconds total_time {};   //!< in those callbacks
+    std::chrono::nanoseconds max_time {};     //!< in the slowest one
+    uint64_t interest_evaluations {};         //!< calls to interest()
+    uint64_t starved {};                      //!< times a rule's fd was reported ready, but the call's budget ran
+                                              //!< out before the rule was served (Backend::Poll and Epoll)
+    uint64_t slow {};                         //!< callbacks that took longer than the watchdog allows
+  };
+
+  //! A snapshot of where a loop's time goes
+  struct Profile
+  {
+    uint64_t calls {};                       //!< to wait_next_event
+    std::chrono::nanoseconds wait_time {};   //!< in poll, epoll_wait, or waiting for io_uring completions
+    std::chrono::nanoseconds dispatch_time {}; //!< the rest: asking interest, running callbacks, bookkeeping
+    std::vector<CategoryProfile> categories {};
+  };
+
 private:
   using CallbackT = std::function<void( void )>;
   using InterestT = std::function<bool( void )>;
+  using ReadLengthT = std::function<size_t( void )>;           //!< bytes a read rule can take now
+  using ReadCallbackT = std::function<void( std::string_view )>; //!< takes the bytes read
+  using WriteSourceT = std::function<std::string_view( void )>;  //!< bytes a write rule wants written
+  using WriteCallbackT = std::function<void( size_t )>;          //!< told how many of them were written
 
-  struct RuleCategory
+  struct RuleCategory : CategoryProfile
   {
-    std::string name;
+    std::chrono::nanoseconds watchdog {}; //!< log callbacks that take longer (0: don't)
+  };
+
+  //! Rules keep their callbacks in place (see InlineFunction): added with small lambdas, a rule allocates nothing,
+  //! and calling one doesn't go through a pointer to the heap
+  using StoredCallbackT = InlineFunction<void( void )>;
+  using StoredInterestT = InlineFunction<bool( void )>;
+
+  //! The defaults for the callables of the add_rule templates
+  struct AlwaysInterested
+  {
+    bool operator()() const { return true; }
+  };
+  struct DoNothing
+  {
+    void operator()() const {}
   };
 
   struct BasicRule
   {
     size_t category_id;
-    InterestT interest;
-    CallbackT callback;
     bool cancel_requested {};
+    bool notified {};   //!< told its interest through RuleHandle::set_interest(), instead of asked by interest()
+    bool interested {}; //!< A notified rule's interest; an fd rule's result of interest() in the current call
+    bool queued {};     //!< A notified rule on Rules::changed
+    StoredInterestT interest;
+    StoredCallbackT callback;
 
-    BasicRule( size_t s_category_id, InterestT s_interest, CallbackT s_callback );
+    BasicRule( size_t s_category_id, StoredInterestT s_interest, StoredCallbackT s_callback );
   };
 
+  struct EpollRegistration;
+
   struct FDRule : public BasicRule
   {
+    // the fields every call to wait_next_event looks at come first
     FileDescriptor fd;   //!< FileDescriptor to monitor for activity.
     Direction direction; //!< Direction::In for reading from fd, Direction::Out for writing to fd.
-    CallbackT cancel;    //!< A callback that is called when the rule is cancelled (e.g. on EOF or hangup)
-    CallbackT error;     //!< A callback that is called when the fd has an error before cancellation
+    EpollRegistration* registration {}; //!< With Backend::Epoll, the registration of this rule's fd
+
+    // Backend::IoUring
+    uint64_t operation {};    //!< user_data of this rule's operation in flight, or 0 if there is none
+    bool cancel_submitted {}; //!< ... and it has been asked to stop
+    bool poll_first {};       //!< the last read or write would have blocked; wait for readiness first
+
+    StoredCallbackT cancel; //!< A callback that is called when the rule is cancelled (e.g. on EOF or hangup)
+    StoredCallbackT error;  //!< A callback that is called when the fd has an error before cancellation
 
-    FDRule( BasicRule&& base, FileDescriptor&& s_fd, Direction s_direction, CallbackT s_cancel, CallbackT s_error );
+    // Read and write rules: the loop does the I/O itself and hands over the result
+    InlineFunction<size_t( void )> read_length {};
+    InlineFunction<void( std::string_view )> on_read {};
+    InlineFunction<std::string_view( void )> write_source {};
+    InlineFunction<void( size_t )> on_written {};
+
+    FDRule( BasicRule&& base,
+            FileDescriptor&& s_fd,
+            Direction s_direction,
+            StoredCallbackT s_cancel,
+            StoredCallbackT s_error );
 
     //! Returns the number of times fd has been read or written, depending on the value of Rule::direction.
     //! \details This function is used internally by EventLoop; you will not need to call it
     unsigned int service_count() const;
+
+    FDRule( const FDRule& other ) = delete;
+    FDRule& operator=( const FDRule& other ) = delete;
+    FDRule( FDRule&& other ) = default;
+    FDRule& operator=( FDRule&& other ) = default;
+    ~FDRule() = default;
   };
 
+  //! An fd registered with epoll, shared by every rule on that fd (epoll takes each fd only once)
+  struct EpollRegistration
+  {
+    int fd;
+    uint32_t registered_events = 0; //!< events currently requested from the kernel
+    uint32_t wanted_events = 0;     //!< union of the directions of the interested rules, this call
+    uint32_t notified_events = 0;   //!< ... of the notified rules, which last until they change
+    uint32_t predicate_events = 0;  //!< wanted_events, as of the last call (so due to be looked at again)
+    bool armed = false;             //!< on _epoll_armed
+    bool always_ready = false;      //!< epoll refused the fd (e.g. a regular file); like poll, treat it as ready
+    std::vector<SlotHandle> rules {};
+  };
+
+  //! What became of an fd rule after its poll/epoll result was handled
+  enum class Outcome
+  {
+    Idle,      //!< Nothing to do for this rule
+    Served,    //!< The callback ran
+    Cancelled, //!< The rule hit an error or hangup and was cancelled; remove it
+  };
+
+  Backend _backend;
+  Dispatch _dispatch { Dispatch::One };
+  size_t _budget {}; //!< With Dispatch::AllReady, the most rules served per call (0: no limit)
   std::vector<RuleCategory> _rule_categories {};
-  std::list<std::shared_ptr<FDRule>> _fd_rules {};
-  std::list<std::shared_ptr<BasicRule>> _non_fd_rules {};
+  std::chrono::nanoseconds _watchdog {}; //!< for categories added from now on, too
+  uint64_t _calls {};
+  std::chrono::nanoseconds _wait_time {};
+  std::chrono::nanoseconds _dispatch_time {};
 
-public:
-  EventLoop() { _rule_categories.reserve( 64 ); }
+  //! The rules, each kind in a slot map (so iterating over them walks one array), and the timers. Shared so a
+  //! RuleHandle can tell whether the loop is still there.
+  struct Rules
+  {
+    SlotMap<FDRule> fd_rules {};
+    SlotMap<BasicRule> non_fd_rules {};
+    SlotMap<BasicRule> notified_rules {}; //!< the notified non-fd rules, only ever looked at through `changed`
+    TimerWheel timers {}; //!< in milliseconds since _timer_epoch
 
-  //! Returned by each call to EventLoop::wait_next_event.
-  enum class Result
+    struct Change
+    {
+      SlotHandle id;
+      bool fd_rule; //!< in fd_rules, else in notified_rules
+    };
+
+    //! Notified rules the loop must look at on its next call: their interest changed, they were cancelled, or
+    //! (with Backend::IoUring) their operation completed. A call looks at these and no other notified rules --
+    //! except that Backend::Poll, which looks at every fd rule on every call anyway, doesn't track fd rules.
+    std::vector<Change> changed {};
+    bool track_changes {};         //!< of fd rules
+    size_t notified_interested {}; //!< notified fd rules that are interested
+
+    void attend( SlotHandle id, FDRule& rule );    //!< put a notified fd rule on `changed`
+    void attend( SlotHandle id, BasicRule& rule ); //!< ... or a notified non-fd rule
+  };
+  std::shared_ptr<Rules> _rules { std::make_shared<Rules>() };
+  size_t _fd_start {};     //!< With Dispatch::AllReady, the fd rule each pass starts from, so none is starved
+  size_t _non_fd_start {}; //!< ... and the non-fd rule
+
+  std::vector<pollfd> _pollfds {}; //!< Backend::Poll: one entry per fd rule, rebuilt on each call
+
+  std::optional<FileDescriptor> _epoll {}; //!< Backend::Epoll: the epoll instance
+  std::unordered_map<int, EpollRegistration> _epoll_registrations {};
+  std::vector<EpollRegistration*> _epoll_armed {}; //!< registrations whose events may have to change
+  std::vector<epoll_event> _epoll_events {};
+  std::vector<Rules::Change> _attending {}; //!< Rules::changed, while attend_changed() goes through it
+
+  //! Backend::IoUring: the kind of operation a completion belongs to, in the low bits of its user_data
+  enum class Operation : uint8_t
   {
-    Success, //!< At least one Rule was triggered.
-    Timeout, //!< No rules were triggered before timeout.
-    Exit     //!< All rules have been canceled or were uninterested; make no further calls to
-             //!< EventLoop::wait_next_event.
+    Poll,
+    Read,
+    Write,
+    Cancel
   };
 
+  std::unique_ptr<IOUring> _uring {};
+
+  std::string _read_buffer {}; //!< read rules on the readiness backends read into this
+
+  std::chrono::steady_clock::time_point _timer_epoch { std::chrono::steady_clock::now() };
+
+  //! Tasks posted by other threads, and the eventfd that wakes the loop for them. On the heap, so the threads
+  //! that post keep a fixed place to post to.
+  struct Posted
+  {
+    MPSCQueue<InlineFunction<void( void )>> tasks {};
+    EventFD wakeup {};
+  };
+  std::unique_ptr<Posted> _posted {};
+
+  RuleHandle add_fd_rule( FDRule&& rule, FileDescriptor& fd ); //!< Check the rule's category, and add it
+  RuleHandle add_non_fd_rule( BasicRule&& rule );
+  void forget( SlotHandle id ); //!< Detach an fd rule from its epoll registration or io_uring, and erase it
+  void arm( EpollRegistration& registration ); //!< have the next epoll_wait check the registration's events
+  void renotify( EpollRegistration& registration ); //!< recompute its notified_events, and arm it
+  bool attend_changed(); //!< look at the notified fd rules on Rules::changed; true if any is interested
+  size_t serve_changed( size_t budget ); //!< serve the notified non-fd rules on Rules::changed; returns how many
+  void uring_update( FDRule& rule, SlotHandle id ); //!< submit or cancel the operation the rule's interest needs
+  Outcome handle_fd_event( FDRule& rule, int16_t events, int16_t revents );
+  Outcome handle_completion( const io_uring_cqe& cqe );
+  Outcome handle_error( FDRule& rule, int error );
+  void serve( FDRule& rule ); //!< Run the rule's callback, or the read or write of a read or write rule
+  bool interest( BasicRule& rule ); //!< Ask the rule's interest(), counting it against its category
+
+  //! Run `callback`, for a rule in `category`, and count it: its time, and a complaint if that is too long
+  template<typename Callback>
+  static void timed( RuleCategory& category, const Callback& callback );
+
+  //! Backend::Epoll: count the rules left ready when the budget ran out, from rule `first` of `events[0]` on
+  void count_starved( std::span<const epoll_event> events, size_t first );
+  void uring_submit( FDRule& rule, SlotHandle id );
+  void uring_cancel( FDRule& rule );
+  uint64_t timer_now() const; //!< the current time on the timer wheel
+  size_t advance_timers();    //!< fire the timers that are due, timing each; returns how many fired
+  Result wait_once( int timeout_ms );
+  Result wait_poll( int timeout_ms, size_t budget );
+  Result wait_epoll( int timeout_ms, size_t budget );
+  Result wait_uring( int timeout_ms, size_t budget );
+
+public:
+  explicit EventLoop( Backend backend = Backend::Poll );
+
+  //! The backend in use (Backend::IoUring falls back to Backend::Epoll where io_uring is unavailable)
+  Backend backend() const { return _backend; }
+
+  //! Choose how many ready rules each call to wait_next_event serves. With Dispatch::AllReady, `budget`
+  //! (if nonzero) caps the number of callbacks per call; rules left over are served first on the next call.
+  void set_dispatch( Dispatch dispatch, size_t budget = 0 );
+
   size_t add_category( const std::string& name );
 
-  class RuleHandle
+  //! Log (to stderr) every callback that takes longer than `budget`, naming its category. Zero turns it off.
+  void set_watchdog( std::chrono::nanoseconds budget );
+
+  //! What the loop has spent its time on, in all and by category. The counters are always kept: a callback
+  //! costs two reads of the clock more.
+  Profile profile() const;
+
+  //! Zero the counters
+  void reset_profile();
+
+  //! Write profile() as a table, the categories that took the most time first
+  void dump_profile( std::ostream& out ) const;
+
+  //! The fd and non-fd rules not cancelled yet (timers aside). A rule whose fd was closed or hit EOF counts until
+  //! the next call to wait_next_event drops it.
+  size_t rule_count() const
   {
-    std::weak_ptr<BasicRule> rule_weak_ptr_;
+    return _rules->fd_rules.size() + _rules->non_fd_rules.size() + _rules->notified_rules.size();
+  }
 
+  //! Names a rule by its slot (and the slot's generation) in the loop's rules, or a timer on its wheel
+  class RuleHandle
+  {
   public:
-    template<class RuleType>
-    explicit RuleHandle( const std::shared_ptr<RuleType> x ) : rule_weak_ptr_( x )
+    enum class Kind : uint8_t
+    {
+      FD,
+      NonFD,
+      NotifiedNonFD,
+      Timer
+    };
+
+    RuleHandle( const std::shared_ptr<Rules>& rules, Kind kind, SlotHandle rule )
+      : rules_( rules ), kind_( kind ), rule_( rule )
+    {}
+
+    RuleHandle( const std::shared_ptr<Rules>& rules, TimerWheel::TimerId timer )
+      : rules_( rules ), kind_( Kind::Timer ), timer_( timer )
     {}
 
+    //! Stop the rule. Does nothing if it is already gone, or the loop is.
     void cancel();
+
+    //! Tell a rule added with add_notified_rule() whether it is interested. Does nothing if the rule is gone,
+    //! or the loop is; throws std::runtime_error if the rule has an interest() predicate, or is a timer.
+    void set_interest( bool interested );
+
+  private:
+    friend class EventLoop;
+
+    std::weak_ptr<Rules> rules_ {};
+    Kind kind_ {};
+    SlotHandle rule_ {};
+    TimerWheel::TimerId timer_ {};
   };
 
   RuleHandle add_rule(
@@ -97,7 +368,119 @@ public:
     const CallbackT& callback,
     const InterestT& interest = [] { return true; } );
 
-  //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
+  //! The same as add_rule() above, but the callables are kept as they are, in the rule itself, instead of being
+  //! copied into std::function objects (see InlineFunction). Lambdas that capture a few references cost no
+  //! allocation, and the loop calls them without following a pointer to the heap.
+  template<std::invocable Callback,
+           std::predicate Interest = AlwaysInterested,
+           std::invocable Cancel = DoNothing,
+           std::invocable Error = DoNothing>
+  RuleHandle add_rule( size_t category_id,
+                       FileDescriptor& fd,
+                       Direction direction,
+                       Callback&& callback,
+                       Interest&& interest = {},
+                       Cancel&& cancel = {},
+                       Error&& error = {} )
+  {
+    return add_fd_rule( FDRule { BasicRule { category_id,
+                                             std::forward<Interest>( interest ),
+                                             std::forward<Callback>( callback ) },
+                                 fd.duplicate(),
+                                 direction,
+                                 std::forward<Cancel>( cancel ),
+                                 std::forward<Error>( error ) },
+                        fd );
+  }
+
+  template<std::invocable Callback, std::predicate Interest = AlwaysInterested>
+  RuleHandle add_rule( size_t category_id, Callback&& callback, Interest&& interest = {} )
+  {
+    return add_non_fd_rule(
+      BasicRule { category_id, std::forward<Interest>( interest ), std::forward<Callback>( callback ) } );
+  }
+
+  //! A rule that is told whether it is interested instead of asked: it starts out uninterested, and stays as
+  //! RuleHandle::set_interest() last set it. The loop never calls a predicate for it; unless the backend is
+  //! Backend::Poll, a call to wait_next_event doesn't look at the rule at all unless its interest changed or its
+  //! fd is ready. Its callback should set_interest( false ) once it wants no more, as an interest() predicate
+  //! would turn false. EOF and errors cancel the rule as for other fd rules, though one whose fd is closed by
+  //! other code is only noticed when its interest next changes.
+  template<std::invocable Callback, std::invocable Cancel = DoNothing, std::invocable Error = DoNothing>
+  RuleHandle add_notified_rule( size_t category_id,
+                                FileDescriptor& fd,
+                                Direction direction,
+                                Callback&& callback,
+                                Cancel&& cancel = {},
+                                Error&& error = {} )
+  {
+    BasicRule base { category_id, AlwaysInterested {}, std::forward<Callback>( callback ) };
+    base.notified = true;
+    return add_fd_rule( FDRule { std::move( base ),
+                                 fd.duplicate(),
+                                 direction,
+                                 std::forward<Cancel>( cancel ),
+                                 std::forward<Error>( error ) },
+                        fd );
+  }
+
+  //! A notified rule with no fd: once set interested, the next call to wait_next_event runs its callback until it
+  //! sets its interest to false. Calls don't look at the rule while it is uninterested, with any backend.
+  template<std::invocable Callback>
+  RuleHandle add_notified_rule( size_t category_id, Callback&& callback )
+  {
+    BasicRule base { category_id, AlwaysInterested {}, std::forward<Callback>( callback ) };
+    base.notified = true;
+    return add_non_fd_rule( std::move( base ) );
+  }
+
+  //! Let other threads post() tasks to this loop: adds a rule, in a category of its own ("posted tasks"), that
+  //! runs them when they arrive. Call it before the loop runs, or on its thread; calling it again does nothing.
+  //! The rule is never cancelled, so from then on wait_next_event doesn't return Result::Exit.
+  void accept_posts();
+
+  //! Have `task` run on the loop's thread, by a coming call to wait_next_event. Any thread may post, while other
+  //! threads do, without taking a lock (each post allocates one node of a lock-free queue). Tasks posted by one
+  //! thread run in the order they were posted. Only a post that finds the queue empty wakes the loop, so a burst
+  //! of posts costs one wakeup. If a task throws, wait_next_event passes the exception on, and the tasks after it
+  //! run on a later call. Throws std::runtime_error if the loop doesn't accept_posts().
+  void post( InlineFunction<void( void )> task );
+
+  //! A rule that reads from `fd` whenever `read_length` is nonzero, at most that many bytes, and passes what it
+  //! read to `on_read`. With Backend::IoUring the read is done by the kernel into a registered buffer; otherwise
+  //! the loop reads when `fd` is readable. EOF, errors and cancellation work as for other fd rules.
+  RuleHandle add_read_rule(
+    size_t category_id,
+    FileDescriptor& fd,
+    const ReadLengthT& read_length,
+    const ReadCallbackT& on_read,
+    const CallbackT& cancel = [] {},
+    const CallbackT& error = [] {} );
+
+  //! A rule that writes the bytes `write_source` returns to `fd` whenever there are any, and tells
+  //! `on_written` how many were written. Until then, `write_source` must keep returning the same bytes first.
+  //! With Backend::IoUring they are copied into a registered buffer and written by the kernel.
+  RuleHandle add_write_rule(
+    size_t category_id,
+    FileDescriptor& fd,
+    const WriteSourceT& write_source,
+    const WriteCallbackT& on_written,
+    const CallbackT& cancel = [] {},
+    const CallbackT& error = [] {} );
+
+  //! A rule that calls `callback` once, `delay` from now (to the millisecond, never early) -- or, with a nonzero
+  //! `period`, then again every `period` until cancelled. Pending timers keep wait_next_event from returning
+  //! Result::Exit, and it waits no longer than until the next one is due. Adding and cancelling a timer take
+  //! constant time, however many are pending.
+  RuleHandle add_timer( size_t category_id,
+                        std::chrono::milliseconds delay,
+                        CallbackT callback,
+                        std::chrono::milliseconds period = std::chrono::milliseconds::zero() );
+
+  //! Calls [poll(2)](\ref man2::poll) or [epoll_wait(2)](\ref man2::epoll_wait), depending on the backend,
+  //! and then executes the callback for a ready fd. With Backend::IoUring, submits the operations the
+  //! interested rules need, waits for completions, and handles every completion that has arrived.
+  //! Timers that are due fire first, and don't count as the one rule Dispatch::One serves.
   Result wait_next_event( int timeout_ms );
 
   // convenience function to add category and rule at the same time
@@ -0,0 +1,163 @@
+#include "eventloop_pool.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
+#include <utility>
+
+using namespace std;
+
+namespace {
+// The CPUs this process may run on
+vector<int> allowed_cpus()
+{
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  CheckSystemCall( "sched_getaffinity", sched_getaffinity( 0, sizeof( set ), &set ) );
+  vector<int> cpus;
+  for ( int cpu = 0; cpu < CPU_SETSIZE; ++cpu ) {
+    if ( CPU_ISSET( cpu, &set ) ) {
+      cpus.push_back( cpu );
+    }
+  }
+  return cpus;
+}
+
+void pin_to( const int cpu )
+{
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  CPU_SET( cpu, &set );
+  const int error = pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+  if ( error ) {
+    throw unix_error { "pthread_setaffinity_np", error };
+  }
+}
+} // namespace
+
+EventLoopPool::EventLoopPool( const Address& address, ConnectionHandler handler, const Options& options )
+  : handler_( move( handler ) ), handoff_( options.handoff ), handoff_margin_( options.handoff_margin )
+{
+  const vector<int> cpus = allowed_cpus();
+  const size_t threads = options.threads ? options.threads : max( cpus.size(), size_t { 1 } );
+
+  // every listener must be bound to the same port, so the first one's (if the kernel picked it) goes to the rest
+  optional<Address> bound;
+  for ( size_t i = 0; i < threads; ++i ) {
+    auto worker = make_unique<Worker>( options.backend );
+    worker->listener.set_reuseaddr();
+    worker->listener.set_reuseport();
+    worker->listener.bind( bound.value_or( address ) );
+    worker->listener.listen( options.backlog );
+    worker->loop.accept_posts(); // before any thread can post to it
+    if ( not bound ) {
+      bound = worker->listener.local_address();
+    }
+    workers_.push_back( move( worker ) );
+  }
+
+  // only once every listener is up, so no loop starts taking connections the kernel can't spread yet
+  try {
+    for ( size_t i = 0; i < threads; ++i ) {
+      const int cpu = options.pin and not cpus.empty() ? cpus[i % cpus.size()] : -1;
+      workers_[i]->thread = thread( [this, &worker = *workers_[i], cpu] { run( worker, cpu ); } );
+    }
+  } catch ( ... ) {
+    wake_all();
+    join();
+    throw;
+  }
+}
+
+Address EventLoopPool::local_address() const
+{
+  return workers_.front()->listener.local_address();
+}
+
+void EventLoopPool::run( Worker& worker, const int cpu )
+{
+  try {
+    if ( cpu >= 0 ) {
+      pin_to( cpu );
+    }
+
+    worker.loop.add_rule( "accept connection", worker.listener, Direction::In, [&] { accept( worker ); } );
+
+    while ( not stopping_.load( memory_order_acquire ) ) {
+      worker.loop.wait_next_event( -1 );
+      worker.load.store( worker.loop.rule_count(), memory_order_relaxed );
+    }
+  } catch ( ... ) {
+    {
+      const lock_guard lock { error_mutex_ };
+      if ( not error_ ) {
+        error_ = current_exception();
+      }
+    }
+    wake_all();
+  }
+}
+
+void EventLoopPool::accept( Worker& worker )
+{
+  TCPSocket connection = worker.listener.accept();
+
+  if ( handoff_ ) {
+    const auto load = []( const Worker& w ) { return w.load.load( memory_order_relaxed ); };
+    Worker& target = **min_element(
+      workers_.begin(), workers_.end(), [&]( const auto& a, const auto& b ) { return load( *a ) < load( *b ); } );
+    if ( load( worker ) > load( target ) + handoff_margin_ ) {
+      // count the connection against the target at once, so a burst isn't all sent the same way before it
+      // reports its load
+      target.load.fetch_add( 1, memory_order_relaxed );
+      target.loop.post(
+        [this, &target, passed = move( connection )]() mutable { serve( target, move( passed ) ); } );
+      handoffs_.fetch_add( 1, memory_order_relaxed );
+      return;
+    }
+  }
+
+  serve( worker, move( connection ) );
+}
+
+void EventLoopPool::serve( Worker& worker, TCPSocket&& connection )
+{
+  handler_( worker.loop, move( connection ) );
+  worker.load.store( worker.loop.rule_count(), memory_order_relaxed );
+}
+
+void EventLoopPool::wake_all()
+{
+  stopping_.store( true, memory_order_release );
+  for ( const auto& worker : workers_ ) {
+    worker->loop.post( [] {} ); // just to wake it
+  }
+}
+
+void EventLoopPool::join()
+{
+  for ( const auto& worker : workers_ ) {
+    if ( worker->thread.joinable() ) {
+      worker->thread.join();
+    }
+  }
+}
+
+void EventLoopPool::stop()
+{
+  wake_all();
+  join();
+
+  const lock_guard lock { error_mutex_ };
+  if ( error_ ) {
+    rethrow_exception( exchange( error_, nullptr ) );
+  }
+}
+
+EventLoopPool::~EventLoopPool()
+{
+  wake_all();
+  join();
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "address.hh"
+#include "eventloop.hh"
+#include "socket.hh"
+
+//! A server runtime: one EventLoop per thread, each thread pinned to a CPU, and each loop with a listening
+//! TCPSocket of its own on the same address (bound with SO_REUSEPORT), so the kernel shards incoming connections
+//! across the loops and accepting one takes no lock. Each connection is passed to a handler, on the thread of the
+//! loop that is to serve it, to add the rules for it to that loop.
+//!
+//! The kernel spreads connections evenly, not by how busy the loops are. With Options::handoff, a loop that
+//! accepts a connection while it has more than Options::handoff_margin rules beyond the least busy loop passes
+//! the connection over to that loop instead, posting it there (see EventLoop::post()).
+class EventLoopPool
+{
+public:
+  //! Called on a pool thread with each new connection (as accept() returns it) and the loop that serves it.
+  //! Several threads call it at once, each with its own loop, so anything it shares must be thread-safe.
+  using ConnectionHandler = std::function<void( EventLoop& loop, TCPSocket&& connection )>;
+
+  struct Options
+  {
+    size_t threads {}; //!< loops (and threads) to run; 0 for one per CPU this process may run on
+    bool pin { true }; //!< pin each thread to one CPU (taking the CPUs in turn if there are more threads)
+    bool handoff {};   //!< pass connections from a busy loop to the least busy one...
+    size_t handoff_margin { 64 }; //!< ... when the busy one has more than this many rules beyond it
+    EventLoop::Backend backend { EventLoop::Backend::Epoll };
+    int backlog { 1024 }; //!< of each listener
+  };
+
+  //! Bind a listener for each loop to `address` (if its port is 0, one is picked, the same for every loop), and
+  //! start the threads
+  EventLoopPool( const Address& address, ConnectionHandler handler, const Options& options );
+
+  Address local_address() const; //!< where the pool listens
+  size_t size() const { return workers_.size(); }
+  size_t handoffs() const { return handoffs_.load( std::memory_order_relaxed ); } //!< connections passed over
+
+  //! Stop every loop and join the threads. Rethrows the first exception that escaped a loop (including one thrown
+  //! by the handler), which stops the whole pool.
+  void stop();
+
+  ~EventLoopPool(); //!< stop(), but any exception is dropped
+
+  EventLoopPool( const EventLoopPool& other ) = delete;
+  EventLoopPool& operator=( const EventLoopPool& other ) = delete;
+
+private:
+  struct Worker
+  {
+    EventLoop loop;
+    TCPSocket listener {};
+    std::atomic<size_t> load {}; //!< the loop's rules, as of its last event
+
+    std::thread thread {};
+
+    explicit Worker( EventLoop::Backend backend ) : loop( backend ) {}
+  };
+
+  ConnectionHandler handler_;
+  bool handoff_;
+  size_t handoff_margin_;
+  std::vector<std::unique_ptr<Worker>> workers_ {};
+  std::atomic<bool> stopping_ {};
+  std::atomic<size_t> handoffs_ {};
+
+  std::mutex error_mutex_ {};
+  std::exception_ptr error_ {};
+
+  void run( Worker& worker, int cpu ); //!< the body of a worker's thread (`cpu` is -1 to leave it unpinned)
+  void accept( Worker& worker );
+  void serve( Worker& worker, TCPSocket&& connection ); //!< pass a connection to the handler, on its loop
+  void wake_all(); //!< ask every loop to stop (any thread)
+  void join();
+};
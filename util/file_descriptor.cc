@@ -3,8 +3,10 @@
 #include "exception.hh"
 
 #include <algorithm>
+#include <climits>
 #include <fcntl.h>
 #include <iostream>
+#include <span>
 #include <stdexcept>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -108,6 +110,33 @@ void FileDescriptor::read( string& buffer )
   buffer.resize( bytes_read );
 }
 
+size_t FileDescriptor::read( span<char> buffer )
+{
+  if ( buffer.empty() ) {
+    return 0; // a zero-length read would look like EOF
+  }
+
+  const ssize_t bytes_read = ::read( fd_num(), buffer.data(), buffer.size() );
+  if ( bytes_read < 0 ) {
+    if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
+      return 0;
+    }
+    throw unix_error { "read" };
+  }
+
+  register_read();
+
+  if ( bytes_read == 0 ) {
+    internal_fd_->eof_ = true;
+  }
+
+  if ( bytes_read > static_cast<ssize_t>( buffer.size() ) ) {
+    throw runtime_error( "read() read more than requested" );
+  }
+
+  return bytes_read;
+}
+
 void FileDescriptor::read( vector<string>& buffers )
 {
   if ( buffers.empty() ) {
@@ -150,6 +179,14 @@ void FileDescriptor::read( vector<string>& buffers )
   }
 }
 
+void FileDescriptor::record_read( size_t bytes_read )
+{
+  register_read();
+  if ( bytes_read == 0 ) {
+    internal_fd_->eof_ = true;
+  }
+}
+
 size_t FileDescriptor::write( string_view buffer )
 {
   return write( vector<string_view> { buffer } );
@@ -167,10 +204,13 @@ size_t FileDescriptor::write( const vector<std::string>& buffers )
 
 size_t FileDescriptor::write( const vector<string_view>& buffers )
 {
+  // writev() accepts at most IOV_MAX buffers; any beyond that are left for the next write
+  const size_t count = min( buffers.size(), static_cast<size_t>( IOV_MAX ) );
+
   vector<iovec> iovecs;
-  iovecs.reserve( buffers.size() );
+  iovecs.reserve( count );
   size_t total_size = 0;
-  for ( const auto x : buffers ) {
+  for ( const auto x : span( buffers ).first( count ) ) {
     iovecs.push_back( { const_cast<char*>( x.data() ), x.size() } ); // NOLINT(*-const-cast)
     total_size += x.size();
   }
@@ -190,6 +230,36 @@ size_t FileDescriptor::write( const vector<string_view>& buffers )
   return bytes_written;
 }
 
+size_t FileDescriptor::splice_to( FileDescriptor& destination, size_t len )
+{
+  if ( len == 0 ) {
+    return 0; // a zero-length splice would look like EOF
+  }
+
+  // SPLICE_F_NONBLOCK makes the pipe side non-blocking; the other side follows its own O_NONBLOCK flag
+  const ssize_t bytes_spliced
+    = ::splice( fd_num(), nullptr, destination.fd_num(), nullptr, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+  if ( bytes_spliced < 0 ) {
+    if ( errno == EAGAIN ) {
+      return 0;
+    }
+    throw unix_error { "splice" };
+  }
+
+  register_read();
+  destination.register_write();
+
+  if ( bytes_spliced == 0 ) {
+    internal_fd_->eof_ = true;
+  }
+
+  if ( bytes_spliced > static_cast<ssize_t>( len ) ) {
+    throw runtime_error( "splice() moved more than requested" );
+  }
+
+  return bytes_spliced;
+}
+
 void FileDescriptor::set_blocking( bool blocking )
 {
   int flags = CheckSystemCall( "fcntl", fcntl( fd_num(), F_GETFL ) ); // NOLINT(*-vararg)
@@ -3,6 +3,7 @@
 #include <cstddef>
 #include <limits>
 #include <memory>
+#include <span>
 #include <vector>
 
 // A reference-counted handle to a file descriptor
@@ -65,12 +66,24 @@ public:
   void read( std::string& buffer );
   void read( std::vector<std::string>& buffers );
 
-  // Attempt to write a buffer
+  // Read into caller-owned memory (e.g. Writer::reserve()); returns number of bytes read
+  size_t read( std::span<char> buffer );
+
+  // Attempt to write a buffer (or, with writev, a series of buffers)
   // returns number of bytes written
   size_t write( std::string_view buffer );
   size_t write( const std::vector<std::string_view>& buffers );
   size_t write( const std::vector<std::string>& buffers );
 
+  // Move up to `len` bytes to `destination` inside the kernel with splice(2); one of the two must be a pipe.
+  // Returns number of bytes moved (0 if either side would block). Throws unix_error (EINVAL) if unsupported.
+  size_t splice_to( FileDescriptor& destination, size_t len );
+
+  // Account for a read or write done on this fd by someone else (e.g. completed by io_uring): bumps the
+  // read or write count, and, as in read(), a 0-byte read means EOF
+  void record_read( size_t bytes_read );
+  void record_write() { register_write(); }
+
   // Close the underlying file descriptor
   void close() { internal_fd_->close(); }
 
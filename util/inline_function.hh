@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template<typename Signature, size_t Capacity = 32>
+class InlineFunction;
+
+//! A callable with the signature `R( Args... )`, like std::function, but kept in place: a callable of up to
+//! `Capacity` bytes (whose move can't throw) lives inside the InlineFunction itself, so wrapping a lambda that
+//! captures a few references allocates nothing, and calling it is one call through a function pointer with no
+//! pointer to follow to the callable. Larger callables fall back to the heap.
+//!
+//! Move-only: a callable is moved in, never copied. Moving one that is trivially copyable (as a lambda capturing
+//! only references and pointers is) just copies its bytes. Calling an empty InlineFunction is undefined.
+template<typename R, typename... Args, size_t Capacity>
+class InlineFunction<R( Args... ), Capacity>
+{
+public:
+  InlineFunction() = default;
+  InlineFunction( std::nullptr_t ) {} // NOLINT(*-explicit-*)
+
+  template<typename F>
+    requires( not std::same_as<std::remove_cvref_t<F>, InlineFunction>
+              and std::is_invocable_r_v<R, std::decay_t<F>&, Args...> )
+  InlineFunction( F&& f ) // NOLINT(*-explicit-*)
+  {
+    using Callable = std::decay_t<F>;
+    if constexpr ( stored_inline<Callable> ) {
+      ::new ( storage_.data() ) Callable( std::forward<F>( f ) );
+      invoke_ = []( void* storage, Args&&... args ) -> R {
+        return std::invoke( *static_cast<Callable*>( storage ), std::forward<Args>( args )... );
+      };
+      if constexpr ( not std::is_trivially_copyable_v<Callable> ) {
+        manage_ = []( void* destination, void* source ) {
+          auto* const callable = static_cast<Callable*>( source );
+          if ( destination ) {
+            ::new ( destination ) Callable( std::move( *callable ) );
+          }
+          callable->~Callable();
+        };
+      }
+    } else {
+      ::new ( storage_.data() ) Callable*( new Callable( std::forward<F>( f ) ) );
+      invoke_ = []( void* storage, Args&&... args ) -> R {
+        return std::invoke( **static_cast<Callable**>( storage ), std::forward<Args>( args )... );
+      };
+      manage_ = []( void* destination, void* source ) {
+        auto** const callable = static_cast<Callable**>( source );
+        if ( destination ) {
+          ::new ( destination ) Callable*( *callable );
+        } else {
+          delete *callable;
+        }
+      };
+    }
+  }
+
+  InlineFunction( InlineFunction&& other ) noexcept { take( other ); }
+
+  InlineFunction& operator=( InlineFunction&& other ) noexcept
+  {
+    if ( this != &other ) {
+      reset();
+      take( other );
+    }
+    return *this;
+  }
+
+  InlineFunction& operator=( std::nullptr_t )
+  {
+    reset();
+    return *this;
+  }
+
+  InlineFunction( const InlineFunction& other ) = delete;
+  InlineFunction& operator=( const InlineFunction& other ) = delete;
+
+  ~InlineFunction() { reset(); }
+
+  explicit operator bool() const { return invoke_ != nullptr; }
+
+  R operator()( Args... args ) const { return invoke_( storage_.data(), std::forward<Args>( args )... ); }
+
+private:
+  using Invoke = R ( * )( void*, Args&&... );
+  using Manage = void ( * )( void* destination, void* source ); //!< move `source` to `destination` (or nowhere)
+
+  template<typename Callable>
+  static constexpr bool stored_inline = sizeof( Callable ) <= Capacity
+                                        and alignof( Callable ) <= alignof( std::max_align_t )
+                                        and std::is_nothrow_move_constructible_v<Callable>;
+
+  alignas( std::max_align_t ) mutable std::array<std::byte, Capacity> storage_ {};
+  Invoke invoke_ {};
+  Manage manage_ {}; //!< null if the callable is trivially copyable (and destructible)
+
+  void reset()
+  {
+    if ( manage_ ) {
+      manage_( nullptr, storage_.data() );
+    }
+    invoke_ = nullptr;
+    manage_ = nullptr;
+  }
+
+  void take( InlineFunction& other )
+  {
+    if ( other.manage_ ) {
+      other.manage_( storage_.data(), other.storage_.data() );
+    } else {
+      storage_ = other.storage_;
+    }
+    invoke_ = std::exchange( other.invoke_, nullptr );
+    manage_ = std::exchange( other.manage_, nullptr );
+  }
+};
@@ -0,0 +1,207 @@
+#include "io_uring.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+// The kernel reads and writes the ring indices concurrently with us
+uint32_t load_acquire( uint32_t* index )
+{
+  return atomic_ref<uint32_t>( *index ).load( memory_order_acquire );
+}
+
+void store_release( uint32_t* index, uint32_t value )
+{
+  atomic_ref<uint32_t>( *index ).store( value, memory_order_release );
+}
+} // namespace
+
+IOUring::Mapping::Mapping( int fd, size_t length, uint64_t offset ) : size( length )
+{
+  void* const map = fd < 0 ? mmap( nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 )
+                           : mmap( nullptr,
+                                   length,
+                                   PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE,
+                                   fd,
+                                   static_cast<off_t>( offset ) );
+  if ( map == MAP_FAILED ) {
+    throw unix_error( "mmap" );
+  }
+  base = static_cast<char*>( map );
+}
+
+IOUring::Mapping::~Mapping()
+{
+  munmap( base, size );
+}
+
+int IOUring::setup( unsigned entries, io_uring_params& params )
+{
+  // let completions wait for our next io_uring_enter instead of interrupting us; older kernels refuse the flag
+  params = {};
+  params.flags = IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SUBMIT_ALL;
+  long fd = syscall( __NR_io_uring_setup, entries, &params );
+  if ( fd < 0 and errno == EINVAL ) {
+    params = {};
+    fd = syscall( __NR_io_uring_setup, entries, &params );
+  }
+  return CheckSystemCall( "io_uring_setup", static_cast<int>( fd ) );
+}
+
+IOUring::IOUring( unsigned entries, unsigned buffer_count, size_t buffer_size )
+  : params_()
+  , ring_fd_( setup( entries, params_ ) )
+  , rings_( ring_fd_.fd_num(),
+            max( params_.sq_off.array + params_.sq_entries * sizeof( uint32_t ),
+                 params_.cq_off.cqes + params_.cq_entries * sizeof( io_uring_cqe ) ),
+            IORING_OFF_SQ_RING )
+  , sqes_( ring_fd_.fd_num(), params_.sq_entries * sizeof( io_uring_sqe ), IORING_OFF_SQES )
+  , buffer_size_( buffer_size )
+  , buffer_count_( buffer_count )
+  , buffers_( -1, 2 * buffer_count * buffer_size, 0 )
+  , buffer_ring_( -1, buffer_count * sizeof( io_uring_buf ), 0 )
+  , sq_mask_( *rings_.at<uint32_t>( params_.sq_off.ring_mask ) )
+  , cq_mask_( *rings_.at<uint32_t>( params_.cq_off.ring_mask ) )
+{
+  constexpr uint32_t needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+  if ( ( params_.features & needed ) != needed ) {
+    throw runtime_error( "io_uring: kernel is missing required features" );
+  }
+
+  // entry i of the submission array always names submission entry i
+  for ( uint32_t i = 0; i < params_.sq_entries; ++i ) {
+    rings_.at<uint32_t>( params_.sq_off.array )[i] = i; // NOLINT(*-pointer-arithmetic)
+  }
+
+  vector<iovec> fixed;
+  for ( uint16_t i = 0; i < buffer_count_; ++i ) {
+    const auto buffer = fixed_buffer( i );
+    fixed.push_back( { buffer.data(), buffer.size() } );
+    free_fixed_buffers_.push_back( buffer_count_ - 1 - i );
+  }
+  const long registered
+    = syscall( __NR_io_uring_register, ring_fd_.fd_num(), IORING_REGISTER_BUFFERS, fixed.data(), buffer_count_ );
+  CheckSystemCall( "io_uring_register(BUFFERS)", static_cast<int>( registered ) );
+
+  io_uring_buf_reg ring {};
+  ring.ring_addr = reinterpret_cast<uint64_t>( buffer_ring_.base ); // NOLINT(*-reinterpret-cast)
+  ring.ring_entries = buffer_count_;
+  ring.bgid = kProvidedGroup;
+  CheckSystemCall(
+    "io_uring_register(PBUF_RING)",
+    static_cast<int>( syscall( __NR_io_uring_register, ring_fd_.fd_num(), IORING_REGISTER_PBUF_RING, &ring, 1 ) ) );
+  for ( uint16_t id = 0; id < buffer_count_; ++id ) {
+    recycle_provided_buffer( id );
+  }
+}
+
+IOUring::~IOUring()
+{
+  // tear down the ring (cancelling what is in flight) before the buffers it may still use are unmapped
+  ring_fd_.close();
+}
+
+io_uring_sqe& IOUring::next_sqe()
+{
+  if ( sq_tail_ - load_acquire( rings_.at<uint32_t>( params_.sq_off.head ) ) >= params_.sq_entries ) {
+    submit( 0, 0 );
+  }
+
+  io_uring_sqe& sqe = sqes_.at<io_uring_sqe>( 0 )[sq_tail_ & sq_mask_]; // NOLINT(*-pointer-arithmetic)
+  sqe = {};
+  ++sq_tail_;
+  return sqe;
+}
+
+io_uring_sqe& IOUring::last_sqe()
+{
+  return sqes_.at<io_uring_sqe>( 0 )[( sq_tail_ - 1 ) & sq_mask_]; // NOLINT(*-pointer-arithmetic)
+}
+
+void IOUring::submit( unsigned wait_nr, int timeout_ms )
+{
+  store_release( rings_.at<uint32_t>( params_.sq_off.tail ), sq_tail_ );
+  const unsigned to_submit = sq_tail_ - load_acquire( rings_.at<uint32_t>( params_.sq_off.head ) );
+
+  __kernel_timespec timeout { timeout_ms / 1000, ( timeout_ms % 1000 ) * 1000000L };
+  io_uring_getevents_arg arg {};
+  arg.sigmask_sz = _NSIG / 8;
+  arg.ts = timeout_ms < 0 ? 0 : reinterpret_cast<uint64_t>( &timeout ); // NOLINT(*-reinterpret-cast)
+
+  const unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0;
+  const long ret = syscall( __NR_io_uring_enter,
+                            ring_fd_.fd_num(),
+                            to_submit,
+                            wait_nr,
+                            flags,
+                            wait_nr ? &arg : nullptr,
+                            wait_nr ? sizeof( arg ) : 0 );
+
+  // timing out, a signal and a full completion ring all leave the caller to reap what is there
+  if ( ret < 0 and errno != ETIME and errno != EINTR and errno != EBUSY and errno != EAGAIN ) {
+    throw unix_error( "io_uring_enter" );
+  }
+}
+
+bool IOUring::next_completion( io_uring_cqe& cqe )
+{
+  uint32_t* const head = rings_.at<uint32_t>( params_.cq_off.head );
+  const uint32_t index = *head;
+  if ( index == load_acquire( rings_.at<uint32_t>( params_.cq_off.tail ) ) ) {
+    return false;
+  }
+
+  cqe = rings_.at<io_uring_cqe>( params_.cq_off.cqes )[index & cq_mask_]; // NOLINT(*-pointer-arithmetic)
+  store_release( head, index + 1 );
+  return true;
+}
+
+optional<uint16_t> IOUring::take_fixed_buffer()
+{
+  if ( free_fixed_buffers_.empty() ) {
+    return {};
+  }
+  const uint16_t index = free_fixed_buffers_.back();
+  free_fixed_buffers_.pop_back();
+  return index;
+}
+
+void IOUring::release_fixed_buffer( uint16_t index )
+{
+  free_fixed_buffers_.push_back( index );
+}
+
+span<char> IOUring::fixed_buffer( uint16_t index )
+{
+  return { buffers_.base + index * buffer_size_, buffer_size_ }; // NOLINT(*-pointer-arithmetic)
+}
+
+span<char> IOUring::provided_buffer( uint16_t id )
+{
+  return fixed_buffer( buffer_count_ + id );
+}
+
+void IOUring::recycle_provided_buffer( uint16_t id )
+{
+  const auto buffer = provided_buffer( id );
+  const uint16_t slot = buffer_ring_tail_ & ( buffer_count_ - 1 );
+  auto& entry = buffer_ring_.at<io_uring_buf>( 0 )[slot]; // NOLINT(*-pointer-arithmetic)
+  entry.addr = reinterpret_cast<uint64_t>( buffer.data() ); // NOLINT(*-reinterpret-cast)
+  entry.len = static_cast<uint32_t>( buffer.size() );
+  entry.bid = id;
+
+  // the tail shares its place with the first entry's reserved field
+  ++buffer_ring_tail_;
+  atomic_ref<uint16_t> tail { buffer_ring_.at<io_uring_buf_ring>( 0 )->tail };
+  tail.store( buffer_ring_tail_, memory_order_release );
+}
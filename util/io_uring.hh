@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "file_descriptor.hh"
+
+//! An [io_uring(7)](\ref man7::io_uring) instance driven through the raw system calls: a submission ring, a
+//! completion ring, and two pools of buffers known to the kernel.
+//!
+//! - *Fixed buffers* are registered with IORING_REGISTER_BUFFERS and used for IORING_OP_WRITE_FIXED. One is
+//!   taken for each write and given back when the write completes.
+//! - *Provided buffers* form a buffer ring (IORING_REGISTER_PBUF_RING) that reads select from with
+//!   IOSQE_BUFFER_SELECT. The kernel picks one only when data arrives, so a read that is waiting holds no
+//!   memory. The completion names the buffer, which goes back to the ring with recycle_provided_buffer().
+class IOUring
+{
+public:
+  //! Buffer group of the provided buffers, for io_uring_sqe::buf_group
+  static constexpr uint16_t kProvidedGroup = 0;
+
+  //! Set up a ring with `entries` submission entries and `buffer_count` buffers of `buffer_size` bytes in each
+  //! pool. `entries` and `buffer_count` must be powers of two.
+  //! \throws unix_error if the kernel refuses io_uring, runtime_error if it lacks a feature this class needs
+  IOUring( unsigned entries, unsigned buffer_count, size_t buffer_size );
+  ~IOUring();
+
+  //! A zeroed submission entry to fill in; it goes to the kernel with the next submit(). If the ring is
+  //! full, the pending entries are submitted first.
+  io_uring_sqe& next_sqe();
+  io_uring_sqe& last_sqe(); //!< the entry next_sqe() returned most recently
+
+  //! Submit the pending entries, then wait for at least `wait_nr` completions or until `timeout_ms`
+  //! milliseconds pass (a negative timeout waits indefinitely).
+  void submit( unsigned wait_nr, int timeout_ms );
+
+  //! Take the oldest completion off the completion ring into `cqe`; returns false if there was none.
+  bool next_completion( io_uring_cqe& cqe );
+
+  //! Fixed buffers: the index of a free one (for io_uring_sqe::buf_index), if any.
+  std::optional<uint16_t> take_fixed_buffer();
+  void release_fixed_buffer( uint16_t index );
+  std::span<char> fixed_buffer( uint16_t index );
+
+  //! Provided buffers: the memory of buffer `id` (from the completion flags), and handing it back to the kernel.
+  std::span<char> provided_buffer( uint16_t id );
+  void recycle_provided_buffer( uint16_t id );
+
+  size_t buffer_size() const { return buffer_size_; }
+
+  IOUring( const IOUring& other ) = delete;
+  IOUring& operator=( const IOUring& other ) = delete;
+  IOUring( IOUring&& other ) = delete;
+  IOUring& operator=( IOUring&& other ) = delete;
+
+private:
+  //! An mmap(2)ed region, unmapped on destruction
+  struct Mapping
+  {
+    char* base {};
+    size_t size {};
+
+    Mapping( int fd, size_t length, uint64_t offset ); //!< map `length` bytes of `fd` (or anonymous memory if -1)
+    ~Mapping();
+
+    template<typename T>
+    T* at( uint32_t offset ) const
+    {
+      return reinterpret_cast<T*>( base + offset ); // NOLINT(*-reinterpret-cast, *-pointer-arithmetic)
+    }
+
+    Mapping( const Mapping& other ) = delete;
+    Mapping& operator=( const Mapping& other ) = delete;
+    Mapping( Mapping&& other ) = delete;
+    Mapping& operator=( Mapping&& other ) = delete;
+  };
+
+  io_uring_params params_;
+  FileDescriptor ring_fd_;
+  Mapping rings_;         //!< submission and completion rings (IORING_FEAT_SINGLE_MMAP)
+  Mapping sqes_;          //!< submission entries
+  size_t buffer_size_;    //!< size of each buffer, in both pools
+  unsigned buffer_count_; //!< number of buffers in each pool
+  Mapping buffers_;       //!< the fixed buffers, followed by the provided buffers
+  Mapping buffer_ring_;   //!< the provided buffer ring's entries
+
+  uint32_t sq_mask_;
+  uint32_t cq_mask_;
+  uint32_t sq_tail_ {}; //!< next submission entry to fill (published to the kernel on submit())
+  uint16_t buffer_ring_tail_ {};
+  std::vector<uint16_t> free_fixed_buffers_ {};
+
+  static int setup( unsigned entries, io_uring_params& params );
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+//! A lock-free queue for any number of producer threads and one consumer thread.
+//!
+//! The producers push onto a stack, each with one compare-and-swap. The consumer takes the whole stack at once
+//! with one exchange, and reverses it to run the values in the order they were pushed (by each producer; the
+//! order between producers is whatever their pushes raced to). Since the consumer never takes one node at a
+//! time, there is no ABA problem. push() tells whether the queue was empty, so a producer can wake the consumer
+//! once per burst instead of once per value.
+template<typename T>
+class MPSCQueue
+{
+public:
+  MPSCQueue() = default;
+
+  //! Add a value (any thread). Returns true if the queue was empty -- the consumer may be waiting.
+  bool push( T value )
+  {
+    auto* const node = new Node { std::move( value ), nullptr };
+    Node* previous = head_.load( std::memory_order_relaxed );
+    do {
+      node->next = previous;
+    } while ( not head_.compare_exchange_weak(
+      previous, node, std::memory_order_release, std::memory_order_relaxed ) );
+    return previous == nullptr; // not node->next: once pushed, the node may already be consumed
+  }
+
+  //! Take every value pushed so far, oldest first, and pass each to `consume` (the consumer thread only).
+  //! If `consume` throws, the values not yet consumed stay first in line for the next call. Returns the number
+  //! consumed.
+  template<typename Consume>
+  size_t drain( Consume&& consume )
+  {
+    // the stack comes newest first: reverse it, and put it behind whatever an earlier call left
+    Node* taken = head_.exchange( nullptr, std::memory_order_acquire );
+    Node* const newest = taken;
+    Node* oldest = nullptr;
+    while ( taken ) {
+      Node* const next = taken->next;
+      taken->next = oldest;
+      oldest = taken;
+      taken = next;
+    }
+    if ( newest ) {
+      ( pending_ ? pending_tail_->next : pending_ ) = oldest;
+      pending_tail_ = newest;
+    }
+
+    size_t consumed = 0;
+    while ( pending_ ) {
+      Node* const node = pending_;
+      pending_ = node->next;
+      if ( not pending_ ) {
+        pending_tail_ = nullptr;
+      }
+      const std::unique_ptr<Node> owned { node }; // freed even if consume() throws
+      consume( std::move( node->value ) );
+      ++consumed;
+    }
+    return consumed;
+  }
+
+  //! Whether anything is waiting (a snapshot; the consumer thread only)
+  bool empty() const { return not pending_ and not head_.load( std::memory_order_acquire ); }
+
+  ~MPSCQueue()
+  {
+    for ( Node* list : { head_.load( std::memory_order_acquire ), pending_ } ) {
+      while ( list ) {
+        delete std::exchange( list, list->next );
+      }
+    }
+  }
+
+  MPSCQueue( const MPSCQueue& other ) = delete;
+  MPSCQueue& operator=( const MPSCQueue& other ) = delete;
+
+private:
+  struct Node
+  {
+    T value;
+    Node* next;
+  };
+
+  std::atomic<Node*> head_ { nullptr }; //!< the newest value pushed
+  Node* pending_ {};                     //!< taken by the consumer but not yet consumed, oldest first
+  Node* pending_tail_ {};                //!< the newest of them
+};
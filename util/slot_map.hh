@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+//! Names a value in a SlotMap: the index of its slot, and the generation of that slot when the value was put
+//! there. Erasing the value bumps the generation, so a stale handle finds nothing, even once the slot is reused.
+struct SlotHandle
+{
+  uint32_t index {};
+  uint32_t generation {};
+
+  bool operator==( const SlotHandle& other ) const = default;
+};
+
+//! Values kept contiguously, in the order they were inserted, and named by generational handles.
+//!
+//! Inserting, finding and erasing a value are O(1). Erasing only marks the value dead (and frees its handle at
+//! once): the value itself is destroyed by the next release() or compact(). compact() is also when new values join
+//! the dense array, and when the places of dead ones are squeezed out -- once they are half of it, in one sweep
+//! that keeps the rest in order, so each erase pays for one move (amortized). Nothing moves or goes away in
+//! between, so a reference to a value stays good while code it calls inserts or erases others (or itself).
+template<typename T>
+class SlotMap
+{
+public:
+  using Handle = SlotHandle;
+
+  //! Add a value. It is found by its handle at once, and joins the dense array at the next compact().
+  Handle insert( T value )
+  {
+    uint32_t index {};
+    if ( free_.empty() ) {
+      index = static_cast<uint32_t>( slots_.size() );
+      slots_.emplace_back();
+    } else {
+      index = free_.back();
+      free_.pop_back();
+    }
+
+    slots_[index].position = kStaged | static_cast<uint32_t>( staged_.size() );
+    staged_.push_back( std::move( value ) );
+    staged_owner_.push_back( index );
+    ++size_;
+    return { index, slots_[index].generation };
+  }
+
+  //! The value `handle` names, or nullptr if it has been erased
+  T* find( Handle handle )
+  {
+    if ( handle.index >= slots_.size() or slots_[handle.index].generation != handle.generation ) {
+      return nullptr;
+    }
+    const uint32_t position = slots_[handle.index].position;
+    return position & kStaged ? &staged_[position & ~kStaged] : &*values_[position];
+  }
+
+  //! Erase the value `handle` names (if it is still there). It stays in place, dead, until the next compact().
+  void erase( Handle handle )
+  {
+    if ( not find( handle ) ) {
+      return;
+    }
+    Slot& slot = slots_[handle.index];
+    if ( slot.position & kStaged ) {
+      staged_owner_[slot.position & ~kStaged] = kDead;
+    } else {
+      owner_[slot.position] = kDead;
+      doomed_.push_back( slot.position );
+    }
+    ++slot.generation;
+    free_.push_back( handle.index );
+    --size_;
+    ++dead_;
+  }
+
+  //! Destroy the values in the dense array erased since the last call (moving nothing)
+  void release()
+  {
+    for ( const uint32_t position : doomed_ ) {
+      values_[position].reset();
+    }
+    doomed_.clear();
+  }
+
+  //! release(), and append the values inserted since the last call; squeeze out the places of the dead ones if
+  //! they are half the dense array, keeping everything in order. `cursor`, a position in the dense array, follows
+  //! the value it was on (or the next one left).
+  void compact( size_t& cursor )
+  {
+    release();
+    if ( dead_ * 2 > values_.size() + staged_.size() ) {
+      squeeze( cursor );
+    }
+    for ( size_t i = 0; i < staged_.size(); ++i ) {
+      if ( staged_owner_[i] == kDead ) {
+        --dead_;
+      } else {
+        slots_[staged_owner_[i]].position = static_cast<uint32_t>( values_.size() );
+        values_.emplace_back( std::move( staged_[i] ) );
+        owner_.push_back( staged_owner_[i] );
+      }
+    }
+    staged_.clear();
+    staged_owner_.clear();
+  }
+
+  void compact()
+  {
+    size_t cursor = 0;
+    compact( cursor );
+  }
+
+  size_t size() const { return size_; } //!< values not erased
+  bool empty() const { return size_ == 0; }
+
+  //! The dense array, as of the last compact(). Values erased since are still there, but not live().
+  size_t dense_size() const { return values_.size(); }
+  bool live( size_t position ) const { return owner_[position] != kDead; }
+  T& operator[]( size_t position ) { return *values_[position]; }
+  Handle handle_at( size_t position ) const { return { owner_[position], slots_[owner_[position]].generation }; }
+
+private:
+  static constexpr uint32_t kDead = std::numeric_limits<uint32_t>::max();
+  static constexpr uint32_t kStaged = 1U << 31U; //!< marks a slot whose value is still in staged_
+
+  struct Slot
+  {
+    uint32_t position {}; //!< where the value is: in values_, or (with kStaged) in staged_
+    uint32_t generation {};
+  };
+
+  std::vector<std::optional<T>> values_ {}; //!< empty once a dead value has been destroyed
+  std::vector<uint32_t> owner_ {};          //!< the slot of each value in values_, or kDead once it is erased
+  std::vector<uint32_t> doomed_ {};         //!< positions in values_ erased since the last release()
+  std::deque<T> staged_ {};                 //!< inserted since the last compact(); a deque, so they don't move
+  std::vector<uint32_t> staged_owner_ {};
+  std::vector<Slot> slots_ {};
+  std::vector<uint32_t> free_ {};
+  size_t size_ {};
+  size_t dead_ {}; //!< erased values still taking up a place, in values_ or staged_
+
+  //! Drop the dead values from the dense array, keeping the rest in order
+  void squeeze( size_t& cursor )
+  {
+    size_t kept = 0;
+    size_t new_cursor = values_.size();
+    for ( size_t i = 0; i < values_.size(); ++i ) {
+      if ( i == cursor ) {
+        new_cursor = kept;
+      }
+      if ( owner_[i] == kDead ) {
+        continue;
+      }
+      if ( kept != i ) {
+        values_[kept] = std::move( values_[i] );
+        owner_[kept] = owner_[i];
+      }
+      slots_[owner_[kept]].position = static_cast<uint32_t>( kept );
+      ++kept;
+    }
+    if ( new_cursor > kept ) {
+      new_cursor = kept;
+    }
+    dead_ -= values_.size() - kept;
+    values_.erase( values_.begin() + static_cast<std::ptrdiff_t>( kept ), values_.end() );
+    owner_.resize( kept );
+    cursor = new_cursor;
+  }
+};
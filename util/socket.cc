@@ -200,6 +200,13 @@ void Socket::set_reuseaddr()
   setsockopt( SOL_SOCKET, SO_REUSEADDR, int { true } );
 }
 
+// let other sockets (set the same way, by the same user) bind this address too
+//! \note Each must be set before bind()
+void Socket::set_reuseport()
+{
+  setsockopt( SOL_SOCKET, SO_REUSEPORT, int { true } );
+}
+
 void Socket::throw_if_error() const
 {
   int socket_error = 0;
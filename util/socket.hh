@@ -54,6 +54,10 @@ public:
   //! Allow local address to be reused sooner via [SO_REUSEADDR](\ref man7::socket)
   void set_reuseaddr();
 
+  //! Let several sockets bind the same address via [SO_REUSEPORT](\ref man7::socket); the kernel spreads
+  //! incoming connections (or datagrams) across them
+  void set_reuseport();
+
   //! Check for errors (will be seen on non-blocking sockets)
   void throw_if_error() const;
 };
@@ -0,0 +1,266 @@
+#include "timer_wheel.hh"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+using namespace std;
+
+namespace {
+constexpr uint64_t kMask = 0xFF;
+} // namespace
+
+array<uint32_t, TimerWheel::kExpiring + 1> TimerWheel::make_heads()
+{
+  array<uint32_t, kExpiring + 1> heads {};
+  heads.fill( kNone );
+  return heads;
+}
+
+void TimerWheel::link( uint32_t index, uint16_t list )
+{
+  Timer& timer = timers_[index];
+  timer.list = list;
+  timer.prev = kNone;
+  timer.next = heads_[list];
+  if ( timer.next != kNone ) {
+    timers_[timer.next].prev = index;
+  }
+  heads_[list] = index;
+
+  if ( list != kExpiring ) {
+    occupied_[list / kSlots][( list % kSlots ) / 64] |= uint64_t { 1 } << ( list % 64 );
+  }
+}
+
+void TimerWheel::unlink( uint32_t index )
+{
+  Timer& timer = timers_[index];
+  if ( timer.list == kUnlinked ) {
+    return;
+  }
+
+  if ( timer.prev != kNone ) {
+    timers_[timer.prev].next = timer.next;
+  } else {
+    heads_[timer.list] = timer.next;
+  }
+  if ( timer.next != kNone ) {
+    timers_[timer.next].prev = timer.prev;
+  }
+
+  if ( timer.list != kExpiring and heads_[timer.list] == kNone ) {
+    occupied_[timer.list / kSlots][( timer.list % kSlots ) / 64] &= ~( uint64_t { 1 } << ( timer.list % 64 ) );
+  }
+  timer.list = kUnlinked;
+  timer.prev = timer.next = kNone;
+}
+
+void TimerWheel::place( uint32_t index )
+{
+  // a level holds deadlines less than 256^(level+1) ticks away; the top level's reach stops one of its slots
+  // short, so that a slot there is never the one now_ is in
+  constexpr uint64_t reach
+    = ( uint64_t { 1 } << ( kSlotBits * kLevels ) ) - ( uint64_t { 1 } << ( kSlotBits * ( kLevels - 1 ) ) );
+  const uint64_t deadline = max( timers_[index].deadline, now_ );
+  const uint64_t key = deadline - now_ < reach ? deadline : now_ + reach - 1;
+  const uint64_t delta = key - now_;
+
+  unsigned level = 0;
+  while ( level + 1 < kLevels and delta >= ( uint64_t { 1 } << ( kSlotBits * ( level + 1 ) ) ) ) {
+    ++level;
+  }
+  const auto slot = static_cast<unsigned>( ( key >> ( kSlotBits * level ) ) & kMask );
+  link( index, static_cast<uint16_t>( level * kSlots + slot ) );
+}
+
+void TimerWheel::cascade( unsigned level, unsigned slot )
+{
+  // take the whole list at once; placing each timer relinks it, so there is no need to unlink them one by one
+  uint32_t index = detach( static_cast<uint16_t>( level * kSlots + slot ) );
+  while ( index != kNone ) {
+    const uint32_t next = timers_[index].next;
+    if ( next != kNone ) {
+      __builtin_prefetch( &timers_[next] );
+    }
+    place( index );
+    index = next;
+  }
+}
+
+uint32_t TimerWheel::detach( uint16_t list )
+{
+  const uint32_t head = heads_[list];
+  heads_[list] = kNone;
+  occupied_[list / kSlots][( list % kSlots ) / 64] &= ~( uint64_t { 1 } << ( list % 64 ) );
+  return head;
+}
+
+void TimerWheel::release( uint32_t index )
+{
+  Timer& timer = timers_[index];
+  timer.live = false;
+  timer.callback = nullptr;
+  ++timer.generation;
+  free_.push_back( index );
+  --size_;
+}
+
+TimerWheel::TimerId TimerWheel::add( uint64_t deadline, uint64_t period, CallbackT callback, uint8_t tag )
+{
+  uint32_t index {};
+  if ( free_.empty() ) {
+    index = static_cast<uint32_t>( timers_.size() );
+    timers_.emplace_back();
+  } else {
+    index = free_.back();
+    free_.pop_back();
+  }
+
+  Timer& timer = timers_[index];
+  timer.deadline = deadline;
+  timer.period = period;
+  timer.live = true;
+  timer.tag = tag;
+  timer.callback = move( callback );
+  ++size_;
+  place( index );
+  return { index, timer.generation };
+}
+
+void TimerWheel::cancel( TimerId id )
+{
+  if ( id.index >= timers_.size() ) {
+    return;
+  }
+  Timer& timer = timers_[id.index];
+  if ( not timer.live or timer.generation != id.generation ) {
+    return;
+  }
+  unlink( id.index );
+  release( id.index );
+}
+
+unsigned TimerWheel::next_occupied( unsigned level, unsigned from ) const
+{
+  constexpr unsigned words = kSlots / 64;
+  const auto& bits = occupied_[level];
+  // the first word is checked from `from` on, and once more at the end for the slots before `from`
+  for ( unsigned i = 0; i <= words; ++i ) {
+    const unsigned word = ( from / 64 + i ) % words;
+    uint64_t candidates = bits[word];
+    if ( i == 0 ) {
+      candidates &= ~uint64_t { 0 } << ( from % 64 );
+    } else if ( i == words ) {
+      candidates &= ( uint64_t { 1 } << ( from % 64 ) ) - 1;
+    }
+    if ( candidates != 0 ) {
+      const unsigned slot = word * 64 + static_cast<unsigned>( countr_zero( candidates ) );
+      return ( slot - from ) % kSlots;
+    }
+  }
+  return kSlots;
+}
+
+uint64_t TimerWheel::next_event() const
+{
+  if ( empty() ) {
+    return numeric_limits<uint64_t>::max();
+  }
+
+  uint64_t next = numeric_limits<uint64_t>::max();
+  for ( unsigned level = 0; level < kLevels; ++level ) {
+    // slots above level 0 are visited (cascaded) at multiples of their span: find the first one at or after now_
+    const unsigned shift = kSlotBits * level;
+    const uint64_t span = uint64_t { 1 } << shift;
+    const uint64_t first_visit = ( now_ + span - 1 ) >> shift;
+    if ( ( first_visit << shift ) >= next ) {
+      break; // this level's slots (and those above) come due no sooner than what was already found
+    }
+    const unsigned distance = next_occupied( level, static_cast<unsigned>( first_visit & kMask ) );
+    if ( distance < kSlots ) {
+      next = min( next, ( first_visit + distance ) << shift );
+    }
+  }
+  return next;
+}
+
+size_t TimerWheel::fire( uint16_t list, uint64_t now, const RunnerT& run )
+{
+  size_t fired = 0;
+  while ( heads_[list] != kNone ) {
+    const uint32_t index = heads_[list];
+    unlink( index );
+    const uint32_t generation = timers_[index].generation;
+
+    // the callback may add timers (moving timers_) or cancel this one, so it runs from a local
+    auto callback = move( timers_[index].callback );
+    const uint8_t tag = timers_[index].tag;
+    ++fired;
+    try {
+      if ( run ) {
+        run( tag, callback );
+      } else {
+        callback();
+      }
+    } catch ( ... ) {
+      if ( timers_[index].generation == generation ) {
+        release( index );
+      }
+      // the rest of this tick's timers are overdue: keep them aside for the next advance()
+      if ( list != kExpiring ) {
+        for ( uint32_t rest = detach( list ); rest != kNone; ) {
+          const uint32_t next = timers_[rest].next;
+          link( rest, kExpiring );
+          rest = next;
+        }
+      }
+      throw;
+    }
+
+    Timer& timer = timers_[index];
+    if ( timer.generation != generation ) {
+      continue; // cancelled by its own callback
+    }
+    if ( timer.period == 0 ) {
+      release( index );
+    } else {
+      timer.deadline += timer.period;
+      if ( timer.deadline <= now ) {
+        timer.deadline += ( ( now - timer.deadline ) / timer.period + 1 ) * timer.period;
+      }
+      timer.callback = move( callback );
+      place( index );
+    }
+  }
+  return fired;
+}
+
+size_t TimerWheel::advance( uint64_t now, const RunnerT& run )
+{
+  // timers left over by a callback that threw are overdue
+  size_t fired = fire( kExpiring, now, run );
+  while ( not empty() ) {
+    const uint64_t tick = next_event();
+    if ( tick > now ) {
+      break;
+    }
+
+    // move timers down from every level whose slot boundary this tick is, lowest level first
+    for ( unsigned level = 1; level < kLevels; ++level ) {
+      if ( tick & ( ( uint64_t { 1 } << ( kSlotBits * level ) ) - 1 ) ) {
+        break;
+      }
+      now_ = tick;
+      cascade( level, static_cast<unsigned>( ( tick >> ( kSlotBits * level ) ) & kMask ) );
+    }
+
+    // fire this tick's timers, straight off their slot: anything they add or re-arm is at least a tick
+    // away, and so lands on another slot (or level)
+    now_ = tick + 1;
+    fired += fire( static_cast<uint16_t>( tick & kMask ), now, run );
+  }
+
+  now_ = max( now_, now + 1 );
+  return fired;
+}
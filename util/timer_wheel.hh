@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+//! A hierarchical timing wheel: four levels of 256 slots each, counting in ticks (EventLoop uses milliseconds).
+//! Level 0 holds the timers due in the next 256 ticks, one slot per tick; each level above covers 256 times
+//! the span of the one below, and its slots are cascaded down as time reaches them. Deadlines further out
+//! than the top level reaches wait there and are placed again when it is cascaded.
+//!
+//! Adding and cancelling a timer are O(1), and so is firing one. Timers live in one array, reused through a
+//! free list; each slot is an intrusive list through that array, and a handle is an index plus a generation,
+//! so a stale handle can't cancel a timer that reused its place.
+class TimerWheel
+{
+public:
+  using CallbackT = std::function<void( void )>;
+
+  //! Runs a due timer's callback, told the tag it was added with: lets the owner wrap every callback (EventLoop
+  //! times each against its rule category) without wrapping each one as it is added
+  using RunnerT = std::function<void( uint8_t tag, CallbackT& callback )>;
+
+  //! Identifies a timer; stays valid (and harmless to cancel) after the timer is gone
+  struct TimerId
+  {
+    uint32_t index {};
+    uint32_t generation {};
+  };
+
+  //! Start the wheel at tick `now`.
+  explicit TimerWheel( uint64_t now = 0 ) : now_( now ) {}
+
+  //! Call `callback` at tick `deadline` (or on the next tick, if that has passed), and then every `period`
+  //! ticks after it if `period` is nonzero, until cancelled. A periodic timer that falls behind skips the
+  //! periods it missed instead of firing once for each. The `tag` is the owner's, passed back to the runner.
+  TimerId add( uint64_t deadline, uint64_t period, CallbackT callback, uint8_t tag = 0 );
+
+  //! Stop a timer. Does nothing if it has already fired (one-shot) or been cancelled.
+  void cancel( TimerId id );
+
+  //! Fire every timer due at or before tick `now`, in deadline order. Returns the number fired. If a callback
+  //! throws, its timer is cancelled and the exception propagates; the rest of the tick fires next time.
+  //! With a `run`, each callback is run through it.
+  size_t advance( uint64_t now, const RunnerT& run = nullptr );
+
+  //! The first tick at which advance() has something to do (fire timers, or move some down a level), or
+  //! max() if there are no timers. Never less than the next tick to be processed.
+  uint64_t next_event() const;
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+private:
+  static constexpr unsigned kLevels = 4;
+  static constexpr unsigned kSlotBits = 8;
+  static constexpr unsigned kSlots = 1U << kSlotBits;
+  static constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+  static constexpr uint16_t kExpiring = kLevels * kSlots; //!< overdue timers, left by a callback that threw
+  static constexpr uint16_t kUnlinked = kExpiring + 1;
+
+  struct alignas( 64 ) Timer // one cache line each: a timer is touched at random, a few times over its life
+  {
+    uint64_t deadline {};
+    uint64_t period {};
+    uint32_t prev { kNone };
+    uint32_t next { kNone };
+    uint32_t generation {};
+    uint16_t list { kUnlinked }; //!< which list the timer is on: level * kSlots + slot, or kExpiring
+    bool live {};
+    uint8_t tag {}; //!< fits in what would be padding before the callback
+    CallbackT callback {};
+  };
+
+  uint64_t now_;      //!< the next tick to process
+  size_t size_ {};    //!< live timers
+  std::vector<Timer> timers_ {};
+  std::vector<uint32_t> free_ {};
+  std::array<uint32_t, kExpiring + 1> heads_ = make_heads(); //!< first timer of each list
+  std::array<std::array<uint64_t, kSlots / 64>, kLevels> occupied_ {}; //!< bitmap of nonempty slots per level
+
+  static std::array<uint32_t, kExpiring + 1> make_heads();
+
+  void link( uint32_t index, uint16_t list );
+  void unlink( uint32_t index );
+  void place( uint32_t index ); //!< put a timer on the slot its deadline belongs in, relative to now_
+  void cascade( unsigned level, unsigned slot );
+  void release( uint32_t index );
+  uint32_t detach( uint16_t list ); //!< empty a slot, returning its first timer (the rest still chained on)
+  size_t fire( uint16_t list, uint64_t now, const RunnerT& run ); //!< run (and re-arm or release) a list's timers
+
+  //! The first slot at or after `from` (circularly) that holds timers on `level`, as a distance from `from`,
+  //! or kSlots if the level is empty
+  unsigned next_occupied( unsigned level, unsigned from ) const;
+};